@@ -0,0 +1,77 @@
+// Ivan Bystrov
+// 18 October 2026
+//
+// Pins the cpu blur threads to cpus picked from the topology of the host (compact, scatter or an explicit list), and reports where they run
+
+#ifndef AFFINITY_SEEN
+#define AFFINITY_SEEN
+
+#include <stdbool.h>
+#include <pthread.h>
+
+
+/**
+ * Struct storing the cpus the threads of the cpu blur are pinned to
+ * mode : 'c' fills the cpus of one NUMA node (and core) before the next, 's' spreads over the nodes and cores first, 'l' uses the given list
+ * num_cpus : number of cpus in cpus (thread t runs on cpus[t % num_cpus], so more threads than cpus share them)
+ * cpus : the cpu of each thread, in the order of the mode (malloced)
+ * nodes : the NUMA node of each cpu in cpus (-1 if the host doesn't say)
+ * packages : the socket of each cpu in cpus (-1 if the host doesn't say)
+ */
+struct Thread_Placement {
+	char mode;
+	unsigned num_cpus;
+	int *cpus;
+	int *nodes;
+	int *packages;
+};
+
+/**
+ * Parses a comma separated list of cpus and ranges of cpus (like 0,2,4-7)
+ * @param input : the list to parse
+ * @param [output] cpus : the (malloced) cpus of the list in order, only set if the list is valid
+ * @param [output] num_cpus : the number of cpus in the list
+ * @return true if input is a valid list, false otherwise
+ */
+bool parse_cpu_list(char *input, int **cpus, unsigned *num_cpus);
+
+/**
+ * Works out which cpu each thread is pinned to, from the cpus this process may run on and their NUMA node, socket and core
+ * @param [output] placement : the placement to set up
+ * @param mode : 'c' for compact, 's' for scatter, 'l' for the cpus of list
+ * @param list : the cpus to use in order (only used if mode is 'l', the placement takes it over)
+ * @param list_len : number of cpus in list
+ */
+void init_thread_placement(struct Thread_Placement *placement, char mode, int *list, unsigned list_len);
+
+/**
+ * Gets the cpu a thread is pinned to
+ * @param placement : the placement of the threads (NULL means threads aren't pinned)
+ * @param thread : the index of the thread in its pass
+ * @return the cpu, or -1 if the thread isn't pinned
+ */
+int placement_cpu(struct Thread_Placement *placement, unsigned thread);
+
+/**
+ * Starts a thread, pinned to a cpu before it runs (so everything it first touches is put on the NUMA node of that cpu)
+ * @param [output] thread : where the id of the thread is stored
+ * @param thread_func : the function the thread runs
+ * @param arg : the parameter passed to thread_func
+ * @param cpu : the cpu to pin the thread to (-1 means don't pin it)
+ */
+void create_pinned_thread(pthread_t *thread, void *(*thread_func)(void *), void *arg, int cpu);
+
+/**
+ * Outputs the cpu, NUMA node and socket each thread of a pass runs on, and how many threads each node has
+ * @param placement : the placement of the threads
+ * @param num_threads : the number of threads of each pass
+ */
+void print_thread_placement(struct Thread_Placement *placement, unsigned num_threads);
+
+/**
+ * Frees the arrays of a placement
+ * @param placement : the placement to free
+ */
+void free_thread_placement(struct Thread_Placement *placement);
+
+#endif /* AFFINITY_SEEN */
@@ -0,0 +1,75 @@
+// Ivan Bystrov
+// 18 October 2026
+//
+// Picks the blur engine and number of threads from a cost model calibrated for this host
+
+#ifndef AUTO_SELECT_SEEN
+#define AUTO_SELECT_SEEN
+
+#include <stdbool.h>
+
+// Filename of the calibration profile (stored in the home directory, or the working directory if there is no home)
+#define PROFILE_FILENAME ".gaussian_blur_profile"
+
+
+/**
+ * Struct storing how long each engine takes on this host
+ * calibrated : true if the values were read from a calibration profile, false if they are defaults
+ * cpu_pixel_ns : nanoseconds per pixel the exact (planar) cpu blur takes on one thread, not counting the kernel taps
+ * cpu_tap_ns : nanoseconds per pixel per kernel tap (of both passes) the exact cpu blur takes on one thread
+ * cpu_approx_ns : nanoseconds per pixel the approximate cpu blur takes on one thread (the same for any standard deviation)
+ * thread_us : microseconds to create and join one thread for one pass
+ * gpu : 1 if there is a gpu to blur on, 0 otherwise
+ * gpu_setup_ms : milliseconds to set up and release the gpu (building the program, creating the images)
+ * gpu_pixel_ns : nanoseconds per pixel the gpu blur takes, not counting the kernel taps (mostly the transfers)
+ * gpu_tap_ns : nanoseconds per pixel per kernel tap (of both passes) the gpu blur takes
+ */
+struct Cost_Profile {
+	bool calibrated;
+	float cpu_pixel_ns;
+	float cpu_tap_ns;
+	float cpu_approx_ns;
+	float thread_us;
+	unsigned gpu;
+	float gpu_setup_ms;
+	float gpu_pixel_ns;
+	float gpu_tap_ns;
+};
+
+/**
+ * Struct storing the engine picked for a blur
+ * device : 'c' for the cpu, 'g' for the gpu
+ * threads : number of threads (only used if device is 'c')
+ * approx : 1 if the approximate cpu blur was picked, 0 otherwise
+ * estimated_duration : how long the blur is expected to take in seconds
+ */
+struct Engine_Choice {
+	char device;
+	unsigned threads;
+	unsigned approx;
+	float estimated_duration;
+};
+
+/**
+ * Reads the calibration profile of this host (or uses default values if there is none)
+ * @param [output] profile : struct to store the profile in
+ */
+void load_cost_profile(struct Cost_Profile *profile);
+
+/**
+ * Times every engine on synthetic images and writes the calibration profile of this host
+ */
+void calibrate_cost_profile(void);
+
+/**
+ * Picks the engine and number of threads expected to blur an image the fastest
+ * @param profile : how long each engine takes on this host
+ * @param width : width of the image in pixels
+ * @param height : height of the image in pixels
+ * @param std_dev : standard deviation of the blur
+ * @param allow_approx : true if the approximate cpu blur can be picked
+ * @param [output] choice : the picked engine
+ */
+void choose_engine(struct Cost_Profile *profile, unsigned width, unsigned height, float std_dev, bool allow_approx, struct Engine_Choice *choice);
+
+#endif /* AUTO_SELECT_SEEN */
@@ -0,0 +1,37 @@
+// Ivan Bystrov
+// 18 October 2026
+//
+// Blurs a list of images in batches of the same size class, so the gpu blurs a whole batch of small images in one dispatch per pass
+
+#ifndef BATCH_SEEN
+#define BATCH_SEEN
+
+#include "blur_cpu.h"
+#include "blur_gpu.h"
+#include "img_arena.h"
+
+
+/**
+ * Reads the list of images to blur, one filename per line (empty lines are skipped)
+ * @param list_filename : filepath to the list
+ * @param [output] num_images : the number of images in the list
+ * @return the (malloced) filenames of the images (each one malloced)
+ */
+char **read_batch_list(char *list_filename, unsigned *num_images);
+
+/**
+ * Blurs every image of a list and writes each one to its output file
+ * The images are sorted into size classes, and consecutive images of a class are blurred together as one batch
+ * @param input_filenames : the filenames of the images to blur
+ * @param output_filenames : the filenames to write the blurred images to (in the same order as input_filenames)
+ * @param num_images : the number of images
+ * @param std_dev : desired standard deviation of the gaussian blur
+ * @param device : 'c' to blur on the cpu (one image after another), 'g' to blur each batch on the gpu in one dispatch per pass
+ * @param cpu_config : how the cpu blur should be performed (only used if device is 'c', the area is ignored)
+ * @param gpu_config : how the gpu blur should be performed (only used if device is 'g', the area is ignored, needs images that are not linear)
+ * @param arena : the arena the images of each batch are loaded into (and handed back to after the batch is written)
+ */
+void blur_batch(char **input_filenames, char **output_filenames, unsigned num_images, unsigned std_dev, char device,
+		struct Cpu_Config *cpu_config, struct Gpu_Config *gpu_config, struct Img_Arena *arena);
+
+#endif /* BATCH_SEEN */
@@ -7,14 +7,95 @@
 #define BLUR_CPU_SEEN
 
 #include "process_png.h"
+#include "blur_helpers.h"
+#include "perf_counters.h"
+#include "affinity.h"
 
 
+/**
+ * Struct storing how the cpu blur should be performed
+ * num_threads : number of threads to use for the blur
+ * planar : 1 means deinterleave the image into R, G, B planes and blur those (alpha is never touched), 0 means blur interleaved RGBA
+ * area : the parts of the image to blur, all other pixels pass through unchanged (NULL means blur the whole image)
+ * approx : 1 means approximate the gaussian blur of the whole image with box blurs (ignores planar, area and op), 0 means blur exactly
+ * op : the operation to output instead of the blurred image, fused into the last pass (NULL means output the blurred image)
+ * perf : where the hardware counters of every thread in every pass are stored (NULL means they aren't counted)
+ * placement : the cpu each thread is pinned to (NULL means threads aren't pinned)
+ */
+struct Cpu_Config {
+	unsigned num_threads;
+	unsigned planar;
+	struct Blur_Area *area;
+	unsigned approx;
+	struct Blur_Op *op;
+	struct Perf_Report *perf;
+	struct Thread_Placement *placement;
+};
+
+/**
+ * Performs cpu blur with an already calculated gaussian kernel (prints nothing, so it can be used for every frame of a stream)
+ * @param img_datap : struct storing all the info of the input image, the blurred image is stored in img_datap->arrays[0]
+ * @param gaussian_kernel : the 1D convolution kernel that will apply the blur
+ * @param gaussian_kernel_len : the length of the kernel
+ * @param config : how the blur should be performed (number of threads, image layout, area to blur)
+ */
+void blur_cpu_with_kernel(struct Img_Data *img_datap, float *gaussian_kernel, unsigned gaussian_kernel_len, struct Cpu_Config *config);
+
+/**
+ * Blurs the image and downscales it in one go, only computing the blurred pixels the downscaled image samples
+ * (the result is the same as blurring the whole image and then sampling it at SAMPLE_POSITION)
+ * @param img_datap : struct storing all the info of the input image (in img_datap->arrays[0], which is not changed)
+ * @param gaussian_kernel : the 1D convolution kernel that will apply the blur
+ * @param gaussian_kernel_len : the length of the kernel
+ * @param num_threads : number of threads to use for the blur
+ * @param placement : the cpu each thread is pinned to (NULL means threads aren't pinned)
+ * @param out_width : width of the downscaled image in pixels (at most the width of the input image)
+ * @param out_height : height of the downscaled image in pixels (at most the height of the input image)
+ * @param [output] out_pixels : the downscaled RGBA pixels (out_width * out_height)
+ */
+void blur_cpu_resized(struct Img_Data *img_datap, float *gaussian_kernel, unsigned gaussian_kernel_len, unsigned num_threads,
+		struct Thread_Placement *placement, unsigned out_width, unsigned out_height, unsigned char *out_pixels);
+
+/**
+ * Zeroes arrays of height rows, each band of rows by the pinned thread that blurs it when the whole image is blurred,
+ * so the kernel puts the pages of every band on the NUMA node of its thread (only pages that were never touched are placed)
+ * @param arrays : the arrays to touch
+ * @param num_arrays : number of arrays in arrays
+ * @param height : number of rows of each array
+ * @param row_stride : bytes between the starts of two rows of each array
+ * @param config : how the cpu blur will be performed (the number of threads and their placement)
+ */
+void first_touch_arrays(unsigned char **arrays, unsigned num_arrays, unsigned height, size_t row_stride, struct Cpu_Config *config);
+
+/**
+ * First touches the memory blur_cpu_with_kernel allocates next from the arena for an image of this size (the colour planes of the planar
+ * and approximate blurs, then the second temp array of a difference of gaussians), and hands it back so the blur gets the same memory
+ * @param arena : the arena the blur will allocate from (nothing else may be allocated from it before the blur for the memory to line up)
+ * @param width : width of the image in pixels
+ * @param height : height of the image in rows
+ * @param row_stride : bytes between the starts of two rows of the image arrays
+ * @param config : how the cpu blur will be performed
+ */
+void first_touch_blur_scratch(struct Img_Arena *arena, unsigned width, unsigned height, unsigned row_stride, struct Cpu_Config *config);
+
+/**
+ * First touches the memory the arrays of an image are allocated from next (by load_image_arrays), and then the scratch memory of its blur,
+ * so the kernel puts the pages of every band on the NUMA node of the thread that blurs it (the memory is handed back to the arena, and allocated again in the same place)
+ * @param arena : the arena the image arrays will be allocated from (its memory must not have been touched yet for this to place anything)
+ * @param width : width of the image in pixels
+ * @param height : height of the image in rows
+ * @param row_stride : bytes between the starts of two rows of the arrays
+ * @param num_arrays : how many arrays of row_stride * height bytes will be allocated (2, or 1 for a raw image whose arrays[0] is its mapping)
+ * @param config : how the cpu blur will be performed (the number of threads and their placement)
+ */
+void first_touch_img_arrays(struct Img_Arena *arena, unsigned width, unsigned height, unsigned row_stride, unsigned num_arrays, struct Cpu_Config *config);
+
 /**
  * Performs cpu blur on the input image and stores it in new image space
  * @param img_data : struct storing all the info of the input image
  * @param std_dev : desired standard deviation of the gaussian_blur
- * @param config : number of threads to use for the blur
+ * @param config : how the blur should be performed (number of threads, image layout, area to blur)
  */
-void blur_cpu(struct Img_Data *img_data, unsigned std_dev, unsigned num_threads);
+void blur_cpu(struct Img_Data *img_data, unsigned std_dev, struct Cpu_Config *config);
 
 #endif /* BLUR_CPU_SEEN */
@@ -6,14 +6,105 @@
 #ifndef BLUR_GPU_SEEN
 #define BLUR_GPU_SEEN
 
+#include <stdbool.h>
 #include "process_png.h"
+#include "blur_helpers.h"
 
 
+/**
+ * Struct storing how the gpu blur should be performed
+ * area : the parts of the image to blur, all other pixels pass through unchanged (NULL means blur the whole image)
+ * linear : 1 means blur CL_UNORM_INT8 images with linear filtering, merging each pair of taps into one fetch, 0 means read every tap
+ * memory : 'i' to blur images, 'b' to blur packed RGBA buffers, 'a' to use images on gpus and buffers on other OpenCL devices (like cpus)
+ * num_bands : number of horizontal bands whole images are uploaded, blurred and downloaded in at the same time (1 means the whole image at once)
+ * op : the operation to output instead of the blurred image, fused into the last pass (NULL means output the blurred image, needs images that are not linear)
+ */
+struct Gpu_Config {
+	struct Blur_Area *area;
+	unsigned linear;
+	char memory;
+	unsigned num_bands;
+	struct Blur_Op *op;
+};
+
+/**
+ * All the OpenCL objects needed to blur images of one size with one gaussian kernel (defined in blur_gpu.c)
+ */
+struct Gpu_Context;
+
+/**
+ * Checks if there is an OpenCL device to blur on, the same way create_gpu_context looks for it (but without exiting if there isn't)
+ * @return true if there is an OpenCL device, false otherwise
+ */
+bool gpu_available(void);
+
+/**
+ * Sets up the gpu to blur images the size of img_datap with gaussian_kernel (the images stay allocated until the context is released)
+ * @param img_datap : struct storing the info of the (first) image to blur
+ * @param gaussian_kernel : the 1D convolution kernel that will apply the blur
+ * @param gaussian_kernel_len : the length of the kernel
+ * @param config : how the gpu blur should be performed (the area is ignored, it is given to each blur instead)
+ * @return the (malloced) gpu context
+ */
+struct Gpu_Context *create_gpu_context(struct Img_Data *img_datap, float *gaussian_kernel, unsigned gaussian_kernel_len, struct Gpu_Config *config);
+
+/**
+ * Changes the gaussian kernel a gpu context blurs with (without building the program again)
+ * @param ctx : the gpu context to change
+ * @param gaussian_kernel : the new 1D convolution kernel
+ * @param gaussian_kernel_len : the length of the new kernel
+ */
+void set_gpu_context_kernel(struct Gpu_Context *ctx, float *gaussian_kernel, unsigned gaussian_kernel_len);
+
+/**
+ * Blurs an image on the gpu with an existing context (the image must be the size the context was created for)
+ * @param ctx : the gpu context to blur with
+ * @param img_datap : struct storing all the info of the image, the blurred image is stored in img_datap->arrays[0]
+ * @param area : the parts of the image to blur (NULL means blur the whole image, which a context created with an operation always does)
+ */
+void blur_gpu_with_context(struct Gpu_Context *ctx, struct Img_Data *img_datap, struct Blur_Area *area);
+
+/**
+ * Blurs an image on the gpu and downscales it in one go, with an existing context (the image must be the size the context was created for)
+ * Only the blurred pixels the downscaled image samples are computed, the result is the same as blurring the whole image and sampling it at SAMPLE_POSITION
+ * @param ctx : the gpu context to blur with (must use images that are not normalized, so not linear or buffers)
+ * @param img_datap : struct storing all the info of the image (in img_datap->arrays[0], which is not changed)
+ * @param out_width : width of the downscaled image in pixels (at most the width of the image)
+ * @param out_height : height of the downscaled image in pixels (at most the height of the image)
+ * @param [output] out_pixels : the downscaled RGBA pixels (out_width * out_height)
+ */
+void blur_gpu_resized_with_context(struct Gpu_Context *ctx, struct Img_Data *img_datap, unsigned out_width, unsigned out_height, unsigned char *out_pixels);
+
+/**
+ * Gets the most images blur_gpu_batch_with_context can blur in one batch on the device of a gpu context
+ * @param ctx : the gpu context
+ * @return the most layers an image array can have (0 if the context uses buffers, which can't blur batches)
+ */
+unsigned gpu_max_batch_layers(struct Gpu_Context *ctx);
+
+/**
+ * Blurs a batch of images on the gpu with one dispatch per pass, with each image in its own layer of a 2D image array
+ * Each image is clamped at its own edges, so it is blurred the same as on its own, but the batch only costs two kernel launches
+ * @param ctx : the gpu context to blur with (must use images that are not normalized, so not linear or buffers)
+ * @param imgs : the images to blur (in their arrays[0]), each one is blurred in place
+ * @param num_imgs : the number of images in the batch (at most gpu_max_batch_layers)
+ * @param width : the width of the size class in pixels (at least the width of every image)
+ * @param height : the height of the size class in pixels (at least the height of every image)
+ */
+void blur_gpu_batch_with_context(struct Gpu_Context *ctx, struct Img_Data **imgs, unsigned num_imgs, unsigned width, unsigned height);
+
+/**
+ * Releases all the OpenCL objects of a gpu context and frees it
+ * @param ctx : the gpu context to release
+ */
+void release_gpu_context(struct Gpu_Context *ctx);
+
 /**
  * Performs gpu blur (using OpenCL) on the input image and stores it in the new image space
  * @param img_datap : struct storing all the info of the input image
  * @param std_dev : desired standard deviation of the gaussian_blur
+ * @param config : how the blur should be performed (area to blur, linear filtering)
  */
-void blur_gpu(struct Img_Data *img_datap, unsigned std_dev); 
+void blur_gpu(struct Img_Data *img_datap, unsigned std_dev, struct Gpu_Config *config); 
 
 #endif /* BLUR_GPU_SEEN */
@@ -8,6 +8,71 @@
 
 #define RADIUS 3
 
+// Number of merged taps calculate_linear_taps makes from a kernel of length len
+#define LINEAR_TAPS_LEN(len) (((len) + 1) / 2)
+
+// Number of box blurs used to approximate a gaussian blur
+#define NUM_BOXES 3
+
+// Side length in pixels of the square tiles a mask is broken into when finding the regions to blur
+#define MASK_TILE_SIZE 32
+
+// Pixel of a line of in_len pixels that output pixel i of a line downscaled to out_len pixels is sampled at (the one under the centre of its footprint)
+#define SAMPLE_POSITION(i, in_len, out_len) ((unsigned) ((2 * (unsigned long long) (i) + 1) * (in_len) / (2 * (unsigned long long) (out_len))))
+
+/**
+ * Rectangle of pixels in the image
+ * x : column of the left edge of the rectangle
+ * y : row of the top edge of the rectangle
+ * width : width of the rectangle in pixels
+ * height : height of the rectangle in pixels
+ */
+struct Region {
+	unsigned x;
+	unsigned y;
+	unsigned width;
+	unsigned height;
+};
+
+/**
+ * Struct storing which pixels of the image should be blurred (every other pixel passes through unchanged)
+ * regions : rectangles of the image to blur
+ * num_regions : number of rectangles in regions
+ * mask : width * height bytes, only pixels inside regions with a non zero mask byte are blurred (NULL means all pixels inside regions are)
+ */
+struct Blur_Area {
+	struct Region *regions;
+	unsigned num_regions;
+	unsigned char *mask;
+};
+
+/**
+ * Struct storing the operation built on the blur that is output instead of the blurred image (fused into the last pass of the blur)
+ * type : 'u' for an unsharp mask (original + amount * (original - blurred)), 'd' for a difference of gaussians (128 + blurred - blurred with dog_std_dev)
+ * amount : how much the unsharp mask sharpens (only used if type is 'u')
+ * dog_std_dev : standard deviation of the blur subtracted by the difference of gaussians (only used if type is 'd')
+ */
+struct Blur_Op {
+	char type;
+	float amount;
+	unsigned dog_std_dev;
+};
+
+
+/**
+ * Calculates the length of the 1D gaussian convolution kernel for any (not necessarily integer) standard deviation
+ * @param std_dev : the standard deviation of the gaussian filter
+ * @return the length of the kernel in pixels (always odd, RADIUS standard deviations on each side rounded up)
+ */
+unsigned kernel_len_for_std_dev(float std_dev);
+
+/**
+ * Calculates the values for all the elements of the 1D gaussian convolution kernel for any standard deviation (values are normalized)
+ * @param [output] gaussian_kernel : the 1D kernel to fill the values with
+ * @param gaussian_kernel_len : length of the gaussian kernel in pixels (the target pixel is in the middle)
+ * @param std_dev : the standard deviation of the gaussian filter
+ */
+void calculate_kernel_float(float **gaussian_kernel, unsigned gaussian_kernel_len, float std_dev);
 
 /**
  * Calculates the values for all the elements of the 1D gaussian convolution kernel (values are normalized)
@@ -16,6 +81,30 @@
  */
 void calculate_kernel(float **gaussian_kernel, unsigned gaussian_kernel_len, unsigned std_dev);
 
+/**
+ * Merges each pair of neighbouring taps of a 1D convolution kernel into one tap that samples between the two pixels,
+ * so a sampler with linear filtering reads both pixels (weighted by the fraction) in one fetch
+ * @param gaussian_kernel : the 1D convolution kernel to merge
+ * @param gaussian_kernel_len : the length of the kernel (the target pixel is at gaussian_kernel_len / 2)
+ * @param [output] linear_taps : LINEAR_TAPS_LEN(gaussian_kernel_len) pairs of (offset in pixels from the target pixel, weight)
+ */
+void calculate_linear_taps(float *gaussian_kernel, unsigned gaussian_kernel_len, float *linear_taps);
+
+/**
+ * Calculates the widths of NUM_BOXES box blurs that applied one after another approximate a gaussian blur
+ * @param [output] box_widths : NUM_BOXES odd box widths in pixels
+ * @param std_dev : the standard deviation of the gaussian filter being approximated
+ */
+void calculate_box_widths(unsigned *box_widths, float std_dev);
+
+/**
+ * Calculates the standard deviation of a (normalized, symmetric) 1D convolution kernel
+ * @param gaussian_kernel : the kernel
+ * @param gaussian_kernel_len : the length of the kernel in pixels
+ * @return the standard deviation of the kernel
+ */
+float kernel_std_dev(float *gaussian_kernel, unsigned gaussian_kernel_len);
+
 /**
  * Prints out the gaussian kernel to be used in the program
  * @param gaussian_kernel : pointer to the kernel to be output
@@ -23,4 +112,46 @@ void calculate_kernel(float **gaussian_kernel, unsigned gaussian_kernel_len, uns
  */
 void print_kernel(float *gaussian_kernel, unsigned gaussian_kernel_len);
 
+/**
+ * Grows a region by a halo on each side, without letting it extend past the edges of the image
+ * @param region : the region to grow
+ * @param halo_x : number of columns to add to the left and right of the region
+ * @param halo_y : number of rows to add to the top and bottom of the region
+ * @param width : width of the image in pixels
+ * @param height : height of the image in pixels
+ * @return the grown region
+ */
+struct Region expand_region(struct Region region, unsigned halo_x, unsigned halo_y, unsigned width, unsigned height);
+
+/**
+ * Clips every region to the image and removes the regions that end up empty
+ * @param regions : the regions to clip
+ * @param num_regions : number of regions
+ * @param width : width of the image in pixels
+ * @param height : height of the image in pixels
+ * @return the number of regions left (they are moved to the front of regions)
+ */
+unsigned clip_regions(struct Region *regions, unsigned num_regions, unsigned width, unsigned height);
+
+/**
+ * Turns a map of marked tiles into regions, merging each horizontal run of marked tiles into one region
+ * @param tile_map : tiles_x * tiles_y bytes, non zero means the tile is marked
+ * @param tile_size : side length of each tile in pixels
+ * @param width : width of the image in pixels
+ * @param height : height of the image in pixels
+ * @param [output] regions : pointer to where the (malloced) array of regions is stored
+ * @return the number of regions
+ */
+unsigned regions_from_tile_map(unsigned char *tile_map, unsigned tile_size, unsigned width, unsigned height, struct Region **regions);
+
+/**
+ * Finds the regions that cover all the non zero bytes of a mask, in MASK_TILE_SIZE tiles
+ * @param mask : width * height bytes, non zero means the pixel should be blurred
+ * @param width : width of the image in pixels
+ * @param height : height of the image in pixels
+ * @param [output] regions : pointer to where the (malloced) array of regions is stored
+ * @return the number of regions
+ */
+unsigned regions_from_mask(unsigned char *mask, unsigned width, unsigned height, struct Region **regions);
+
 #endif /* BLUR_HELPERS_SEEN */
@@ -7,9 +7,9 @@
 #define ERROR_SEEN
 
 /**
- * Outputs error message and exits program
+ * Outputs error message and exits program (marked noreturn, so the compiler knows nothing after a failed check runs)
  * @param error_msg : the error message to be output, if NULL use perror
  */
-void error(char *error_msg); 
+void error(char *error_msg) __attribute__((noreturn)); 
 
 #endif /* ERROR_SEEN */
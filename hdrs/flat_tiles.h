@@ -0,0 +1,28 @@
+// Ivan Bystrov
+// 18 October 2026
+//
+// Finds the parts of an image that are one flat colour so blurring them can be skipped
+
+#ifndef FLAT_TILES_SEEN
+#define FLAT_TILES_SEEN
+
+#include "process_png.h"
+#include "blur_helpers.h"
+
+// Side length in pixels of the square tiles the minimum and maximum of each colour component are found for
+#define FLAT_TILE_SIZE 32
+
+
+/**
+ * Finds the regions of the output image that have to be blurred, leaving out every tile whose whole kernel footprint is one colour
+ * (the cpu blur of a flat footprint gives back that colour, which is already the input pixel, so those tiles are left as they are,
+ * the first gpu pass truncates instead of rounding so a full gpu blur can give back one less than that colour)
+ * Tiles whose footprint reaches past the edge of the image are always blurred, since the taps past the edge are dropped by the cpu blur
+ * @param img_datap : struct storing the input image (in img_datap->arrays[0])
+ * @param offset : the index of the target pixel in the gaussian kernel (how far the footprint of a pixel reaches)
+ * @param [output] regions : pointer to where the (malloced) array of regions is stored
+ * @return the number of regions
+ */
+unsigned find_non_flat_regions(struct Img_Data *img_datap, unsigned offset, struct Region **regions);
+
+#endif /* FLAT_TILES_SEEN */
@@ -0,0 +1,32 @@
+// Ivan Bystrov
+// 18 October 2026
+//
+// Unrolled cpu blur kernels for each small radius, which fold the mirrored taps of the symmetric gaussian kernel
+
+#ifndef FOLDED_KERNELS_SEEN
+#define FOLDED_KERNELS_SEEN
+
+#include <stddef.h>
+
+// Largest radius (offset of the target pixel in the kernel) with an unrolled kernel, which covers standard deviations up to 8
+#define MAX_FOLDED_RADIUS 24
+
+
+/**
+ * An unrolled kernel, which calculates the weighted R, G, B sums of a pixel whose taps are all inside the image
+ * @param center : the target pixel in the image array
+ * @param step : bytes between two neighbouring taps (the pixel length for a horizontal pass, the row stride for a vertical pass)
+ * @param half_kernel : the target pixel's element of the kernel, followed by the elements of the taps 1, 2, ... pixels away
+ * @param [output] sums : the 3 weighted sums
+ */
+typedef void (*Folded_Sums_Func)(unsigned char *center, size_t step, float *half_kernel, float *sums);
+
+/**
+ * Gets the unrolled kernel of a radius
+ * @param gaussian_kernel_len : the length of the kernel (must be symmetric, like every kernel from calculate_kernel)
+ * @param offset : the index of the target pixel in the kernel
+ * @return the unrolled kernel, or NULL if there isn't one for this radius (the generic loop has to be used)
+ */
+Folded_Sums_Func get_folded_sums(unsigned gaussian_kernel_len, unsigned offset);
+
+#endif /* FOLDED_KERNELS_SEEN */
@@ -0,0 +1,98 @@
+// Ivan Bystrov
+// 18 October 2026
+//
+// Reads and writes images in every supported format (PNG, raw RGBA, PAM, PPM and QOI), picked from the file extension
+
+#ifndef IMAGE_IO_SEEN
+#define IMAGE_IO_SEEN
+
+#include "process_png.h"
+#include "img_arena.h"
+
+// Size in bytes of the header of raw images ("RGBA", then the width, height and row stride as little endian 32 bit integers, then zeros)
+// It is a whole cache line so the rows of a mapped raw image stay aligned
+#define RAW_HEADER_SIZE 64
+
+
+/**
+ * The formats images can be read from and written to
+ * FORMAT_UNKNOWN : the extension isn't one of the supported formats
+ * FORMAT_PNG : .png, 8 bit RGBA PNG (through libpng)
+ * FORMAT_RAW : .rgba, a RAW_HEADER_SIZE byte header then the rows of RGBA pixels (mapped straight into memory when read)
+ * FORMAT_PAM : .pam, netpbm P7 with a depth of 4 (RGB_ALPHA) or 3 (RGB, read with an alpha of 255)
+ * FORMAT_PPM : .ppm, netpbm P6 (read with an alpha of 255, alpha is dropped when written)
+ * FORMAT_QOI : .qoi, the Quite OK Image format
+ */
+enum Image_Format {
+	FORMAT_UNKNOWN,
+	FORMAT_PNG,
+	FORMAT_RAW,
+	FORMAT_PAM,
+	FORMAT_PPM,
+	FORMAT_QOI
+};
+
+/**
+ * Gets the format of an image file from its extension
+ * @param filename : the filename of the image
+ * @return the format of the image (FORMAT_UNKNOWN if the extension isn't supported)
+ */
+enum Image_Format image_format(char *filename);
+
+/**
+ * Reads the size of an image and outputs its core information (the pixels are loaded by load_image_arrays)
+ * PNG images are decoded by libpng, every other format is mapped into memory
+ * @param [output] img_datap : pointer to struct storing input image data needed for program
+ * @param filename : filepath to the image (its extension picks the format)
+ */
+void read_image(struct Img_Data *img_datap, char *filename);
+
+/**
+ * Reads an image like read_image, without outputting anything (the colour type of a PNG image is not checked, read_image_size checks it)
+ * @param [output] img_datap : pointer to struct storing input image data needed for program
+ * @param filename : filepath to the image (its extension picks the format)
+ */
+void open_image(struct Img_Data *img_datap, char *filename);
+
+/**
+ * Reads only the size of an image, from the header of a PNG image or the start of a mapping of any other format (nothing is decoded or output)
+ * @param filename : filepath to the image (its extension picks the format)
+ * @param [output] width : width of the image in pixels
+ * @param [output] height : height of the image in pixels
+ */
+void read_image_size(char *filename, unsigned *width, unsigned *height);
+
+/**
+ * Sets up the two temp image arrays of an image that was read, with the pixels of the image in arrays[0]
+ * A raw image is blurred straight in its (private) mapping with the row stride of the file, so its pixels are never copied,
+ * the pixels of every other format are decoded into arrays from the arena with the given row stride
+ * @param img_datap : pointer to the img_data struct of the image read with read_image
+ * @param arena : the arena to allocate the arrays from
+ * @param row_stride : bytes between the starts of two rows (at least width * pixel_length, ignored for raw images)
+ */
+void load_image_arrays(struct Img_Data *img_datap, struct Img_Arena *arena, unsigned row_stride);
+
+/**
+ * Writes RGBA pixels to an image file in the format of its extension (everything but PNG is written through a mapping of the file)
+ * @param filename : filepath of the output image
+ * @param pixels : the RGBA pixels to write
+ * @param width : width of the image in pixels
+ * @param height : height of the image in pixels
+ * @param row_stride : bytes between the starts of two rows of pixels
+ */
+void write_image_pixels(char *filename, unsigned char *pixels, unsigned width, unsigned height, unsigned row_stride);
+
+/**
+ * Writes the image in img_datap->arrays[0] to a file in the format of its extension (a PNG input written as PNG keeps its png info)
+ * @param img_datap : pointer to struct storing the image
+ * @param filename : filepath of the output image
+ */
+void write_image(struct Img_Data *img_datap, char *filename);
+
+/**
+ * Frees an image read with read_image, unmapping it if it was mapped
+ * @param img_datap : pointer to the img_data struct to be freed
+ */
+void free_image(struct Img_Data *img_datap);
+
+#endif /* IMAGE_IO_SEEN */
@@ -0,0 +1,100 @@
+// Ivan Bystrov
+// 18 October 2026
+//
+// Allocates the image arrays from an arena of aligned (optionally huge page) mappings that is reused across blurs
+
+#ifndef IMG_ARENA_SEEN
+#define IMG_ARENA_SEEN
+
+#include <stddef.h>
+#include <stdbool.h>
+
+// Every allocation starts on a new cache line
+#define IMG_ALIGNMENT 64
+
+// Mappings are made in multiples of this (the size of a huge page on x86 and most arm64 kernels)
+#define ARENA_BLOCK_SIZE (2UL << 20)
+
+// Maximum number of mappings an arena can be made of (each mapping is at least as large as all the ones before it, so they hold at least 64 GB)
+#define MAX_ARENA_BLOCKS 16
+
+
+/**
+ * Struct storing one mapping of an arena
+ * base : start of the mapping
+ * size : size of the mapping in bytes
+ */
+struct Arena_Block {
+	unsigned char *base;
+	size_t size;
+};
+
+/**
+ * Struct storing an arena, which hands out memory from its mappings one allocation after another
+ * Nothing is unmapped until the arena is released, so the memory of a job released with release_to_arena_mark is reused by the next job
+ * blocks : the mappings of the arena (in the order they were made)
+ * num_blocks : number of mappings made
+ * block : index of the mapping the next allocation comes from
+ * used : bytes of blocks[block] already handed out
+ * huge_pages : true if the mappings should come from the reserved huge pages (MAP_HUGETLB), they are only advised to be huge otherwise
+ */
+struct Img_Arena {
+	struct Arena_Block blocks[MAX_ARENA_BLOCKS];
+	unsigned num_blocks;
+	unsigned block;
+	size_t used;
+	bool huge_pages;
+};
+
+/**
+ * Struct storing how much of an arena was handed out at some point, so everything allocated after can be released
+ */
+struct Arena_Mark {
+	unsigned block;
+	size_t used;
+};
+
+/**
+ * Initializes an empty arena (nothing is mapped until the first allocation)
+ * @param [output] arena : the arena to initialize
+ * @param huge_pages : true to map from the reserved huge pages (falls back to advised pages if there are none)
+ */
+void init_img_arena(struct Img_Arena *arena, bool huge_pages);
+
+/**
+ * Allocates memory from an arena, aligned to IMG_ALIGNMENT (the memory is not zeroed, it can hold an earlier job's pixels)
+ * @param arena : the arena to allocate from
+ * @param size : size of the allocation in bytes
+ * @return the allocated memory
+ */
+void *arena_alloc(struct Img_Arena *arena, size_t size);
+
+/**
+ * Gets how much of an arena has been handed out
+ * @param arena : the arena
+ * @return the mark to give to release_to_arena_mark
+ */
+struct Arena_Mark arena_mark(struct Img_Arena *arena);
+
+/**
+ * Releases everything allocated from an arena after a mark was taken, so it is handed out again by the next allocations
+ * @param arena : the arena
+ * @param mark : the mark taken before the allocations to release
+ */
+void release_to_arena_mark(struct Img_Arena *arena, struct Arena_Mark mark);
+
+/**
+ * Unmaps all the memory of an arena (everything allocated from it is invalid afterwards)
+ * @param arena : the arena to release
+ */
+void release_img_arena(struct Img_Arena *arena);
+
+/**
+ * Gets the padded row stride of an image, a multiple of IMG_ALIGNMENT that is an odd number of cache lines,
+ * so the pixels of a column don't all map to the same few cache sets when the vertical pass walks down it
+ * @param row_len : length of the pixels of one row in bytes
+ * @return the row stride in bytes
+ */
+unsigned padded_row_stride(unsigned row_len);
+
+#endif /* IMG_ARENA_SEEN */
@@ -0,0 +1,35 @@
+// Ivan Bystrov
+// 18 October 2026
+//
+// Finds what changed since the previous frame so only the affected parts of the output get blurred again
+
+#ifndef INCREMENTAL_SEEN
+#define INCREMENTAL_SEEN
+
+#include "process_png.h"
+#include "blur_helpers.h"
+
+// Side length in pixels of the square tiles compared between the previous and current input image
+#define CHANGE_TILE_SIZE 32
+
+
+/**
+ * Finds the regions of the output image that have to be blurred again because the input image changed since the previous frame
+ * @param img_datap : struct storing the current input image (in img_datap->arrays[0])
+ * @param prev_img_datap : struct storing the previous input image (in prev_img_datap->arrays[0], must be the same size)
+ * @param offset : the index of the target pixel in the gaussian kernel (how far a changed input pixel spreads in the output)
+ * @param [output] regions : pointer to where the (malloced) array of regions is stored
+ * @return the number of regions
+ */
+unsigned find_changed_regions(struct Img_Data *img_datap, struct Img_Data *prev_img_datap, unsigned offset, struct Region **regions);
+
+/**
+ * Copies the blurred regions in img_datap->arrays[0] over the previous output image, making it the output of the current frame
+ * @param img_datap : struct storing the blurred current image
+ * @param prev_out_datap : struct storing the previous output image (in prev_out_datap->arrays[0], must be the same size)
+ * @param regions : the regions that were blurred again
+ * @param num_regions : number of regions
+ */
+void update_previous_output(struct Img_Data *img_datap, struct Img_Data *prev_out_datap, struct Region *regions, unsigned num_regions);
+
+#endif /* INCREMENTAL_SEEN */
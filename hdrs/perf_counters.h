@@ -0,0 +1,96 @@
+// Ivan Bystrov
+// 18 October 2026
+//
+// Counts hardware events (cycles, instructions, cache and TLB misses) of each cpu blur thread in each pass with perf_event_open
+
+#ifndef PERF_COUNTERS_SEEN
+#define PERF_COUNTERS_SEEN
+
+#include <stddef.h>
+#include <stdbool.h>
+
+// Largest number of passes a cpu blur has (the planar blur deinterleaves, then blurs vertically, then horizontally)
+#define MAX_PERF_PASSES 3
+
+
+/**
+ * The hardware events counted for every thread
+ */
+enum Perf_Event {
+	PERF_CYCLES,
+	PERF_INSTRUCTIONS,
+	PERF_L1D_MISSES,
+	PERF_LLC_MISSES,
+	PERF_DTLB_MISSES,
+	NUM_PERF_EVENTS
+};
+
+/**
+ * Struct storing what one thread did in one pass
+ * values : the count of each event (scaled up if the kernel had to share the counters between events)
+ * counted : true for each event that could be counted (counters can be missing on some cpus, and in containers and virtual machines)
+ * seconds : wall time the thread took
+ * pixels : number of pixels the thread computed
+ * open_errno : errno of the first counter that couldn't be opened (0 if every counter opened)
+ */
+struct Perf_Counters {
+	unsigned long long values[NUM_PERF_EVENTS];
+	bool counted[NUM_PERF_EVENTS];
+	double seconds;
+	size_t pixels;
+	int open_errno;
+};
+
+/**
+ * Struct storing the counters of every thread in every pass of a cpu blur
+ * num_threads : number of threads of each pass
+ * num_passes : number of passes of the blur (set by the blur)
+ * pass_names : what each pass does (set by the blur)
+ * counters : the counters of thread t in pass p are counters[p * num_threads + t] (malloced)
+ */
+struct Perf_Report {
+	unsigned num_threads;
+	unsigned num_passes;
+	char *pass_names[MAX_PERF_PASSES];
+	struct Perf_Counters *counters;
+};
+
+/**
+ * Struct storing the thread function a measured thread runs
+ * thread_func : the function the thread runs
+ * thread_params : the parameter passed to thread_func
+ * counters : where the counters of the thread are stored (pixels must already be set)
+ */
+struct Perf_Thread {
+	void *(*thread_func)(void *);
+	void *thread_params;
+	struct Perf_Counters *counters;
+};
+
+/**
+ * Allocates a report for a blur with the given number of threads (every counter starts at zero)
+ * @param [output] report : the report to set up
+ * @param num_threads : number of threads of each pass
+ */
+void init_perf_report(struct Perf_Report *report, unsigned num_threads);
+
+/**
+ * Entry point for a thread that counts the hardware events of thread_func (start it with pthread_create instead of thread_func)
+ * @param perf_thread : Pointer to Perf_Thread struct
+ * @return : returns NULL
+ */
+void *perf_thread(void *perf_thread);
+
+/**
+ * Outputs the counters of every thread in every pass, with the IPC, LLC traffic per pixel and the imbalance between the threads of each pass
+ * @param report : the report filled in by the blur
+ */
+void print_perf_report(struct Perf_Report *report);
+
+/**
+ * Frees the counters of a report
+ * @param report : the report to free
+ */
+void free_perf_report(struct Perf_Report *report);
+
+#endif /* PERF_COUNTERS_SEEN */
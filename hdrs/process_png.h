@@ -7,6 +7,7 @@
 #define PROCESS_PNG_SEEN
 
 #include <png.h>
+#include "img_arena.h"
 
 
 /**
@@ -20,6 +21,10 @@
  * bit_depth : bit depth of the input image (must be 8 for this program to work)
  * pixel_length : length of each pixel in bytes (must be 4 for this program to work)
  * arrays : pointer to two temp image arrays that are used to perform the blurs
+ * row_stride : bytes from the start of one row of the arrays to the start of the next (at least width * pixel_length, the rest is padding)
+ * arena : the arena the arrays (and the scratch memory of the blurs) are allocated from
+ * mapped_file : the input file mapped into memory (NULL for PNG images, and once a decoded image has been loaded into the arrays)
+ * mapped_size : size of mapped_file in bytes
  */
 struct Img_Data {
 	png_structp png_ptr;
@@ -31,6 +36,10 @@ struct Img_Data {
 	unsigned bit_depth;
 	unsigned pixel_length;
 	unsigned char **arrays;
+	unsigned row_stride;
+	struct Img_Arena *arena;
+	unsigned char *mapped_file;
+	size_t mapped_size;
 };
 
 /**
@@ -42,11 +51,34 @@ struct Img_Data {
 void copy_row_pointers_and_arr(struct Img_Data *img_datap, unsigned arr_val, unsigned io_to_comp);
 
 /**
- * Free img_data struct (should only be called after the two buffers have been created)
+ * Allocates the two temp image arrays from an arena (not zeroed), with the given row stride
+ * @param img_datap : pointer to img_data struct to allocate the arrays of
+ * @param arena : the arena to allocate the arrays from
+ * @param row_stride : bytes between the starts of two rows (at least width * pixel_length)
+ */
+void create_img_arrays(struct Img_Data *img_datap, struct Img_Arena *arena, unsigned row_stride);
+
+/**
+ * Free img_data struct (the two buffers belong to the arena they were allocated from, so they are not freed)
  * @param img_datap : pointer to the img_data struct to be freed
  */
 void free_img_data_struct(struct Img_Data *img_datap); 
 
+/**
+ * Reads the size of a png image from its header, without decoding its pixels
+ * @param filename : filepath to the png image
+ * @param [output] width : width of the image in pixels
+ * @param [output] height : height of the image in pixels
+ */
+void read_png_size(char *filename, unsigned *width, unsigned *height);
+
+/**
+ * Decodes a png image and stores image data at img_p, without outputting anything or checking its colour type (read_png does both)
+ * @param [output] img_datap : pointer to struct storing input image data needed for program
+ * @param filename : filepath to the input image the program will be blurring
+ */
+void decode_png(struct Img_Data *img_datap, char *filename);
+
 /**
  * Reads a png image and stores image data at img_p
  * @param [output] img_datap : pointer to struct storing input image data needed for program
@@ -54,6 +86,15 @@ void free_img_data_struct(struct Img_Data *img_datap);
  */
 void read_png(struct Img_Data *img_datap, char *input_filepath);
 
+/**
+ * Reads a mask png image (must be 8 bit, RGBA, and the same size as the image being blurred)
+ * @param filename : filepath to the mask image
+ * @param width : width the mask image must have
+ * @param height : height the mask image must have
+ * @return width * height bytes (malloced), non zero where the mask pixel is not black
+ */
+unsigned char *read_png_mask(char *filename, unsigned width, unsigned height);
+
 /**
  * Writes the blurred png image to another file (<input_filepath>_OUTPUT_MODIFIER.png
  * @param img_datap : pointer to struct storing input and output image data
@@ -61,6 +102,16 @@ void read_png(struct Img_Data *img_datap, char *input_filepath);
  */
 void write_png(struct Img_Data *img_datap, char *filename); 
 
+/**
+ * Writes RGBA pixels that don't have png info from an input image (like a downscaled image) to a png file
+ * @param filename : filepath of the output image
+ * @param pixels : the RGBA pixels to write
+ * @param width : width of the output image in pixels
+ * @param height : height of the output image in pixels
+ * @param row_stride : bytes between the starts of two rows of pixels
+ */
+void write_png_pixels(char *filename, unsigned char *pixels, unsigned width, unsigned height, unsigned row_stride);
+
 /**
  * Prints the image information of the input image
  * @param img_datap : pointer to struct storing the input image data needed for program
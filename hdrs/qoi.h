@@ -0,0 +1,52 @@
+// Ivan Bystrov
+// 18 October 2026
+//
+// Encodes and decodes QOI ("Quite OK Image") images in memory
+
+#ifndef QOI_SEEN
+#define QOI_SEEN
+
+#include <stddef.h>
+#include <stdbool.h>
+
+// Size in bytes of the header before the chunks ("qoif", big endian width and height, channels and colour space)
+#define QOI_HEADER_SIZE 14
+
+// Size in bytes of the end marker after the chunks (7 zero bytes and a 1)
+#define QOI_END_SIZE 8
+
+// Largest size in bytes a QOI image of width x height pixels can be encoded to (every pixel as a 5 byte RGBA chunk)
+#define QOI_MAX_SIZE(width, height) (QOI_HEADER_SIZE + (size_t) (width) * (height) * 5 + QOI_END_SIZE)
+
+
+/**
+ * Reads the size of a QOI image from its header
+ * @param data : the encoded image
+ * @param size : size of the encoded image in bytes
+ * @param [output] width : width of the image in pixels
+ * @param [output] height : height of the image in pixels
+ * @return true if data starts with a valid QOI header, false otherwise
+ */
+bool qoi_read_header(unsigned char *data, size_t size, unsigned *width, unsigned *height);
+
+/**
+ * Decodes a QOI image into RGBA pixels (3 channel images get an alpha of 255)
+ * @param data : the encoded image (its header must be valid)
+ * @param size : size of the encoded image in bytes
+ * @param [output] pixels : the decoded RGBA pixels
+ * @param row_stride : bytes between the starts of two rows of pixels
+ */
+void qoi_decode(unsigned char *data, size_t size, unsigned char *pixels, unsigned row_stride);
+
+/**
+ * Encodes RGBA pixels as a 4 channel QOI image
+ * @param pixels : the RGBA pixels to encode
+ * @param width : width of the image in pixels
+ * @param height : height of the image in pixels
+ * @param row_stride : bytes between the starts of two rows of pixels
+ * @param [output] out : the encoded image (must have room for QOI_MAX_SIZE(width, height) bytes)
+ * @return size of the encoded image in bytes
+ */
+size_t qoi_encode(unsigned char *pixels, unsigned width, unsigned height, unsigned row_stride, unsigned char *out);
+
+#endif /* QOI_SEEN */
@@ -0,0 +1,28 @@
+// Ivan Bystrov
+// 18 October 2026
+//
+// Blurs an image and downscales it in one go, for anti-aliasing before shrinking (e.g. thumbnails)
+
+#ifndef RESIZE_SEEN
+#define RESIZE_SEEN
+
+#include "process_png.h"
+#include "blur_cpu.h"
+#include "blur_gpu.h"
+
+
+/**
+ * Blurs the input image, downscales it and writes it to the output file, only computing the blurred pixels the downscaled image samples
+ * @param img_datap : struct storing all the info of the input image (must already be copied into arrays[0])
+ * @param std_dev : the standard deviation of the blur
+ * @param out_width : width of the downscaled image in pixels (at most the width of the input image)
+ * @param out_height : height of the downscaled image in pixels (at most the height of the input image)
+ * @param device : 'c' to blur on the cpu, 'g' to blur on the gpu
+ * @param cpu_config : how the cpu blur should be performed (only used if device is 'c', only the number of threads is used)
+ * @param gpu_config : how the gpu blur should be performed (only used if device is 'g', always blurs images without linear filtering or bands)
+ * @param output_filename : filename to write the downscaled image to
+ */
+void blur_resized(struct Img_Data *img_datap, unsigned std_dev, unsigned out_width, unsigned out_height, char device,
+		struct Cpu_Config *cpu_config, struct Gpu_Config *gpu_config, char *output_filename);
+
+#endif /* RESIZE_SEEN */
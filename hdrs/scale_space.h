@@ -0,0 +1,27 @@
+// Ivan Bystrov
+// 18 October 2026
+//
+// Blurs one image with several standard deviations, each level blurring the level before it
+
+#ifndef SCALE_SPACE_SEEN
+#define SCALE_SPACE_SEEN
+
+#include "process_png.h"
+#include "blur_cpu.h"
+#include "blur_gpu.h"
+
+
+/**
+ * Blurs the input image with every standard deviation and writes each level to its own output file
+ * Each level is computed from the previous level with the residual standard deviation sqrt(s_n^2 - s_(n-1)^2)
+ * @param img_datap : struct storing all the info of the input image (must already be copied into arrays[0])
+ * @param std_devs : the standard deviations to blur with (strictly increasing)
+ * @param num_std_devs : number of standard deviations
+ * @param device : 'c' to blur on the cpu, 'g' to blur on the gpu
+ * @param cpu_config : how the cpu blur should be performed (only used if device is 'c')
+ * @param gpu_config : how the gpu blur should be performed (only used if device is 'g', the area is ignored)
+ * @param output_filenames : filename to write each level to
+ */
+void blur_scale_space(struct Img_Data *img_datap, unsigned *std_devs, unsigned num_std_devs, char device, struct Cpu_Config *cpu_config, struct Gpu_Config *gpu_config, char **output_filenames);
+
+#endif /* SCALE_SPACE_SEEN */
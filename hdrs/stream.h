@@ -0,0 +1,36 @@
+// Ivan Bystrov
+// 18 October 2026
+//
+// Blurs a stream of raw RGBA frames read from stdin and writes the blurred frames to stdout
+
+#ifndef STREAM_SEEN
+#define STREAM_SEEN
+
+#include <stdio.h>
+#include "blur_cpu.h"
+#include "blur_gpu.h"
+
+
+/**
+ * Moves stdout to a new file descriptor for the blurred frames, and points the old stdout at stderr
+ * so everything the rest of the program prints can't end up in the middle of the frames
+ * @return file the blurred frames should be written to
+ */
+FILE *take_stdout_for_frames(void);
+
+/**
+ * Blurs every raw RGBA frame read from stdin and writes them to out, reading, blurring and writing 3 consecutive frames at the same time
+ * @param width : width of every frame in pixels
+ * @param height : height of every frame in pixels
+ * @param std_dev : desired standard deviation of the gaussian blur
+ * @param device : 'c' to blur on the cpu, 'g' to blur on the gpu
+ * @param cpu_config : how the cpu blur should be performed (only used if device is 'c')
+ * @param gpu_config : how the gpu blur should be performed (only used if device is 'g', the area is ignored)
+ * @param arena : the arena the frame slots (and the scratch memory of every blur) are allocated from
+ * @param row_stride : bytes between the starts of two rows of a frame slot (at least width * 4)
+ * @param out : file the blurred frames are written to
+ */
+void blur_stream(unsigned width, unsigned height, unsigned std_dev, char device, struct Cpu_Config *cpu_config, struct Gpu_Config *gpu_config,
+		struct Img_Arena *arena, unsigned row_stride, FILE *out);
+
+#endif /* STREAM_SEEN */
@@ -0,0 +1,296 @@
+// Ivan Bystrov
+// 18 October 2026
+//
+// Pins the cpu blur threads to cpus picked from the topology of the host (compact, scatter or an explicit list), and reports where they run
+
+// Needed for sched_getaffinity and pthread_attr_setaffinity_np
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <sched.h>
+#include <dirent.h>
+#include "affinity.h"
+#include "error.h"
+
+// Largest cpu number a list can have
+#define MAX_LIST_CPU 65535
+
+
+/**
+ * Struct storing where one cpu is in the topology of the host
+ * cpu : the number of the cpu
+ * node : the NUMA node of the cpu (-1 if the host doesn't say)
+ * package : the socket of the cpu (-1 if the host doesn't say)
+ * core : the core of the cpu in its socket (the cpu number if the host doesn't say, so it is a core of its own)
+ * sibling_rank : how many cpus of the same core come before this one (hyperthreads of a core get 0, 1, ...)
+ * core_rank : how many cores of the same node and socket come before the core of this cpu
+ */
+struct Cpu_Topology {
+	int cpu;
+	int node;
+	int package;
+	int core;
+	unsigned sibling_rank;
+	unsigned core_rank;
+};
+
+
+/**
+ * Reads one number about a cpu from sysfs
+ * @param cpu : the cpu
+ * @param name : the file in the topology directory of the cpu (like core_id)
+ * @return the number, or -1 if it couldn't be read
+ */
+static int read_cpu_topology_value(int cpu, char *name) {
+	char path[96];
+	snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/%s", cpu, name);
+	FILE *fp = fopen(path, "r");
+	if (fp == NULL) { return -1; }
+
+	int value;
+	if (fscanf(fp, "%d", &value) != 1) { value = -1; }
+	fclose(fp);
+	return value;
+}
+
+/**
+ * Finds the NUMA node of a cpu, from the nodeN link in its sysfs directory
+ * @param cpu : the cpu
+ * @return the node, or -1 if the host has no NUMA information
+ */
+static int read_cpu_node(int cpu) {
+	char path[64];
+	snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+	DIR *dir = opendir(path);
+	if (dir == NULL) { return -1; }
+
+	int node = -1;
+	struct dirent *entry;
+	while ((entry = readdir(dir)) != NULL) {
+		if (!strncmp(entry->d_name, "node", 4) && isdigit((unsigned char) entry->d_name[4])) {
+			node = strtol(entry->d_name + 4, NULL, 10);
+			break;
+		}
+	}
+	closedir(dir);
+	return node;
+}
+
+/**
+ * Reads where a cpu is in the topology of the host
+ * @param [output] topology : where the cpu is (the ranks are set once every cpu is read)
+ * @param cpu : the cpu
+ */
+static void read_cpu_topology(struct Cpu_Topology *topology, int cpu) {
+	topology->cpu = cpu;
+	topology->node = read_cpu_node(cpu);
+	topology->package = read_cpu_topology_value(cpu, "physical_package_id");
+	topology->core = read_cpu_topology_value(cpu, "core_id");
+	if (topology->core < 0) { topology->core = cpu; }
+	topology->sibling_rank = 0;
+	topology->core_rank = 0;
+}
+
+/**
+ * Orders cpus so each node, then socket, then core is filled before the next (for qsort)
+ * @param a : pointer to the first Cpu_Topology
+ * @param b : pointer to the second Cpu_Topology
+ * @return negative if a goes first, positive if b goes first
+ */
+static int compare_compact(const void *a, const void *b) {
+	const struct Cpu_Topology *cpu_a = a;
+	const struct Cpu_Topology *cpu_b = b;
+	if (cpu_a->node != cpu_b->node) { return cpu_a->node < cpu_b->node ? -1 : 1; }
+	if (cpu_a->package != cpu_b->package) { return cpu_a->package < cpu_b->package ? -1 : 1; }
+	if (cpu_a->core != cpu_b->core) { return cpu_a->core < cpu_b->core ? -1 : 1; }
+	return cpu_a->cpu < cpu_b->cpu ? -1 : 1;
+}
+
+/**
+ * Orders cpus so consecutive cpus are on different nodes (and sockets), and every core gets one cpu before any core gets a second (for qsort)
+ * @param a : pointer to the first Cpu_Topology
+ * @param b : pointer to the second Cpu_Topology
+ * @return negative if a goes first, positive if b goes first
+ */
+static int compare_scatter(const void *a, const void *b) {
+	const struct Cpu_Topology *cpu_a = a;
+	const struct Cpu_Topology *cpu_b = b;
+	if (cpu_a->sibling_rank != cpu_b->sibling_rank) { return cpu_a->sibling_rank < cpu_b->sibling_rank ? -1 : 1; }
+	if (cpu_a->core_rank != cpu_b->core_rank) { return cpu_a->core_rank < cpu_b->core_rank ? -1 : 1; }
+	return compare_compact(a, b);
+}
+
+/**
+ * Parses a comma separated list of cpus and ranges of cpus (like 0,2,4-7)
+ * @param input : the list to parse
+ * @param [output] cpus : the (malloced) cpus of the list in order, only set if the list is valid
+ * @param [output] num_cpus : the number of cpus in the list
+ * @return true if input is a valid list, false otherwise
+ */
+bool parse_cpu_list(char *input, int **cpus, unsigned *num_cpus) {
+	int *list = NULL;
+	unsigned len = 0;
+
+	while (true) {
+		// Each entry is a cpu, or the first and last cpu of a range separated by a '-'
+		char *end;
+		if (!isdigit((unsigned char) *input)) { free(list); return false; }
+		unsigned long first = strtoul(input, &end, 10);
+		unsigned long last = first;
+		if (*end == '-') {
+			if (!isdigit((unsigned char) end[1])) { free(list); return false; }
+			last = strtoul(end + 1, &end, 10);
+		}
+		if (first > last || last > MAX_LIST_CPU || (*end != ',' && *end != '\0')) { free(list); return false; }
+
+		list = realloc(list, sizeof(int) * (len + last - first + 1));
+		if (list == NULL) { error("could not allocate cpu list\n"); }
+		for (unsigned long cpu = first; cpu <= last; ++cpu) {
+			list[len++] = cpu;
+		}
+
+		if (*end == '\0') { break; }
+		input = end + 1;
+	}
+
+	*cpus = list;
+	*num_cpus = len;
+	return true;
+}
+
+/**
+ * Works out which cpu each thread is pinned to, from the cpus this process may run on and their NUMA node, socket and core
+ * @param [output] placement : the placement to set up
+ * @param mode : 'c' for compact, 's' for scatter, 'l' for the cpus of list
+ * @param list : the cpus to use in order (only used if mode is 'l', the placement takes it over)
+ * @param list_len : number of cpus in list
+ */
+void init_thread_placement(struct Thread_Placement *placement, char mode, int *list, unsigned list_len) {
+	// Only the cpus this process is allowed on (by taskset, cgroups, ...) are used
+	cpu_set_t allowed;
+	CPU_ZERO(&allowed);
+	if (sched_getaffinity(0, sizeof(allowed), &allowed)) { error(NULL); }
+
+	unsigned num_cpus = mode == 'l' ? list_len : (unsigned) CPU_COUNT(&allowed);
+	struct Cpu_Topology *topology = malloc(sizeof(struct Cpu_Topology) * num_cpus);
+	if (topology == NULL) { error("could not allocate cpu topology\n"); }
+
+	if (mode == 'l') {
+		for (unsigned i = 0; i < list_len; ++i) {
+			if (list[i] >= CPU_SETSIZE || !CPU_ISSET(list[i], &allowed)) { error("cpu list has a cpu this process is not allowed to run on\n"); }
+			read_cpu_topology(&topology[i], list[i]);
+		}
+		free(list);
+
+	} else {
+		for (int cpu = 0, i = 0; cpu < CPU_SETSIZE; ++cpu) {
+			if (CPU_ISSET(cpu, &allowed)) { read_cpu_topology(&topology[i++], cpu); }
+		}
+		qsort(topology, num_cpus, sizeof(struct Cpu_Topology), compare_compact);
+
+		// In compact order the cpus of a core are next to each other, and so are the cores of a socket
+		for (unsigned i = 1; i < num_cpus; ++i) {
+			struct Cpu_Topology *prev = &topology[i - 1];
+			bool same_socket = topology[i].node == prev->node && topology[i].package == prev->package;
+			bool same_core = same_socket && topology[i].core == prev->core;
+			topology[i].sibling_rank = same_core ? prev->sibling_rank + 1 : 0;
+			topology[i].core_rank = !same_socket ? 0 : same_core ? prev->core_rank : prev->core_rank + 1;
+		}
+		if (mode == 's') { qsort(topology, num_cpus, sizeof(struct Cpu_Topology), compare_scatter); }
+	}
+
+	placement->mode = mode;
+	placement->num_cpus = num_cpus;
+	placement->cpus = malloc(sizeof(int) * num_cpus);
+	placement->nodes = malloc(sizeof(int) * num_cpus);
+	placement->packages = malloc(sizeof(int) * num_cpus);
+	if (placement->cpus == NULL || placement->nodes == NULL || placement->packages == NULL) { error("could not allocate thread placement\n"); }
+	for (unsigned i = 0; i < num_cpus; ++i) {
+		placement->cpus[i] = topology[i].cpu;
+		placement->nodes[i] = topology[i].node;
+		placement->packages[i] = topology[i].package;
+	}
+	free(topology);
+}
+
+/**
+ * Gets the cpu a thread is pinned to
+ * @param placement : the placement of the threads (NULL means threads aren't pinned)
+ * @param thread : the index of the thread in its pass
+ * @return the cpu, or -1 if the thread isn't pinned
+ */
+int placement_cpu(struct Thread_Placement *placement, unsigned thread) {
+	if (placement == NULL) { return -1; }
+	return placement->cpus[thread % placement->num_cpus];
+}
+
+/**
+ * Starts a thread, pinned to a cpu before it runs (so everything it first touches is put on the NUMA node of that cpu)
+ * @param [output] thread : where the id of the thread is stored
+ * @param thread_func : the function the thread runs
+ * @param arg : the parameter passed to thread_func
+ * @param cpu : the cpu to pin the thread to (-1 means don't pin it)
+ */
+void create_pinned_thread(pthread_t *thread, void *(*thread_func)(void *), void *arg, int cpu) {
+	if (cpu < 0) {
+		pthread_create(thread, NULL, thread_func, arg);
+		return;
+	}
+
+	// Setting the affinity in the attributes pins the thread before its first instruction, instead of after it has started on any cpu
+	pthread_attr_t attr;
+	cpu_set_t cpus;
+	CPU_ZERO(&cpus);
+	CPU_SET(cpu, &cpus);
+	pthread_attr_init(&attr);
+	if (pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus)) { error("could not set the cpu affinity of a thread\n"); }
+	pthread_create(thread, &attr, thread_func, arg);
+	pthread_attr_destroy(&attr);
+}
+
+/**
+ * Outputs the cpu, NUMA node and socket each thread of a pass runs on, and how many threads each node has
+ * @param placement : the placement of the threads
+ * @param num_threads : the number of threads of each pass
+ */
+void print_thread_placement(struct Thread_Placement *placement, unsigned num_threads) {
+	char *mode_name = placement->mode == 'c' ? "compact" : placement->mode == 's' ? "scatter" : "list";
+	printf("Thread Placement (%s):\n", mode_name);
+
+	int max_node = -1;
+	for (unsigned thread = 0; thread < num_threads; ++thread) {
+		unsigned i = thread % placement->num_cpus;
+		printf("	Thread %u: cpu %d", thread, placement->cpus[i]);
+		if (placement->nodes[i] >= 0) { printf(", node %d", placement->nodes[i]); }
+		if (placement->packages[i] >= 0) { printf(", socket %d", placement->packages[i]); }
+		printf("\n");
+		if (placement->nodes[i] > max_node) { max_node = placement->nodes[i]; }
+	}
+
+	// Count the threads of each node (there is nothing to count if the host has no NUMA information)
+	if (max_node >= 0) {
+		printf("Threads Per Node:");
+		for (int node = 0; node <= max_node; ++node) {
+			unsigned node_threads = 0;
+			for (unsigned thread = 0; thread < num_threads; ++thread) {
+				if (placement->nodes[thread % placement->num_cpus] == node) { node_threads ++; }
+			}
+			if (node_threads) { printf(" node %d: %u", node, node_threads); }
+		}
+		printf("\n");
+	}
+	printf("\n");
+}
+
+/**
+ * Frees the arrays of a placement
+ * @param placement : the placement to free
+ */
+void free_thread_placement(struct Thread_Placement *placement) {
+	free(placement->cpus);
+	free(placement->nodes);
+	free(placement->packages);
+}
@@ -0,0 +1,329 @@
+// Ivan Bystrov
+// 18 October 2026
+//
+// Picks the blur engine and number of threads from a cost model calibrated for this host
+
+// Needed for sysconf
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "auto_select.h"
+#include "blur_cpu.h"
+#include "blur_gpu.h"
+#include "blur_helpers.h"
+#include "error.h"
+
+// Width and height in pixels of the synthetic image the engines are timed on
+#define CALIBRATION_SIZE 512
+
+// Number of times each engine is timed (the fastest run is kept)
+#define CALIBRATION_RUNS 3
+
+// The two standard deviations the engines are timed with (the difference separates the cost per tap from the cost per pixel)
+#define CALIBRATION_SMALL_STD_DEV 1
+#define CALIBRATION_LARGE_STD_DEV 8
+
+// Number of threads used to time creating and joining threads (on an image so small the blur itself takes no time)
+#define CALIBRATION_THREADS 16
+
+
+/**
+ * Gets the filepath of the calibration profile
+ * @param [output] path : where the filepath is stored
+ * @param size : size of path in bytes
+ */
+void get_profile_path(char *path, size_t size) {
+	char *home = getenv("HOME");
+	snprintf(path, size, "%s/%s", home ? home : ".", PROFILE_FILENAME);
+}
+
+/**
+ * Sets every value of the profile to a default that is roughly right for a desktop with a discrete gpu
+ * @param [output] profile : struct to store the profile in
+ */
+void default_cost_profile(struct Cost_Profile *profile) {
+	profile->calibrated = false;
+	profile->cpu_pixel_ns = 10;
+	profile->cpu_tap_ns = 1;
+	profile->cpu_approx_ns = 30;
+	profile->thread_us = 50;
+	profile->gpu = gpu_available();
+	profile->gpu_setup_ms = 300;
+	profile->gpu_pixel_ns = 2;
+	profile->gpu_tap_ns = 0.01;
+}
+
+/**
+ * Reads the calibration profile of this host (or uses default values if there is none)
+ * @param [output] profile : struct to store the profile in
+ */
+void load_cost_profile(struct Cost_Profile *profile) {
+	char path[4096];
+	get_profile_path(path, sizeof(path));
+
+	FILE *fp = fopen(path, "r");
+	if (fp == NULL) {
+		printf("No calibration profile found at %s (run with --calibrate to create one), using default costs\n", path);
+		default_cost_profile(profile);
+		return;
+	}
+
+	// Every line is a name and a value (lines starting with '#' are comments, unknown names are ignored)
+	default_cost_profile(profile);
+	char line[256];
+	while (fgets(line, sizeof(line), fp)) {
+		char name[64];
+		float value;
+		if (line[0] == '#' || sscanf(line, "%63s %f", name, &value) != 2) { continue; }
+
+		if (!strcmp(name, "cpu_pixel_ns")) { profile->cpu_pixel_ns = value; }
+		else if (!strcmp(name, "cpu_tap_ns")) { profile->cpu_tap_ns = value; }
+		else if (!strcmp(name, "cpu_approx_ns")) { profile->cpu_approx_ns = value; }
+		else if (!strcmp(name, "thread_us")) { profile->thread_us = value; }
+		else if (!strcmp(name, "gpu")) { profile->gpu = value != 0; }
+		else if (!strcmp(name, "gpu_setup_ms")) { profile->gpu_setup_ms = value; }
+		else if (!strcmp(name, "gpu_pixel_ns")) { profile->gpu_pixel_ns = value; }
+		else if (!strcmp(name, "gpu_tap_ns")) { profile->gpu_tap_ns = value; }
+	}
+	profile->calibrated = true;
+
+	if (fclose(fp)) { error("could not close calibration profile\n"); }
+}
+
+/**
+ * Gets the number of seconds since start
+ * @param start : the time to measure from
+ * @return the number of seconds since start
+ */
+double seconds_since(struct timespec *start) {
+	struct timespec finish;
+	clock_gettime(CLOCK_MONOTONIC, &finish);
+	return (finish.tv_sec - start->tv_sec) + (finish.tv_nsec - start->tv_nsec) / 1000000000.0;
+}
+
+/**
+ * Times the cpu blur of an image (the image is blurred over and over in place, which takes the same time as blurring the original)
+ * @param img_datap : struct storing the image to blur
+ * @param std_dev : standard deviation of the blur
+ * @param config : how the cpu blur should be performed
+ * @return the duration of the fastest of CALIBRATION_RUNS blurs in seconds
+ */
+double time_cpu_blur(struct Img_Data *img_datap, float std_dev, struct Cpu_Config *config) {
+	unsigned gaussian_kernel_len = kernel_len_for_std_dev(std_dev);
+	float *gaussian_kernel = malloc(sizeof(float) * gaussian_kernel_len);
+	calculate_kernel_float(&gaussian_kernel, gaussian_kernel_len, std_dev);
+
+	double fastest = -1;
+	for (unsigned run = 0; run < CALIBRATION_RUNS; ++run) {
+		struct timespec start;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		blur_cpu_with_kernel(img_datap, gaussian_kernel, gaussian_kernel_len, config);
+		double duration = seconds_since(&start);
+		if (fastest < 0 || duration < fastest) { fastest = duration; }
+	}
+
+	free(gaussian_kernel);
+	return fastest;
+}
+
+/**
+ * Times setting up the gpu and the gpu blur of an image
+ * @param img_datap : struct storing the image to blur
+ * @param std_dev : standard deviation of the blur
+ * @param [output] setup_duration : how long setting up and releasing the gpu took in seconds
+ * @return the duration of the fastest of CALIBRATION_RUNS blurs in seconds (not counting the set up)
+ */
+double time_gpu_blur(struct Img_Data *img_datap, float std_dev, double *setup_duration) {
+	unsigned gaussian_kernel_len = kernel_len_for_std_dev(std_dev);
+	float *gaussian_kernel = malloc(sizeof(float) * gaussian_kernel_len);
+	calculate_kernel_float(&gaussian_kernel, gaussian_kernel_len, std_dev);
+
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	struct Gpu_Config config = { NULL, 0, 'a', 1, NULL };
+	struct Gpu_Context *ctx = create_gpu_context(img_datap, gaussian_kernel, gaussian_kernel_len, &config);
+	*setup_duration = seconds_since(&start);
+
+	double fastest = -1;
+	for (unsigned run = 0; run < CALIBRATION_RUNS; ++run) {
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		blur_gpu_with_context(ctx, img_datap, NULL);
+		double duration = seconds_since(&start);
+		if (fastest < 0 || duration < fastest) { fastest = duration; }
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	release_gpu_context(ctx);
+	*setup_duration += seconds_since(&start);
+
+	free(gaussian_kernel);
+	return fastest;
+}
+
+/**
+ * Splits the durations of a blur with two standard deviations into a cost per pixel and a cost per pixel per kernel tap
+ * @param small_duration : duration of the blur with CALIBRATION_SMALL_STD_DEV in seconds
+ * @param large_duration : duration of the blur with CALIBRATION_LARGE_STD_DEV in seconds
+ * @param num_pixels : number of pixels that were blurred
+ * @param [output] pixel_ns : nanoseconds per pixel, not counting the kernel taps
+ * @param [output] tap_ns : nanoseconds per pixel per kernel tap (of both passes)
+ */
+void fit_pixel_and_tap_costs(double small_duration, double large_duration, double num_pixels, float *pixel_ns, float *tap_ns) {
+	unsigned small_taps = 2 * kernel_len_for_std_dev(CALIBRATION_SMALL_STD_DEV);
+	unsigned large_taps = 2 * kernel_len_for_std_dev(CALIBRATION_LARGE_STD_DEV);
+
+	*tap_ns = (large_duration - small_duration) * 1e9 / num_pixels / (large_taps - small_taps);
+	if (*tap_ns < 0) { *tap_ns = 0; }
+	*pixel_ns = small_duration * 1e9 / num_pixels - small_taps * *tap_ns;
+	if (*pixel_ns < 0) { *pixel_ns = 0; }
+}
+
+/**
+ * Times every engine on synthetic images and writes the calibration profile of this host
+ */
+void calibrate_cost_profile(void) {
+	struct Cost_Profile profile;
+	default_cost_profile(&profile);
+
+	// Make a synthetic image (the content does not change how long the blur takes, but keep it from being flat anyway)
+	// It has the same padded rows and arena as the images the auto device picks for
+	struct Img_Arena arena;
+	init_img_arena(&arena, false);
+	unsigned char *arrays[2];
+	unsigned row_stride = padded_row_stride(CALIBRATION_SIZE * 4);
+	size_t img_size = (size_t) row_stride * CALIBRATION_SIZE;
+	for (unsigned i = 0; i < 2; ++i) {
+		arrays[i] = arena_alloc(&arena, img_size);
+	}
+	for (size_t i = 0; i < img_size; ++i) { arrays[0][i] = (i * 2654435761u) >> 24; }
+
+	struct Img_Data img_data;
+	img_data.png_ptr = NULL;
+	img_data.info_ptr = NULL;
+	img_data.row_pointers = NULL;
+	img_data.width = CALIBRATION_SIZE;
+	img_data.height = CALIBRATION_SIZE;
+	img_data.colour_type = 6;
+	img_data.bit_depth = 8;
+	img_data.pixel_length = 4;
+	img_data.arrays = arrays;
+	img_data.row_stride = row_stride;
+	img_data.arena = &arena;
+	img_data.mapped_file = NULL;
+	img_data.mapped_size = 0;
+	double num_pixels = (double) CALIBRATION_SIZE * CALIBRATION_SIZE;
+
+	// Time the exact cpu blur (planar, since that is the layout the auto device uses) and the approximate cpu blur on one thread
+	printf("Calibrating cpu...\n");
+	struct Cpu_Config config = { 1, 1, NULL, 0, NULL, NULL, NULL };
+	double small_duration = time_cpu_blur(&img_data, CALIBRATION_SMALL_STD_DEV, &config);
+	double large_duration = time_cpu_blur(&img_data, CALIBRATION_LARGE_STD_DEV, &config);
+	fit_pixel_and_tap_costs(small_duration, large_duration, num_pixels, &profile.cpu_pixel_ns, &profile.cpu_tap_ns);
+
+	config.approx = 1;
+	profile.cpu_approx_ns = time_cpu_blur(&img_data, CALIBRATION_LARGE_STD_DEV, &config) * 1e9 / num_pixels;
+
+	// Time creating and joining threads on a tiny image (the exact planar blur has 3 passes)
+	img_data.width = 4;
+	img_data.height = CALIBRATION_THREADS;
+	config.num_threads = CALIBRATION_THREADS;
+	config.approx = 0;
+	profile.thread_us = time_cpu_blur(&img_data, CALIBRATION_SMALL_STD_DEV, &config) * 1e6 / (3 * CALIBRATION_THREADS);
+	img_data.width = CALIBRATION_SIZE;
+	img_data.height = CALIBRATION_SIZE;
+
+	// Time setting up the gpu and the gpu blur
+	if (profile.gpu) {
+		printf("Calibrating gpu...\n");
+		double small_setup, large_setup;
+		small_duration = time_gpu_blur(&img_data, CALIBRATION_SMALL_STD_DEV, &small_setup);
+		large_duration = time_gpu_blur(&img_data, CALIBRATION_LARGE_STD_DEV, &large_setup);
+		profile.gpu_setup_ms = (small_setup < large_setup ? small_setup : large_setup) * 1e3;
+		fit_pixel_and_tap_costs(small_duration, large_duration, num_pixels, &profile.gpu_pixel_ns, &profile.gpu_tap_ns);
+	} else {
+		printf("No gpu found, the auto device will only use the cpu\n");
+	}
+
+	release_img_arena(&arena);
+
+	// Write the profile
+	char path[4096];
+	get_profile_path(path, sizeof(path));
+	FILE *fp = fopen(path, "w");
+	if (fp == NULL) { error(NULL); }
+	fprintf(fp, "# Gaussian blur calibration profile (written by --calibrate)\n");
+	fprintf(fp, "cpu_pixel_ns %f\n", profile.cpu_pixel_ns);
+	fprintf(fp, "cpu_tap_ns %f\n", profile.cpu_tap_ns);
+	fprintf(fp, "cpu_approx_ns %f\n", profile.cpu_approx_ns);
+	fprintf(fp, "thread_us %f\n", profile.thread_us);
+	fprintf(fp, "gpu %u\n", profile.gpu);
+	if (profile.gpu) {
+		fprintf(fp, "gpu_setup_ms %f\n", profile.gpu_setup_ms);
+		fprintf(fp, "gpu_pixel_ns %f\n", profile.gpu_pixel_ns);
+		fprintf(fp, "gpu_tap_ns %f\n", profile.gpu_tap_ns);
+	}
+	if (fclose(fp)) { error("could not close calibration profile\n"); }
+
+	// Output the profile
+	printf("\nCpu: %f ns per pixel + %f ns per pixel per tap, approximate %f ns per pixel, %f us per thread per pass\n",
+			profile.cpu_pixel_ns, profile.cpu_tap_ns, profile.cpu_approx_ns, profile.thread_us);
+	if (profile.gpu) {
+		printf("Gpu: %f ms set up + %f ns per pixel + %f ns per pixel per tap\n", profile.gpu_setup_ms, profile.gpu_pixel_ns, profile.gpu_tap_ns);
+	}
+	printf("Calibration Profile: %s\n", path);
+}
+
+/**
+ * Picks the engine and number of threads expected to blur an image the fastest
+ * The cpu blurs are modelled as their single thread cost split evenly over the threads (up to one per core), plus creating the threads for every pass
+ * @param profile : how long each engine takes on this host
+ * @param width : width of the image in pixels
+ * @param height : height of the image in pixels
+ * @param std_dev : standard deviation of the blur
+ * @param allow_approx : true if the approximate cpu blur can be picked
+ * @param [output] choice : the picked engine
+ */
+void choose_engine(struct Cost_Profile *profile, unsigned width, unsigned height, float std_dev, bool allow_approx, struct Engine_Choice *choice) {
+	double num_pixels = (double) width * height;
+	unsigned num_taps = 2 * kernel_len_for_std_dev(std_dev);
+
+	// More threads than cores (or rows, since every thread gets a band of rows) never helps
+	long num_cores = sysconf(_SC_NPROCESSORS_ONLN);
+	unsigned max_threads = num_cores > 0 ? num_cores : 1;
+	if (max_threads > height) { max_threads = height; }
+
+	choice->estimated_duration = -1;
+	for (unsigned threads = 1; threads <= max_threads; ++threads) {
+		float thread_duration = threads * profile->thread_us * 1e-6;
+
+		float exact_duration = num_pixels * (profile->cpu_pixel_ns + num_taps * profile->cpu_tap_ns) * 1e-9 / threads + 3 * thread_duration;
+		if (choice->estimated_duration < 0 || exact_duration < choice->estimated_duration) {
+			choice->device = 'c';
+			choice->threads = threads;
+			choice->approx = 0;
+			choice->estimated_duration = exact_duration;
+		}
+
+		float approx_duration = num_pixels * profile->cpu_approx_ns * 1e-9 / threads + 2 * thread_duration;
+		if (allow_approx && approx_duration < choice->estimated_duration) {
+			choice->device = 'c';
+			choice->threads = threads;
+			choice->approx = 1;
+			choice->estimated_duration = approx_duration;
+		}
+	}
+
+	if (profile->gpu) {
+		float gpu_duration = profile->gpu_setup_ms * 1e-3 + num_pixels * (profile->gpu_pixel_ns + num_taps * profile->gpu_tap_ns) * 1e-9;
+		if (gpu_duration < choice->estimated_duration) {
+			choice->device = 'g';
+			choice->threads = 1;
+			choice->approx = 0;
+			choice->estimated_duration = gpu_duration;
+		}
+	}
+}
@@ -0,0 +1,257 @@
+// Ivan Bystrov
+// 18 October 2026
+//
+// Blurs a list of images in batches of the same size class, so the gpu blurs a whole batch of small images in one dispatch per pass
+
+// Needed for getline
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "batch.h"
+#include "image_io.h"
+#include "blur_helpers.h"
+#include "error.h"
+
+// The width and height of a size class are multiples of this, so images of nearly the same size share a batch
+// (each one is blurred in the corner of its layer, and the work items past its edges return straight away)
+#define SIZE_CLASS_STEP 64
+
+// Most pixels the layers of one batch can have together, so the two image arrays on the gpu stay a bounded size
+#define MAX_BATCH_PIXELS (16UL << 20)
+
+// Most bytes the two arrays of every image of one batch can take together in the arena (at the padded row stride of the size class),
+// so the images loaded on the host stay a bounded size too
+#define MAX_BATCH_BYTES (128UL << 20)
+
+
+/**
+ * Struct storing one image of the list
+ * input_filename : filename of the image
+ * output_filename : filename the blurred image is written to
+ * width : width of the image in pixels (only its header is read before the batches are formed, it is decoded with its batch)
+ * height : height of the image in pixels
+ * class_width : width of the size class of the image in pixels
+ * class_height : height of the size class of the image in pixels
+ * index : position of the image in the list (so images of a class stay in list order)
+ */
+struct Batch_Job {
+	char *input_filename;
+	char *output_filename;
+	unsigned width;
+	unsigned height;
+	unsigned class_width;
+	unsigned class_height;
+	unsigned index;
+};
+
+
+/**
+ * Rounds a width or height up to its size class
+ * @param size : the width or height in pixels
+ * @return the width or height of the size class
+ */
+static unsigned size_class(unsigned size) {
+	return (size + SIZE_CLASS_STEP - 1) / SIZE_CLASS_STEP * SIZE_CLASS_STEP;
+}
+
+/**
+ * Orders jobs by size class, then by their position in the list (for qsort)
+ * @param a : pointer to the first Batch_Job
+ * @param b : pointer to the second Batch_Job
+ * @return negative if a goes first, positive if b goes first
+ */
+static int compare_jobs(const void *a, const void *b) {
+	const struct Batch_Job *job_a = a;
+	const struct Batch_Job *job_b = b;
+	if (job_a->class_height != job_b->class_height) { return job_a->class_height < job_b->class_height ? -1 : 1; }
+	if (job_a->class_width != job_b->class_width) { return job_a->class_width < job_b->class_width ? -1 : 1; }
+	return job_a->index < job_b->index ? -1 : 1;
+}
+
+/**
+ * Reads the list of images to blur, one filename per line (empty lines are skipped)
+ * @param list_filename : filepath to the list
+ * @param [output] num_images : the number of images in the list
+ * @return the (malloced) filenames of the images (each one malloced)
+ */
+char **read_batch_list(char *list_filename, unsigned *num_images) {
+	FILE *fp = fopen(list_filename, "r");
+	if (fp == NULL) { error(NULL); }
+
+	char **filenames = NULL;
+	*num_images = 0;
+	char *line = NULL;
+	size_t line_size = 0;
+	ssize_t line_len;
+	while ((line_len = getline(&line, &line_size, fp)) != -1) {
+		// Drop the line ending (and the carriage return of lists written on windows)
+		while (line_len > 0 && (line[line_len - 1] == '\n' || line[line_len - 1] == '\r')) { line[--line_len] = '\0'; }
+		if (line_len == 0) { continue; }
+		if (image_format(line) == FORMAT_UNKNOWN) { error("batch list has a line that is not an image in a supported format\n"); }
+
+		filenames = realloc(filenames, sizeof(char *) * (*num_images + 1));
+		if (filenames == NULL) { error("could not allocate batch list\n"); }
+		filenames[*num_images] = strdup(line);
+		if (filenames[*num_images] == NULL) { error("could not allocate batch list\n"); }
+		(*num_images) ++;
+	}
+	free(line);
+	if (fclose(fp)) { error(NULL); }
+
+	if (*num_images == 0) { error("batch list has no images\n"); }
+	return filenames;
+}
+
+/**
+ * Blurs every image of a list and writes each one to its output file
+ * The images are sorted into size classes, and consecutive images of a class are blurred together as one batch
+ * @param input_filenames : the filenames of the images to blur
+ * @param output_filenames : the filenames to write the blurred images to (in the same order as input_filenames)
+ * @param num_images : the number of images
+ * @param std_dev : desired standard deviation of the gaussian blur
+ * @param device : 'c' to blur on the cpu (one image after another), 'g' to blur each batch on the gpu in one dispatch per pass
+ * @param cpu_config : how the cpu blur should be performed (only used if device is 'c', the area is ignored)
+ * @param gpu_config : how the gpu blur should be performed (only used if device is 'g', the area is ignored, needs images that are not linear)
+ * @param arena : the arena the images of each batch are loaded into (and handed back to after the batch is written)
+ */
+void blur_batch(char **input_filenames, char **output_filenames, unsigned num_images, unsigned std_dev, char device,
+		struct Cpu_Config *cpu_config, struct Gpu_Config *gpu_config, struct Img_Arena *arena) {
+	// Create the 1D Gaussian convolution kernel once for every image and output it
+	unsigned gaussian_kernel_len = std_dev * RADIUS * 2 + 1;
+	float *gaussian_kernel = malloc(sizeof(float) * gaussian_kernel_len);
+	calculate_kernel(&gaussian_kernel, gaussian_kernel_len, std_dev);
+	print_kernel(gaussian_kernel, gaussian_kernel_len);
+
+	// Read the size of every image from its header, and sort the images by size class (the order of the list is kept within a class)
+	struct Batch_Job *jobs = malloc(sizeof(struct Batch_Job) * num_images);
+	if (jobs == NULL) { error("could not allocate batch jobs\n"); }
+	for (unsigned i = 0; i < num_images; ++i) {
+		jobs[i].input_filename = input_filenames[i];
+		jobs[i].output_filename = output_filenames[i];
+		read_image_size(input_filenames[i], &jobs[i].width, &jobs[i].height);
+		jobs[i].class_width = size_class(jobs[i].width);
+		jobs[i].class_height = size_class(jobs[i].height);
+		jobs[i].index = i;
+	}
+	qsort(jobs, num_images, sizeof(struct Batch_Job), compare_jobs);
+
+	// The gpu keeps one context (and program) for every batch, new image arrays are only created when the size class changes
+	// The batched kernels always read images, so images are used on any device that supports them
+	struct Gpu_Context *ctx = NULL;
+	unsigned max_layers = num_images;
+	if (device == 'g') {
+		struct Gpu_Config batch_config = *gpu_config;
+		batch_config.area = NULL;
+		batch_config.memory = 'i';
+
+		// The context only needs the size of an image (the batch images are created for each size class)
+		struct Img_Data size_data;
+		memset(&size_data, 0, sizeof(size_data));
+		size_data.width = jobs[0].width;
+		size_data.height = jobs[0].height;
+		size_data.pixel_length = 4;
+		ctx = create_gpu_context(&size_data, gaussian_kernel, gaussian_kernel_len, &batch_config);
+		max_layers = gpu_max_batch_layers(ctx);
+		if (max_layers == 0) { error("the batched blur needs images, which this OpenCL device does not support\n"); }
+	}
+
+	// Only the images of one batch are decoded at a time
+	struct Img_Data *batch_data = malloc(sizeof(struct Img_Data) * num_images);
+	struct Img_Data **batch_imgs = malloc(sizeof(struct Img_Data *) * num_images);
+	if (batch_data == NULL || batch_imgs == NULL) { error("could not allocate batch\n"); }
+
+	printf("Blurring %u images...\n", num_images);
+	unsigned num_batches = 0;
+	unsigned num_classes = 0;
+	size_t num_pxls = 0;
+	float duration = 0;
+	for (unsigned first = 0, last; first < num_images; first = last) {
+		// A batch is the next images of the same size class, up to the layers of an image array, MAX_BATCH_PIXELS and MAX_BATCH_BYTES
+		// (an image over either on its own is a batch of one)
+		unsigned class_width = jobs[first].class_width;
+		unsigned class_height = jobs[first].class_height;
+		size_t class_pxls = (size_t) class_width * class_height;
+		size_t class_bytes = 2 * (size_t) padded_row_stride(class_width * 4) * class_height;
+		if (first == 0 || class_width != jobs[first - 1].class_width || class_height != jobs[first - 1].class_height) { num_classes ++; }
+		last = first + 1;
+		while (last < num_images && jobs[last].class_width == class_width && jobs[last].class_height == class_height
+				&& last - first < max_layers && (last - first + 1) * class_pxls <= MAX_BATCH_PIXELS && (last - first + 1) * class_bytes <= MAX_BATCH_BYTES) {
+			last ++;
+		}
+		unsigned batch_size = last - first;
+
+		// Open the images of the batch, they are freed (and handed back to the arena) once they are written
+		struct Arena_Mark mark = arena_mark(arena);
+		for (unsigned i = 0; i < batch_size; ++i) {
+			struct Img_Data *img_datap = &batch_data[i];
+			open_image(img_datap, jobs[first + i].input_filename);
+			if (img_datap->width != jobs[first + i].width || img_datap->height != jobs[first + i].height) {
+				error("batch image changed size since its header was read\n");
+			}
+		}
+
+		// Have each pinned thread first touch the rows it blurs of every image before they are decoded (a raw image only needs its temp array),
+		// and the scratch memory every blur of the batch allocates after them (sized for the largest image of the size class)
+		if (device == 'c' && cpu_config->placement) {
+			struct Arena_Mark touch_mark = arena_mark(arena);
+			for (unsigned i = 0; i < batch_size; ++i) {
+				struct Img_Data *img_datap = &batch_data[i];
+				bool raw = image_format(jobs[first + i].input_filename) == FORMAT_RAW;
+				unsigned row_stride = raw ? img_datap->row_stride : padded_row_stride(img_datap->width * img_datap->pixel_length);
+				unsigned char *arrays[2];
+				for (unsigned arr = 0; arr < (raw ? 1u : 2u); ++arr) {
+					arrays[arr] = arena_alloc(arena, (size_t) row_stride * img_datap->height);
+				}
+				first_touch_arrays(arrays, raw ? 1 : 2, img_datap->height, row_stride, cpu_config);
+			}
+			first_touch_blur_scratch(arena, class_width, class_height, padded_row_stride(class_width * 4), cpu_config);
+			release_to_arena_mark(arena, touch_mark);
+		}
+
+		// Decode the images of the batch into the memory that was just touched
+		for (unsigned i = 0; i < batch_size; ++i) {
+			struct Img_Data *img_datap = &batch_data[i];
+			load_image_arrays(img_datap, arena, padded_row_stride(img_datap->width * img_datap->pixel_length));
+			batch_imgs[i] = img_datap;
+			num_pxls += (size_t) img_datap->width * img_datap->height;
+		}
+
+		// Time only the blur of the batch, not reading and writing the images
+		struct timespec start, finish;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		if (device == 'g') {
+			blur_gpu_batch_with_context(ctx, batch_imgs, batch_size, class_width, class_height);
+		} else {
+			for (unsigned i = 0; i < batch_size; ++i) {
+				blur_cpu_with_kernel(batch_imgs[i], gaussian_kernel, gaussian_kernel_len, cpu_config);
+			}
+		}
+		clock_gettime(CLOCK_MONOTONIC, &finish);
+		duration += (finish.tv_sec - start.tv_sec);
+		duration += (finish.tv_nsec - start.tv_nsec) / 1000000000.0;
+		printf("Batch %u: %u images of up to %u x %u\n", num_batches, batch_size, class_width, class_height);
+		num_batches ++;
+
+		// Write every blurred image of the batch, and free it
+		for (unsigned i = 0; i < batch_size; ++i) {
+			write_image(batch_imgs[i], jobs[first + i].output_filename);
+			free_image(batch_imgs[i]);
+		}
+		release_to_arena_mark(arena, mark);
+	}
+
+	// Output how many batches the images took and how fast they were blurred
+	printf("\nImages: %u, Size Classes: %u, Batches: %u\n", num_images, num_classes, num_batches);
+	printf("Blur Duration: %f seconds (%f megapixels per second)\n\n", duration, duration > 0 ? num_pxls / duration / 1000000 : 0.0);
+	if (device == 'c' && cpu_config->placement) { print_thread_placement(cpu_config->placement, cpu_config->num_threads); }
+
+	// Free everything (the images were freed with their batch)
+	if (ctx) { release_gpu_context(ctx); }
+	free(batch_imgs);
+	free(batch_data);
+	free(jobs);
+	free(gaussian_kernel);
+}
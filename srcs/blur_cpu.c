@@ -7,11 +7,19 @@
 #include <stdlib.h>
 #include <math.h>
 #include <time.h>
+#include <string.h>
 #include <pthread.h>
 #include "blur_cpu.h"
 #include "blur_helpers.h"
+#include "folded_kernels.h"
 #include "error.h"
 
+// Number of colour channels that are blurred (alpha is always passed through untouched)
+#define NUM_COLOUR_CHANNELS 3
+
+// What each pass of the interleaved and planar blurs does, for the perf report
+static char *INTERLEAVED_PASS_NAMES[] = { "vertical", "horizontal" };
+static char *PLANAR_PASS_NAMES[] = { "deinterleave", "vertical", "horizontal" };
 
 /** Struct storing all the information threads will need to perform blur
  * img_datap : pointer to the Img_Data struct that contains all the info
@@ -19,8 +27,21 @@
  * end_row : the first row (greater than start_row) the thread should NOT operate on
  * gaussian_kernel : pointer to the gaussian kernel that will perform the blur
  * guassian_kernel_len : length of the gaussian_kernel in pixels
+ * folded_sums : the unrolled kernel of the radius of gaussian_kernel (NULL if there isn't one), looked up once for the whole pass
  * offset : the offset into the gaussian_kernel that the target pixel is at
- * pass : 0 = first pass of the blur, 1 = second pass of the blur
+ * pass : 0 = first pass of the blur, 1 = second pass of the blur (planar blur also has a deinterleave pass before these)
+ * planes : the R, G, B planes of the input image stored one after another (only used by the planar blur)
+ * area : the regions (and mask) of the image to blur
+ * num_passes : total number of passes of the blur (2 for interleaved, 3 for planar)
+ * box_widths : the NUM_BOXES box widths of the approximate blur (only used by the approximate blur, which splits pass 1 into bands of columns)
+ * out_width : width of the downscaled image in pixels (only used by the downscaling blur, where start_row and last_row are rows of the downscaled image)
+ * out_height : height of the downscaled image in pixels
+ * out_pixels : the downscaled RGBA pixels (out_width * out_height)
+ * op : the operation to output instead of the blurred image, applied in the last pass (NULL means output the blurred image)
+ * dog_img_datap : copy of img_datap whose arrays[1] stores the first pass blurred with dog_kernel (only used by a difference of gaussians)
+ * dog_kernel : the 1D convolution kernel of the blur a difference of gaussians subtracts
+ * dog_kernel_len : the length of dog_kernel
+ * dog_folded_sums : the unrolled kernel of the radius of dog_kernel (NULL if there isn't one)
  */
 struct Thread_Params {
 	struct Img_Data *img_datap;
@@ -28,29 +49,82 @@ struct Thread_Params {
 	unsigned last_row;
 	float *gaussian_kernel;
 	unsigned gaussian_kernel_len;
+	Folded_Sums_Func folded_sums;
 	unsigned offset;
 	unsigned pass;
+	unsigned char *planes;
+	struct Blur_Area *area;
+	unsigned num_passes;
+	unsigned *box_widths;
+	unsigned out_width;
+	unsigned out_height;
+	unsigned char *out_pixels;
+	struct Blur_Op *op;
+	struct Img_Data *dog_img_datap;
+	float *dog_kernel;
+	unsigned dog_kernel_len;
+	Folded_Sums_Func dog_folded_sums;
 };
 
 /**
- * Calculates what the new values for each componenet of the blurred pixel should be and stores those values in the new img (FIRST PASS out of 2) 
+ * Gets the part of the image a pass has to compute to blur a region (earlier passes also compute the halo later passes read)
+ * @param img_datap : pointer to struct that stores all image information
+ * @param region : the region of the image to blur
+ * @param pass : the pass to get the region for
+ * @param num_passes : total number of passes (the last two are always the vertical then the horizontal blur)
+ * @param offset : the index of the target pixel in the gaussian kernel (how far the halo extends)
+ * @return the region the pass has to compute
+ */
+struct Region get_pass_region(struct Img_Data *img_datap, struct Region region, unsigned pass, unsigned num_passes, unsigned offset) {
+	unsigned passes_left = num_passes - pass - 1;
+	unsigned halo_x = passes_left >= 1 ? offset : 0;
+	unsigned halo_y = passes_left >= 2 ? offset : 0;
+	return expand_region(region, halo_x, halo_y, img_datap->width, img_datap->height);
+}
+
+/**
+ * Cuts a region down to the rows in [start_row, last_row)
+ * @param region : the region to cut
+ * @param start_row : the first row to keep
+ * @param last_row : the first row (greater than start_row) to NOT keep
+ * @return the cut region (height is 0 if no rows are left)
+ */
+struct Region clip_region_rows(struct Region region, unsigned start_row, unsigned last_row) {
+	unsigned top = region.y > start_row ? region.y : start_row;
+	unsigned bottom = region.y + region.height < last_row ? region.y + region.height : last_row;
+	region.y = top;
+	region.height = bottom > top ? bottom - top : 0;
+	return region;
+}
+
+/**
+ * Calculates the weighted sums of the R, G, B components of the pixels the kernel covers around the target pixel in one direction
  * @param img_datap : pointer to struct that stores all image information
+ * @param input_arr : the image array to read the pixels from
  * @param row : the row the target pixel is at
  * @param col : the column the target pixel is at
  * @param gaussian_kernel : the 1D convolution kernel that will apply the blur
  * @param gaussian_kernel_len : the length of the kernel
- * @param offset : the index of the target pixel in the gaussian kernel (always RADIUS * std_dev)
- * @param pass : 0 if its the first pass of the blur, 1 if its the second pass (illegal inputs not checked so make sure calling function gives correct pass value)
+ * @param folded_sums : the unrolled kernel of the radius of gaussian_kernel, from get_folded_sums (NULL means the generic loop is used)
+ * @param offset : the index of the target pixel in the gaussian kernel
+ * @param pass : 0 to sum vertically (first pass), 1 to sum horizontally (second pass)
+ * @param [output] sums : the 3 weighted sums
  */
-void blur_pixel(struct Img_Data *img_datap, unsigned row, unsigned col, float *gaussian_kernel, unsigned gaussian_kernel_len, unsigned offset, unsigned pass) {
-	// Set the input and output buffers of this blur depending on the pass
-	unsigned char *input_arr = img_datap->arrays[0 + pass];
-	unsigned char *output_arr = img_datap->arrays[1 - pass];
-
+void blur_pixel_sums(struct Img_Data *img_datap, unsigned char *input_arr, unsigned row, unsigned col, float *gaussian_kernel, unsigned gaussian_kernel_len,
+		Folded_Sums_Func folded_sums, unsigned offset, unsigned pass, float *sums) {
 	// Set the rest of the values in img_data used in this blur
 	unsigned pxl_length = img_datap->pixel_length;
 	unsigned width = img_datap->width;
 	unsigned height = img_datap->height;
+
+	// Pixels whose taps are all inside the image use the unrolled kernel of their radius (if there is one), which folds the mirrored taps
+	unsigned pos = pass == 1 ? col : row;
+	unsigned len = pass == 1 ? width : height;
+	if (folded_sums && pos >= offset && pos + offset < len) {
+		unsigned char *center = input_arr + ((size_t) row * img_datap->row_stride) + (col * pxl_length);
+		folded_sums(center, pass == 1 ? pxl_length : img_datap->row_stride, gaussian_kernel + offset, sums);
+		return;
+	}
 	
 	// Initialize sum values used in the weighted average calculation of the target pixel
 	float sum_r = 0;
@@ -74,7 +148,7 @@ void blur_pixel(struct Img_Data *img_datap, unsigned row, unsigned col, float *g
 		// The cast to (int) should not cause issues because libpng constrains input image to 1 million pixels
 		if (!(cur_pxl_row < 0 || cur_pxl_row >= (int) height || cur_pxl_col < 0 || cur_pxl_col >= (int) width)) {
 			// Get a pointer to the pixel being multiplied this iteration
-			unsigned char *pxl = input_arr + (cur_pxl_row * width * pxl_length) + (cur_pxl_col * pxl_length);
+			unsigned char *pxl = input_arr + ((size_t) cur_pxl_row * img_datap->row_stride) + (cur_pxl_col * pxl_length);
 			
 			// Multiply each component of the input pixel with the corresponding element of the gaussian kernel
 			sum_r += *(pxl + 0) * gaussian_kernel[i];
@@ -83,14 +157,122 @@ void blur_pixel(struct Img_Data *img_datap, unsigned row, unsigned col, float *g
 		}
 	}
 
+	sums[0] = sum_r;
+	sums[1] = sum_g;
+	sums[2] = sum_b;
+}
+
+/**
+ * Calculates what the new values for each componenet of the blurred pixel should be and stores those values in the new img (FIRST PASS out of 2) 
+ * @param img_datap : pointer to struct that stores all image information
+ * @param row : the row the target pixel is at
+ * @param col : the column the target pixel is at
+ * @param gaussian_kernel : the 1D convolution kernel that will apply the blur
+ * @param gaussian_kernel_len : the length of the kernel
+ * @param folded_sums : the unrolled kernel of the radius of gaussian_kernel, from get_folded_sums (NULL means the generic loop is used)
+ * @param offset : the index of the target pixel in the gaussian kernel (always RADIUS * std_dev)
+ * @param pass : 0 if its the first pass of the blur, 1 if its the second pass (illegal inputs not checked so make sure calling function gives correct pass value)
+ */
+void blur_pixel(struct Img_Data *img_datap, unsigned row, unsigned col, float *gaussian_kernel, unsigned gaussian_kernel_len, Folded_Sums_Func folded_sums,
+		unsigned offset, unsigned pass) {
+	// Set the input and output buffers of this blur depending on the pass
+	unsigned char *input_arr = img_datap->arrays[0 + pass];
+	unsigned char *output_arr = img_datap->arrays[1 - pass];
+	float sums[3];
+	blur_pixel_sums(img_datap, input_arr, row, col, gaussian_kernel, gaussian_kernel_len, folded_sums, offset, pass, sums);
+
 	// Round the average of each component of the target pixel and store it in the output image array
-	unsigned target_pxl = (row * width * pxl_length) + (col * pxl_length);
-	output_arr[target_pxl + 0] = (unsigned char) round(sum_r);
-	output_arr[target_pxl + 1] = (unsigned char) round(sum_g);
-	output_arr[target_pxl + 2] = (unsigned char) round(sum_b);
+	size_t target_pxl = ((size_t) row * img_datap->row_stride) + (col * img_datap->pixel_length);
+	output_arr[target_pxl + 0] = (unsigned char) round(sums[0]);
+	output_arr[target_pxl + 1] = (unsigned char) round(sums[1]);
+	output_arr[target_pxl + 2] = (unsigned char) round(sums[2]);
 	output_arr[target_pxl + 3] = input_arr[target_pxl + 3];
 }
 
+/**
+ * Rounds a (non negative) weighted sum of pixel components to a component, the same way round() would
+ * @param sum : the weighted sum to round
+ * @return the rounded component
+ */
+static inline unsigned char round_component(float sum) {
+	// Adding 0.5 in double precision is exact for any float so truncating gives the same result as round(), but vectorizes
+	return (unsigned char) ((double) sum + 0.5);
+}
+
+/**
+ * Calculates a component of the output of a blur operation from the weighted sums of the last pass (clamped to a valid component)
+ * @param op : the operation to apply
+ * @param original : the component of the input image
+ * @param sum : the weighted sum of the blur
+ * @param dog_sum : the weighted sum of the blur a difference of gaussians subtracts (only used by a difference of gaussians)
+ * @return the component of the output
+ */
+static inline unsigned char blur_op_component(struct Blur_Op *op, unsigned char original, float sum, float dog_sum) {
+	float value = op->type == 'u' ? original + op->amount * (original - sum) : 128 + sum - dog_sum;
+	if (value < 0) { return 0; }
+	if (value > 255) { return 255; }
+	return round_component(value);
+}
+
+/**
+ * Calculates the second pass of the blur for a pixel and stores the output of a blur operation over the input pixel in img_datap->arrays[0] (SECOND PASS out of 2)
+ * @param tp : the Thread_Params of the thread (for the operation, and the second kernel of a difference of gaussians)
+ * @param row : the row the target pixel is at
+ * @param col : the column the target pixel is at
+ */
+void blur_pixel_op(struct Thread_Params *tp, unsigned row, unsigned col) {
+	struct Img_Data *img_datap = tp->img_datap;
+	float sums[3];
+	float dog_sums[3] = { 0, 0, 0 };
+	blur_pixel_sums(img_datap, img_datap->arrays[1], row, col, tp->gaussian_kernel, tp->gaussian_kernel_len, tp->folded_sums, tp->offset, 1, sums);
+	if (tp->op->type == 'd') {
+		blur_pixel_sums(img_datap, tp->dog_img_datap->arrays[1], row, col, tp->dog_kernel, tp->dog_kernel_len, tp->dog_folded_sums, tp->dog_kernel_len / 2, 1, dog_sums);
+	}
+
+	// The input pixel is still in arrays[0] (alpha is left as it is)
+	unsigned char *pxl = img_datap->arrays[0] + ((size_t) row * img_datap->row_stride) + (col * img_datap->pixel_length);
+	for (unsigned channel = 0; channel < NUM_COLOUR_CHANNELS; ++channel) {
+		pxl[channel] = blur_op_component(tp->op, pxl[channel], sums[channel], dog_sums[channel]);
+	}
+}
+
+/**
+ * Counts the pixels a thread computes in its pass of the exact blur (every pixel of the pass regions in its band of rows)
+ * @param tp : the parameters of the thread
+ * @return the number of pixels
+ */
+size_t thread_pass_pixels(struct Thread_Params *tp) {
+	size_t pixels = 0;
+	for (unsigned i = 0; i < tp->area->num_regions; ++i) {
+		struct Region region = get_pass_region(tp->img_datap, tp->area->regions[i], tp->pass, tp->num_passes, tp->offset);
+		region = clip_region_rows(region, tp->start_row, tp->last_row);
+		pixels += (size_t) region.width * region.height;
+	}
+	return pixels;
+}
+
+/**
+ * Starts a thread of a pass, through perf_thread if the hardware events of the threads are counted
+ * @param [output] thread : where the id of the thread is stored
+ * @param thread_func : the function the thread runs
+ * @param tp : the parameters of the thread
+ * @param [output] pt : where the Perf_Thread of the thread is stored (must stay valid until the thread is joined)
+ * @param counters : the counters of the thread in this pass, with pixels already set (NULL means nothing is counted)
+ * @param cpu : the cpu to pin the thread to (-1 means don't pin it)
+ */
+void create_blur_thread(pthread_t *thread, void *(*thread_func)(void *), struct Thread_Params *tp, struct Perf_Thread *pt, struct Perf_Counters *counters,
+		int cpu) {
+	if (counters == NULL) {
+		create_pinned_thread(thread, thread_func, tp, cpu);
+		return;
+	}
+
+	pt->thread_func = thread_func;
+	pt->thread_params = tp;
+	pt->counters = counters;
+	create_pinned_thread(thread, perf_thread, pt, cpu);
+}
+
 /**
  * Entry point for the cpu threads to perform the blur
  * @param thread_params : Pointer to Thread_Params struct
@@ -104,17 +286,34 @@ void *multithreaded_blur(void *thread_params) {
 	unsigned last_row = tp->last_row;
 	float *gaussian_kernel = tp->gaussian_kernel;
 	unsigned gaussian_kernel_len = tp->gaussian_kernel_len;
+	Folded_Sums_Func folded_sums = tp->folded_sums;
 	unsigned offset = tp->offset;
 	unsigned pass = tp->pass;
+	struct Blur_Area *area = tp->area;
 
 	unsigned counter = 0;
 	
-	// Loop over every pixel this thread is allowed, and apply correct blur to it depending on the pass
-	if (last_row > img_datap->height) { last_row = img_datap->height; }
-	for (unsigned row = start_row; row < last_row; ++row) {
-		for (unsigned col = 0; col < img_datap->width; ++col) {
-			blur_pixel(img_datap, row, col, gaussian_kernel, gaussian_kernel_len, offset, pass);
-			counter ++;
+	// Loop over every pixel of every region this thread is allowed, and apply correct blur to it depending on the pass
+	for (unsigned i = 0; i < area->num_regions; ++i) {
+		struct Region region = get_pass_region(img_datap, area->regions[i], pass, tp->num_passes, offset);
+		region = clip_region_rows(region, start_row, last_row);
+		
+		for (unsigned row = region.y; row < region.y + region.height; ++row) {
+			for (unsigned col = region.x; col < region.x + region.width; ++col) {
+				// Only the last pass is limited by the mask, the first pass has to compute everything the last pass reads
+				if (pass == 1 && area->mask && !area->mask[(size_t) row * img_datap->width + col]) { continue; }
+
+				// A blur operation is applied in the last pass, and a difference of gaussians also does the first pass with its second kernel
+				if (pass == 1 && tp->op) {
+					blur_pixel_op(tp, row, col);
+				} else {
+					blur_pixel(img_datap, row, col, gaussian_kernel, gaussian_kernel_len, folded_sums, offset, pass);
+					if (pass == 0 && tp->dog_img_datap) {
+						blur_pixel(tp->dog_img_datap, row, col, tp->dog_kernel, tp->dog_kernel_len, tp->dog_folded_sums, tp->dog_kernel_len / 2, 0);
+					}
+				}
+				counter ++;
+			}
 		}
 	}
 
@@ -124,44 +323,729 @@ void *multithreaded_blur(void *thread_params) {
 }
 
 /**
- * Performs blur on the input image and stores it in new image space
- * @param img_datap : struct storing all the info of the input image
- * @param std_dev : desired standard deviation of the gaussian_blur
- * @param num_threads : number of threads to use for the blur
+ * Copies the R, G, B components of part of the interleaved image in img_datap->arrays[0] into the colour planes
+ * @param img_datap : pointer to struct that stores all image information
+ * @param [output] planes : the R, G, B planes (each width * height bytes) stored one after another
+ * @param region : the part of the image to copy
  */
-void blur_cpu(struct Img_Data *img_datap, unsigned std_dev, unsigned num_threads) {
-	// Create the 1D Gaussian convolution kernel and output it
-	unsigned gaussian_kernel_len = std_dev * RADIUS * 2 + 1;
-	float *gaussian_kernel = malloc(sizeof(float) * gaussian_kernel_len);
-	calculate_kernel(&gaussian_kernel, gaussian_kernel_len, std_dev);
-	print_kernel(gaussian_kernel, gaussian_kernel_len);
+void deinterleave_region(struct Img_Data *img_datap, unsigned char *planes, struct Region region) {
+	unsigned width = img_datap->width;
+	unsigned pxl_length = img_datap->pixel_length;
+	size_t plane_size = (size_t) width * img_datap->height;
 
-	// Start timing the duration of the blur
-	printf("Blurring...\n");
-	struct timespec start, finish;
-	float duration;
-	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (unsigned row = region.y; row < region.y + region.height; ++row) {
+		unsigned char *in_row = img_datap->arrays[0] + (size_t) row * img_datap->row_stride;
+		for (unsigned channel = 0; channel < NUM_COLOUR_CHANNELS; ++channel) {
+			unsigned char *out_row = planes + channel * plane_size + (size_t) row * width;
+			for (unsigned col = region.x; col < region.x + region.width; ++col) {
+				out_row[col] = in_row[col * pxl_length + channel];
+			}
+		}
+	}
+}
+
+/**
+ * Blurs part of every colour plane with the vertical kernel (FIRST PASS out of 2 of the planar blur)
+ * The kernel is looped over in the outer loop so the inner loop reads whole contiguous rows (this is what vectorizes)
+ * @param in_planes : the R, G, B planes to blur
+ * @param [output] out_planes : the R, G, B planes to store the blurred pixels in
+ * @param width : width of the image in pixels
+ * @param height : height of the image in pixels
+ * @param region : the part of the planes to blur
+ * @param gaussian_kernel : the 1D convolution kernel that will apply the blur
+ * @param gaussian_kernel_len : the length of the kernel
+ * @param offset : the index of the target pixel in the gaussian kernel
+ * @param sums : scratch space for the weighted sums of one row (width floats)
+ */
+void planar_vertical_pass(unsigned char *in_planes, unsigned char *out_planes, unsigned width, unsigned height, struct Region region,
+		float *gaussian_kernel, unsigned gaussian_kernel_len, unsigned offset, float *sums) {
+	size_t plane_size = (size_t) width * height;
+	unsigned first_col = region.x;
+	unsigned end_col = region.x + region.width;
+
+	for (unsigned row = region.y; row < region.y + region.height; ++row) {
+		for (unsigned channel = 0; channel < NUM_COLOUR_CHANNELS; ++channel) {
+			unsigned char *in_plane = in_planes + channel * plane_size;
+			for (unsigned col = first_col; col < end_col; ++col) { sums[col] = 0; }
+
+			// Add every row the kernel covers to the sums, ignoring rows out of bounds of the image like blur_pixel does
+			for (unsigned i = 0; i < gaussian_kernel_len; ++i) {
+				int cur_row = row - offset + i;
+				if (cur_row < 0 || cur_row >= (int) height) { continue; }
+				
+				unsigned char *in_row = in_plane + (size_t) cur_row * width;
+				float weight = gaussian_kernel[i];
+				for (unsigned col = first_col; col < end_col; ++col) {
+					sums[col] += in_row[col] * weight;
+				}
+			}
+
+			unsigned char *out_row = out_planes + channel * plane_size + (size_t) row * width;
+			for (unsigned col = first_col; col < end_col; ++col) {
+				out_row[col] = round_component(sums[col]);
+			}
+		}
+	}
+}
+
+/**
+ * Calculates the weighted sums of the horizontal kernel for columns [first_col, end_col) of a row of a plane, ignoring taps out of bounds of the image
+ * For each kernel element only the columns whose tap lands inside the image are looped over (so the inner loop has no branches)
+ * @param in_row : the row of the plane to blur
+ * @param width : width of the image in pixels
+ * @param first_col : the first column to blur
+ * @param end_col : the first column (greater than first_col) to NOT blur
+ * @param gaussian_kernel : the 1D convolution kernel that will apply the blur
+ * @param gaussian_kernel_len : the length of the kernel
+ * @param offset : the index of the target pixel in the gaussian kernel
+ * @param [output] sums : the weighted sums, indexed by column (width floats)
+ */
+void horizontal_sums(unsigned char *in_row, unsigned width, unsigned first_col, unsigned end_col, float *gaussian_kernel, unsigned gaussian_kernel_len, unsigned offset, float *sums) {
+	for (unsigned col = first_col; col < end_col; ++col) { sums[col] = 0; }
+
+	for (unsigned i = 0; i < gaussian_kernel_len; ++i) {
+		int shift = (int) i - (int) offset;
+		int tap_first_col = (int) first_col + shift < 0 ? -shift : (int) first_col;
+		int tap_end_col = (int) end_col + shift > (int) width ? (int) width - shift : (int) end_col;
+		
+		float weight = gaussian_kernel[i];
+		for (int col = tap_first_col; col < tap_end_col; ++col) {
+			sums[col] += in_row[col + shift] * weight;
+		}
+	}
+}
+
+/**
+ * Blurs part of every colour plane with the horizontal kernel and interleaves the result back into img_datap->arrays[0] (SECOND PASS out of 2)
+ * Alpha components in img_datap->arrays[0] are never written so they stay the same as in the input image
+ * With a blur operation the output of the operation is stored instead, computed from the input pixel still in img_datap->arrays[0]
+ * @param img_datap : pointer to struct that stores all image information
+ * @param in_planes : the R, G, B planes to blur
+ * @param region : the part of the planes to blur
+ * @param mask : width * height bytes, only pixels with a non zero mask byte are written (NULL means all pixels are)
+ * @param gaussian_kernel : the 1D convolution kernel that will apply the blur
+ * @param gaussian_kernel_len : the length of the kernel
+ * @param offset : the index of the target pixel in the gaussian kernel
+ * @param sums : scratch space for the weighted sums of one row (width floats)
+ * @param op : the operation to store instead of the blurred pixels (NULL means store the blurred pixels)
+ * @param dog_planes : the R, G, B planes blurred vertically with dog_kernel (only used by a difference of gaussians)
+ * @param dog_kernel : the 1D convolution kernel of the blur a difference of gaussians subtracts
+ * @param dog_kernel_len : the length of dog_kernel
+ * @param dog_sums : scratch space for the weighted sums of dog_kernel of one row (width floats, only used by a difference of gaussians)
+ */
+void planar_horizontal_pass(struct Img_Data *img_datap, unsigned char *in_planes, struct Region region, unsigned char *mask,
+		float *gaussian_kernel, unsigned gaussian_kernel_len, unsigned offset, float *sums,
+		struct Blur_Op *op, unsigned char *dog_planes, float *dog_kernel, unsigned dog_kernel_len, float *dog_sums) {
+	unsigned width = img_datap->width;
+	unsigned pxl_length = img_datap->pixel_length;
+	size_t plane_size = (size_t) width * img_datap->height;
+	unsigned first_col = region.x;
+	unsigned end_col = region.x + region.width;
+
+	for (unsigned row = region.y; row < region.y + region.height; ++row) {
+		unsigned char *mask_row = mask ? mask + (size_t) row * width : NULL;
 		
-	// Declare the desired number of threads (and their params) and the number of rows they operate on
+		for (unsigned channel = 0; channel < NUM_COLOUR_CHANNELS; ++channel) {
+			unsigned char *in_row = in_planes + channel * plane_size + (size_t) row * width;
+			horizontal_sums(in_row, width, first_col, end_col, gaussian_kernel, gaussian_kernel_len, offset, sums);
+
+			unsigned char *out_row = img_datap->arrays[0] + (size_t) row * img_datap->row_stride;
+			if (!op) {
+				for (unsigned col = first_col; col < end_col; ++col) {
+					if (mask_row && !mask_row[col]) { continue; }
+					out_row[col * pxl_length + channel] = round_component(sums[col]);
+				}
+				continue;
+			}
+
+			// The operation is applied to the sums before they are rounded
+			if (op->type == 'd') {
+				unsigned char *dog_row = dog_planes + channel * plane_size + (size_t) row * width;
+				horizontal_sums(dog_row, width, first_col, end_col, dog_kernel, dog_kernel_len, dog_kernel_len / 2, dog_sums);
+			}
+			for (unsigned col = first_col; col < end_col; ++col) {
+				if (mask_row && !mask_row[col]) { continue; }
+				unsigned char *out = out_row + col * pxl_length + channel;
+				*out = blur_op_component(op, *out, sums[col], op->type == 'd' ? dog_sums[col] : 0);
+			}
+		}
+	}
+}
+
+/**
+ * Entry point for the cpu threads to perform the planar blur
+ * pass 0 deinterleaves arrays[0] into planes, pass 1 blurs planes vertically into arrays[1] (used as 3 planes),
+ * pass 2 blurs arrays[1] horizontally and interleaves the result into arrays[0]
+ * @param thread_params : Pointer to Thread_Params struct
+ * @return : returns NULL
+ */
+void *multithreaded_planar_blur(void *thread_params) {
+	// Get all the values from thread_params
+	struct Thread_Params *tp = (struct Thread_Params *) thread_params;
+	struct Img_Data *img_datap = tp->img_datap;
+	struct Blur_Area *area = tp->area;
+
+	// Scratch space for the sums of the row being blurred (and of the second kernel of a difference of gaussians)
+	float *sums = NULL;
+	float *dog_sums = NULL;
+	if (tp->pass != 0) {
+		sums = malloc(sizeof(float) * img_datap->width);
+		dog_sums = malloc(sizeof(float) * img_datap->width);
+		if (sums == NULL || dog_sums == NULL) { error("could not allocate row sums for planar blur\n"); }
+	}
+	
+	// Perform this pass on the part of every region inside this thread's band of rows
+	for (unsigned i = 0; i < area->num_regions; ++i) {
+		struct Region region = get_pass_region(img_datap, area->regions[i], tp->pass, tp->num_passes, tp->offset);
+		region = clip_region_rows(region, tp->start_row, tp->last_row);
+		if (!region.height) { continue; }
+
+		if (tp->pass == 0) {
+			deinterleave_region(img_datap, tp->planes, region);
+		
+		} else if (tp->pass == 1 && tp->dog_img_datap) {
+			// A difference of gaussians blurs each row with both kernels one after another, so the input rows they share are still in the cache
+			for (unsigned row = region.y; row < region.y + region.height; ++row) {
+				struct Region row_region = { region.x, row, region.width, 1 };
+				planar_vertical_pass(tp->planes, img_datap->arrays[1], img_datap->width, img_datap->height, row_region,
+						tp->gaussian_kernel, tp->gaussian_kernel_len, tp->offset, sums);
+				planar_vertical_pass(tp->planes, tp->dog_img_datap->arrays[1], img_datap->width, img_datap->height, row_region,
+						tp->dog_kernel, tp->dog_kernel_len, tp->dog_kernel_len / 2, sums);
+			}
+		
+		} else if (tp->pass == 1) {
+			planar_vertical_pass(tp->planes, img_datap->arrays[1], img_datap->width, img_datap->height, region,
+					tp->gaussian_kernel, tp->gaussian_kernel_len, tp->offset, sums);
+		} else {
+			planar_horizontal_pass(img_datap, img_datap->arrays[1], region, area->mask,
+					tp->gaussian_kernel, tp->gaussian_kernel_len, tp->offset, sums,
+					tp->op, tp->dog_img_datap ? tp->dog_img_datap->arrays[1] : NULL, tp->dog_kernel, tp->dog_kernel_len, dog_sums);
+		}
+	}
+
+	free(sums);
+	free(dog_sums);
+	return NULL;
+}
+
+/**
+ * Box blurs a line of components, treating components outside the line as 0 like blur_pixel does
+ * The sum of the box is kept as a running sum so the cost does not depend on the box width
+ * @param in : the components to blur
+ * @param [output] out : the blurred components (must not be in)
+ * @param len : the number of components in the line
+ * @param box_width : the width of the box in components (odd)
+ */
+void box_blur_line(unsigned char *in, unsigned char *out, unsigned len, unsigned box_width) {
+	unsigned radius = box_width / 2;
+	unsigned sum = 0;
+	for (unsigned i = 0; i < radius && i < len; ++i) { sum += in[i]; }
+	
+	for (unsigned i = 0; i < len; ++i) {
+		if (i + radius < len) { sum += in[i + radius]; }
+		out[i] = (sum + box_width / 2) / box_width;
+		if (i >= radius) { sum -= in[i - radius]; }
+	}
+}
+
+/**
+ * Box blurs columns [first_col, end_col) of a plane vertically, treating components outside the plane as 0
+ * The running sums of all the columns are updated a row at a time so the inner loops read contiguous rows
+ * @param in_plane : the plane to blur (width * height bytes)
+ * @param [output] out : where the first component of the blurred plane is stored (must not overlap the blurred columns of in_plane)
+ * @param out_row_len : distance in bytes between rows of out
+ * @param out_pxl_len : distance in bytes between components of out in the same row
+ * @param width : width of the plane in pixels
+ * @param height : height of the plane in pixels
+ * @param first_col : the first column to blur
+ * @param end_col : the first column (greater than first_col) to NOT blur
+ * @param box_width : the height of the box in pixels (odd)
+ * @param sums : scratch space for the running sums (width unsigned ints)
+ */
+void box_blur_columns(unsigned char *in_plane, unsigned char *out, unsigned out_row_len, unsigned out_pxl_len, unsigned width, unsigned height,
+		unsigned first_col, unsigned end_col, unsigned box_width, unsigned *sums) {
+	unsigned radius = box_width / 2;
+	for (unsigned col = first_col; col < end_col; ++col) { sums[col] = 0; }
+	for (unsigned row = 0; row < radius && row < height; ++row) {
+		unsigned char *in_row = in_plane + (size_t) row * width;
+		for (unsigned col = first_col; col < end_col; ++col) { sums[col] += in_row[col]; }
+	}
+
+	for (unsigned row = 0; row < height; ++row) {
+		if (row + radius < height) {
+			unsigned char *add_row = in_plane + (size_t) (row + radius) * width;
+			for (unsigned col = first_col; col < end_col; ++col) { sums[col] += add_row[col]; }
+		}
+		
+		unsigned char *out_row = out + (size_t) row * out_row_len;
+		for (unsigned col = first_col; col < end_col; ++col) {
+			out_row[col * out_pxl_len] = (sums[col] + box_width / 2) / box_width;
+		}
+
+		if (row >= radius) {
+			unsigned char *sub_row = in_plane + (size_t) (row - radius) * width;
+			for (unsigned col = first_col; col < end_col; ++col) { sums[col] -= sub_row[col]; }
+		}
+	}
+}
+
+/**
+ * Entry point for the cpu threads to perform the approximate blur (NUM_BOXES box blurs in each direction)
+ * pass 0 box blurs this thread's band of rows horizontally from arrays[0] into the colour planes,
+ * pass 1 box blurs this thread's band of columns vertically, going back and forth between the planes and arrays[1] (used as 3 planes),
+ * with the last box blur interleaving the result into arrays[0]
+ * Each box blur of a pass only reads the rows (or columns) the thread itself wrote, so the threads only have to be joined between the passes
+ * @param thread_params : Pointer to Thread_Params struct (in pass 1 start_row and last_row are the band of columns)
+ * @return : returns NULL
+ */
+void *multithreaded_approx_blur(void *thread_params) {
+	// Get all the values from thread_params
+	struct Thread_Params *tp = (struct Thread_Params *) thread_params;
+	struct Img_Data *img_datap = tp->img_datap;
+	unsigned width = img_datap->width;
+	unsigned height = img_datap->height;
+	unsigned pxl_length = img_datap->pixel_length;
+	size_t plane_size = (size_t) width * height;
+	unsigned *box_widths = tp->box_widths;
+
+	if (tp->pass == 0) {
+		// Two lines to go back and forth between while box blurring a row
+		unsigned char *lines = malloc(2 * (size_t) width);
+		if (lines == NULL) { error("could not allocate lines for approximate blur\n"); }
+		unsigned char *line[2] = { lines, lines + width };
+
+		for (unsigned row = tp->start_row; row < tp->last_row && row < height; ++row) {
+			unsigned char *in_row = img_datap->arrays[0] + (size_t) row * img_datap->row_stride;
+			for (unsigned channel = 0; channel < NUM_COLOUR_CHANNELS; ++channel) {
+				for (unsigned col = 0; col < width; ++col) { line[0][col] = in_row[col * pxl_length + channel]; }
+				
+				// The last box blur writes straight into the plane
+				for (unsigned box = 0; box < NUM_BOXES; ++box) {
+					unsigned char *out_line = box == NUM_BOXES - 1 ? tp->planes + channel * plane_size + (size_t) row * width : line[(box + 1) % 2];
+					box_blur_line(line[box % 2], out_line, width, box_widths[box]);
+				}
+			}
+		}
+
+		free(lines);
+	
+	} else {
+		unsigned *sums = malloc(sizeof(unsigned) * width);
+		if (sums == NULL) { error("could not allocate column sums for approximate blur\n"); }
+		unsigned end_col = tp->last_row < width ? tp->last_row : width;
+
+		for (unsigned channel = 0; channel < NUM_COLOUR_CHANNELS && tp->start_row < end_col; ++channel) {
+			unsigned char *plane[2] = { tp->planes + channel * plane_size, img_datap->arrays[1] + channel * plane_size };
+			
+			for (unsigned box = 0; box < NUM_BOXES; ++box) {
+				if (box == NUM_BOXES - 1) {
+					box_blur_columns(plane[box % 2], img_datap->arrays[0] + channel, img_datap->row_stride, pxl_length, width, height,
+							tp->start_row, end_col, box_widths[box], sums);
+				} else {
+					box_blur_columns(plane[box % 2], plane[(box + 1) % 2], width, 1, width, height,
+							tp->start_row, end_col, box_widths[box], sums);
+				}
+			}
+		}
+
+		free(sums);
+	}
+
+	return NULL;
+}
+
+/**
+ * Approximates a gaussian blur of the whole image with NUM_BOXES box blurs in each direction
+ * The running sums make the cost per pixel the same for any standard deviation, at the cost of not being exactly a gaussian blur
+ * @param img_datap : struct storing all the info of the input image, the blurred image is stored in img_datap->arrays[0]
+ * @param std_dev : the standard deviation of the gaussian blur to approximate
+ * @param num_threads : number of threads to use for the blur
+ * @param perf : where the hardware counters of every thread in both passes are stored (NULL means they aren't counted)
+ * @param placement : the cpu each thread is pinned to (NULL means threads aren't pinned)
+ */
+void blur_cpu_approx(struct Img_Data *img_datap, float std_dev, unsigned num_threads, struct Perf_Report *perf, struct Thread_Placement *placement) {
+	unsigned box_widths[NUM_BOXES];
+	calculate_box_widths(box_widths, std_dev);
+
+	// The planes are only needed during this blur, so they are handed back to the arena after it
+	struct Arena_Mark mark = arena_mark(img_datap->arena);
+	unsigned char *planes = arena_alloc(img_datap->arena, (size_t) NUM_COLOUR_CHANNELS * img_datap->width * img_datap->height);
+
 	pthread_t threads[num_threads];
 	struct Thread_Params tps[num_threads];
-	unsigned num_rows_per_thread = ceil( (float) img_datap->height / num_threads);
+	struct Perf_Thread perf_threads[num_threads];
+	if (perf) {
+		perf->num_passes = 2;
+		perf->pass_names[0] = "horizontal boxes";
+		perf->pass_names[1] = "vertical boxes";
+	}
 
-	// Loop over both passes of the blur
+	// Pass 0 is split into bands of rows and pass 1 into bands of columns
 	for (unsigned pass = 0; pass < 2; ++pass) {
+		unsigned len = pass == 0 ? img_datap->height : img_datap->width;
+		unsigned num_per_thread = ceil( (float) len / num_threads);
+
+		for (unsigned thread = 0; thread < num_threads; ++thread) {
+			tps[thread].img_datap = img_datap;
+			tps[thread].start_row = thread * num_per_thread;
+			tps[thread].last_row = (thread + 1) * num_per_thread;
+			tps[thread].pass = pass;
+			tps[thread].planes = planes;
+			tps[thread].box_widths = box_widths;
+			
+			// Each thread blurs every pixel of its band of rows (or columns)
+			struct Perf_Counters *counters = NULL;
+			if (perf) {
+				counters = &perf->counters[pass * num_threads + thread];
+				unsigned band_end = tps[thread].last_row < len ? tps[thread].last_row : len;
+				unsigned band_len = tps[thread].start_row < band_end ? band_end - tps[thread].start_row : 0;
+				counters->pixels = (size_t) band_len * (pass == 0 ? img_datap->width : img_datap->height);
+			}
+			create_blur_thread(&threads[thread], multithreaded_approx_blur, &tps[thread], &perf_threads[thread], counters, placement_cpu(placement, thread));
+		}
+
+		for (unsigned thread = 0; thread < num_threads; ++thread) {
+			pthread_join(threads[thread], NULL);
+		}
+	}
+
+	release_to_arena_mark(img_datap->arena, mark);
+}
+
+/**
+ * Entry point for the cpu threads to perform the downscaling blur, which only computes the blurred pixels the downscaled image samples
+ * For each row of the downscaled image in this thread's band the vertical pass is computed for the one input row it samples (over the whole width,
+ * like pass 0 of the interleaved blur, so the inner loop reads contiguous rows), then the horizontal pass only for the columns it samples
+ * Every pixel is rounded between the passes exactly like blur_pixel does, so the result is the full cpu blur sampled at SAMPLE_POSITION
+ * @param thread_params : Pointer to Thread_Params struct (start_row and last_row are rows of the downscaled image)
+ * @return : returns NULL
+ */
+void *multithreaded_resized_blur(void *thread_params) {
+	// Get all the values from thread_params
+	struct Thread_Params *tp = (struct Thread_Params *) thread_params;
+	struct Img_Data *img_datap = tp->img_datap;
+	unsigned width = img_datap->width;
+	unsigned height = img_datap->height;
+	unsigned pxl_length = img_datap->pixel_length;
+	unsigned row_len = width * pxl_length;
+	float *gaussian_kernel = tp->gaussian_kernel;
+	unsigned gaussian_kernel_len = tp->gaussian_kernel_len;
+	unsigned offset = tp->offset;
+
+	// Scratch space for the sums of the vertical pass and the vertically blurred row (the only intermediate memory, one row per thread)
+	float *sums = malloc(sizeof(float) * row_len);
+	unsigned char *mid_row = malloc(row_len);
+	if (sums == NULL || mid_row == NULL) { error("could not allocate rows for downscaling blur\n"); }
+
+	for (unsigned out_row = tp->start_row; out_row < tp->last_row && out_row < tp->out_height; ++out_row) {
+		unsigned row = SAMPLE_POSITION(out_row, height, tp->out_height);
+		
+		// Vertical pass of the sampled row, adding every row the kernel covers and ignoring rows out of bounds of the image like blur_pixel does
+		for (unsigned i = 0; i < row_len; ++i) { sums[i] = 0; }
+		for (unsigned i = 0; i < gaussian_kernel_len; ++i) {
+			int cur_row = row - offset + i;
+			if (cur_row < 0 || cur_row >= (int) height) { continue; }
+
+			unsigned char *in_row = img_datap->arrays[0] + (size_t) cur_row * img_datap->row_stride;
+			float weight = gaussian_kernel[i];
+			for (unsigned j = 0; j < row_len; ++j) {
+				sums[j] += in_row[j] * weight;
+			}
+		}
+		for (unsigned j = 0; j < row_len; ++j) {
+			mid_row[j] = round_component(sums[j]);
+		}
+
+		// Horizontal pass of the sampled columns, with the alpha component of the sampled input pixel
+		unsigned char *alpha_row = img_datap->arrays[0] + (size_t) row * img_datap->row_stride;
+		unsigned char *out_pxl = tp->out_pixels + (size_t) out_row * tp->out_width * pxl_length;
+		for (unsigned out_col = 0; out_col < tp->out_width; ++out_col, out_pxl += pxl_length) {
+			unsigned col = SAMPLE_POSITION(out_col, width, tp->out_width);
+			float sum[NUM_COLOUR_CHANNELS] = { 0 };
+			
+			for (unsigned i = 0; i < gaussian_kernel_len; ++i) {
+				int cur_col = col - offset + i;
+				if (cur_col < 0 || cur_col >= (int) width) { continue; }
+				
+				for (unsigned channel = 0; channel < NUM_COLOUR_CHANNELS; ++channel) {
+					sum[channel] += mid_row[cur_col * pxl_length + channel] * gaussian_kernel[i];
+				}
+			}
+
+			for (unsigned channel = 0; channel < NUM_COLOUR_CHANNELS; ++channel) {
+				out_pxl[channel] = round_component(sum[channel]);
+			}
+			out_pxl[3] = alpha_row[col * pxl_length + 3];
+		}
+	}
+
+	free(sums);
+	free(mid_row);
+	return NULL;
+}
+
+/**
+ * Blurs the image and downscales it in one go, only computing the blurred pixels the downscaled image samples
+ * The work and the intermediate memory scale with the size of the downscaled image instead of the input image
+ * @param img_datap : struct storing all the info of the input image (in img_datap->arrays[0], which is not changed)
+ * @param gaussian_kernel : the 1D convolution kernel that will apply the blur
+ * @param gaussian_kernel_len : the length of the kernel
+ * @param num_threads : number of threads to use for the blur
+ * @param placement : the cpu each thread is pinned to (NULL means threads aren't pinned)
+ * @param out_width : width of the downscaled image in pixels (at most the width of the input image)
+ * @param out_height : height of the downscaled image in pixels (at most the height of the input image)
+ * @param [output] out_pixels : the downscaled RGBA pixels (out_width * out_height)
+ */
+void blur_cpu_resized(struct Img_Data *img_datap, float *gaussian_kernel, unsigned gaussian_kernel_len, unsigned num_threads,
+		struct Thread_Placement *placement, unsigned out_width, unsigned out_height, unsigned char *out_pixels) {
+	pthread_t threads[num_threads];
+	struct Thread_Params tps[num_threads];
+
+	// Each thread gets a band of rows of the downscaled image, and there is only one pass since the rows don't depend on each other
+	unsigned num_rows_per_thread = ceil( (float) out_height / num_threads);
+	for (unsigned thread = 0; thread < num_threads; ++thread) {
+		tps[thread].img_datap = img_datap;
+		tps[thread].gaussian_kernel = gaussian_kernel;
+		tps[thread].gaussian_kernel_len = gaussian_kernel_len;
+		tps[thread].offset = gaussian_kernel_len / 2;
+		tps[thread].start_row = thread * num_rows_per_thread;
+		tps[thread].last_row = (thread + 1) * num_rows_per_thread;
+		tps[thread].out_width = out_width;
+		tps[thread].out_height = out_height;
+		tps[thread].out_pixels = out_pixels;
+
+		create_pinned_thread(&threads[thread], multithreaded_resized_blur, &tps[thread], placement_cpu(placement, thread));
+	}
+
+	for (unsigned thread = 0; thread < num_threads; ++thread) {
+		pthread_join(threads[thread], NULL);
+	}
+}
+
+/**
+ * Struct storing what a thread first touches
+ * arrays : the arrays to touch
+ * num_arrays : number of arrays in arrays
+ * height : number of rows of each array
+ * row_stride : bytes between the starts of two rows of each array
+ * start_row : the first row the thread touches in every array
+ * last_row : the first row (greater than start_row) the thread does NOT touch
+ */
+struct First_Touch_Params {
+	unsigned char **arrays;
+	unsigned num_arrays;
+	unsigned height;
+	size_t row_stride;
+	unsigned start_row;
+	unsigned last_row;
+};
+
+/**
+ * Entry point for the cpu threads to first touch their band of rows of the arrays
+ * @param touch_params : Pointer to First_Touch_Params struct
+ * @return : returns NULL
+ */
+void *first_touch_band(void *touch_params) {
+	struct First_Touch_Params *ftp = (struct First_Touch_Params *) touch_params;
+	unsigned last_row = ftp->last_row < ftp->height ? ftp->last_row : ftp->height;
+	if (ftp->start_row >= last_row) { return NULL; }
+
+	size_t band_size = (size_t) (last_row - ftp->start_row) * ftp->row_stride;
+	for (unsigned arr = 0; arr < ftp->num_arrays; ++arr) {
+		memset(ftp->arrays[arr] + (size_t) ftp->start_row * ftp->row_stride, 0, band_size);
+	}
+
+	return NULL;
+}
+
+/**
+ * Zeroes arrays of height rows, each band of rows by the pinned thread that blurs it when the whole image is blurred,
+ * so the kernel puts the pages of every band on the NUMA node of its thread (only pages that were never touched are placed)
+ * @param arrays : the arrays to touch
+ * @param num_arrays : number of arrays in arrays
+ * @param height : number of rows of each array
+ * @param row_stride : bytes between the starts of two rows of each array
+ * @param config : how the cpu blur will be performed (the number of threads and their placement)
+ */
+void first_touch_arrays(unsigned char **arrays, unsigned num_arrays, unsigned height, size_t row_stride, struct Cpu_Config *config) {
+	unsigned num_threads = config->num_threads;
+	pthread_t threads[num_threads];
+	struct First_Touch_Params ftps[num_threads];
+	unsigned num_rows_per_thread = ceil( (float) height / num_threads);
+	for (unsigned thread = 0; thread < num_threads; ++thread) {
+		ftps[thread].arrays = arrays;
+		ftps[thread].num_arrays = num_arrays;
+		ftps[thread].height = height;
+		ftps[thread].row_stride = row_stride;
+		ftps[thread].start_row = thread * num_rows_per_thread;
+		ftps[thread].last_row = (thread + 1) * num_rows_per_thread;
+		create_pinned_thread(&threads[thread], first_touch_band, &ftps[thread], placement_cpu(config->placement, thread));
+	}
+
+	for (unsigned thread = 0; thread < num_threads; ++thread) {
+		pthread_join(threads[thread], NULL);
+	}
+}
+
+/**
+ * First touches the memory blur_cpu_with_kernel allocates next from the arena for an image of this size (the colour planes of the planar
+ * and approximate blurs, then the second temp array of a difference of gaussians), and hands it back so the blur gets the same memory
+ * @param arena : the arena the blur will allocate from (nothing else may be allocated from it before the blur for the memory to line up)
+ * @param width : width of the image in pixels
+ * @param height : height of the image in rows
+ * @param row_stride : bytes between the starts of two rows of the image arrays
+ * @param config : how the cpu blur will be performed
+ */
+void first_touch_blur_scratch(struct Img_Arena *arena, unsigned width, unsigned height, unsigned row_stride, struct Cpu_Config *config) {
+	struct Arena_Mark mark = arena_mark(arena);
+
+	// Each colour plane is touched like an array of height rows of width bytes
+	if (config->planar || config->approx) {
+		size_t plane_size = (size_t) width * height;
+		unsigned char *planes = arena_alloc(arena, NUM_COLOUR_CHANNELS * plane_size);
+		unsigned char *plane_arrays[NUM_COLOUR_CHANNELS];
+		for (unsigned channel = 0; channel < NUM_COLOUR_CHANNELS; ++channel) {
+			plane_arrays[channel] = planes + channel * plane_size;
+		}
+		first_touch_arrays(plane_arrays, NUM_COLOUR_CHANNELS, height, width, config);
+	}
+	if (!config->approx && config->op && config->op->type == 'd') {
+		unsigned char *dog_array = arena_alloc(arena, (size_t) row_stride * height);
+		first_touch_arrays(&dog_array, 1, height, row_stride, config);
+	}
+
+	release_to_arena_mark(arena, mark);
+}
+
+/**
+ * First touches the memory the arrays of an image are allocated from next (by load_image_arrays), and then the scratch memory of its blur,
+ * so the kernel puts the pages of every band on the NUMA node of the thread that blurs it (the memory is handed back to the arena, and allocated again in the same place)
+ * @param arena : the arena the image arrays will be allocated from (its memory must not have been touched yet for this to place anything)
+ * @param width : width of the image in pixels
+ * @param height : height of the image in rows
+ * @param row_stride : bytes between the starts of two rows of the arrays
+ * @param num_arrays : how many arrays of row_stride * height bytes will be allocated (2, or 1 for a raw image whose arrays[0] is its mapping)
+ * @param config : how the cpu blur will be performed (the number of threads and their placement)
+ */
+void first_touch_img_arrays(struct Img_Arena *arena, unsigned width, unsigned height, unsigned row_stride, unsigned num_arrays, struct Cpu_Config *config) {
+	// Allocate the arrays the same way create_img_arrays does, so they are where the image arrays will be
+	struct Arena_Mark mark = arena_mark(arena);
+	unsigned char *arrays[2];
+	for (unsigned arr = 0; arr < num_arrays; ++arr) {
+		arrays[arr] = arena_alloc(arena, (size_t) row_stride * height);
+	}
+	first_touch_arrays(arrays, num_arrays, height, row_stride, config);
+	first_touch_blur_scratch(arena, width, height, row_stride, config);
+
+	release_to_arena_mark(arena, mark);
+}
+
+/**
+ * Performs blur on the input image with an already calculated gaussian kernel (prints nothing, so it can be used for every frame of a stream)
+ * @param img_datap : struct storing all the info of the input image, the blurred image is stored in img_datap->arrays[0]
+ * @param gaussian_kernel : the 1D convolution kernel that will apply the blur
+ * @param gaussian_kernel_len : the length of the kernel
+ * @param config : how the blur should be performed (number of threads, image layout, area to blur)
+ */
+void blur_cpu_with_kernel(struct Img_Data *img_datap, float *gaussian_kernel, unsigned gaussian_kernel_len, struct Cpu_Config *config) {
+	unsigned num_threads = config->num_threads;
+	unsigned offset = gaussian_kernel_len / 2;
+
+	// The approximate blur only needs the standard deviation of the kernel
+	if (config->approx) {
+		blur_cpu_approx(img_datap, kernel_std_dev(gaussian_kernel, gaussian_kernel_len), num_threads, config->perf, config->placement);
+		return;
+	}
+
+	// Blur the whole image if no area was given
+	struct Region whole_image = { 0, 0, img_datap->width, img_datap->height };
+	struct Blur_Area whole_area = { &whole_image, 1, NULL };
+	struct Blur_Area *area = config->area ? config->area : &whole_area;
+
+	// The planar blur deinterleaves into its own planes, and uses arrays[1] for the intermediate planes
+	// Everything allocated for this blur comes from the arena and is handed back after it, so blurring the next image or frame allocates nothing new
+	struct Arena_Mark mark = arena_mark(img_datap->arena);
+	unsigned char *planes = NULL;
+	if (config->planar) {
+		planes = arena_alloc(img_datap->arena, (size_t) NUM_COLOUR_CHANNELS * img_datap->width * img_datap->height);
+	}
+	unsigned num_passes = config->planar ? 3 : 2;
+	void *(*thread_func)(void *) = config->planar ? multithreaded_planar_blur : multithreaded_blur;
+
+	// A difference of gaussians blurs the same input with a second kernel, into a copy of img_datap with its own arrays[1]
+	struct Img_Data dog_img_data;
+	struct Img_Data *dog_img_datap = NULL;
+	unsigned char *dog_arrays[2];
+	float *dog_kernel = NULL;
+	unsigned dog_kernel_len = 0;
+	if (config->op && config->op->type == 'd') {
+		dog_kernel_len = config->op->dog_std_dev * RADIUS * 2 + 1;
+		dog_kernel = malloc(sizeof(float) * dog_kernel_len);
+		if (dog_kernel == NULL) { error("could not allocate difference of gaussians kernel\n"); }
+		calculate_kernel(&dog_kernel, dog_kernel_len, config->op->dog_std_dev);
+
+		dog_arrays[0] = img_datap->arrays[0];
+		dog_arrays[1] = arena_alloc(img_datap->arena, (size_t) img_datap->row_stride * img_datap->height);
+		dog_img_data = *img_datap;
+		dog_img_data.arrays = dog_arrays;
+		dog_img_datap = &dog_img_data;
+	}
+
+	// Look up the unrolled kernels once for every thread, instead of for every pixel
+	Folded_Sums_Func folded_sums = get_folded_sums(gaussian_kernel_len, offset);
+	Folded_Sums_Func dog_folded_sums = dog_kernel ? get_folded_sums(dog_kernel_len, dog_kernel_len / 2) : NULL;
+
+	// Declare the desired number of threads (and their params)
+	pthread_t threads[num_threads];
+	struct Thread_Params tps[num_threads];
+	struct Perf_Thread perf_threads[num_threads];
+	if (config->perf) {
+		config->perf->num_passes = num_passes;
+		for (unsigned pass = 0; pass < num_passes; ++pass) {
+			config->perf->pass_names[pass] = config->planar ? PLANAR_PASS_NAMES[pass] : INTERLEAVED_PASS_NAMES[pass];
+		}
+	}
+
+	// Loop over all passes of the blur
+	for (unsigned pass = 0; pass < num_passes; ++pass) {
+		// Find the rows this pass has to compute, so they can be split evenly into a band for each thread
+		unsigned top_row = img_datap->height;
+		unsigned bottom_row = 0;
+		for (unsigned i = 0; i < area->num_regions; ++i) {
+			struct Region region = get_pass_region(img_datap, area->regions[i], pass, num_passes, offset);
+			if (region.y < top_row) { top_row = region.y; }
+			if (region.y + region.height > bottom_row) { bottom_row = region.y + region.height; }
+		}
+		if (top_row > bottom_row) { top_row = bottom_row; }
+		unsigned num_rows_per_thread = ceil( (float) (bottom_row - top_row) / num_threads);
+
 		// Create all the threads for the current pass
 		for (unsigned thread = 0; thread < num_threads; ++thread) {
 			// Set all the values of the correct Thread_Params struct
 			tps[thread].img_datap = img_datap;
 			tps[thread].gaussian_kernel = gaussian_kernel;
 			tps[thread].gaussian_kernel_len = gaussian_kernel_len;
-			tps[thread].offset = RADIUS * std_dev;
-			tps[thread].start_row = thread * num_rows_per_thread;
-	       		tps[thread].last_row = (thread + 1) * num_rows_per_thread;
+			tps[thread].offset = offset;
+			tps[thread].start_row = top_row + thread * num_rows_per_thread;
+	       		tps[thread].last_row = top_row + (thread + 1) * num_rows_per_thread;
 			tps[thread].pass = pass;
+			tps[thread].planes = planes;
+			tps[thread].area = area;
+			tps[thread].num_passes = num_passes;
+			tps[thread].op = config->op;
+			tps[thread].dog_img_datap = dog_img_datap;
+			tps[thread].dog_kernel = dog_kernel;
+			tps[thread].dog_kernel_len = dog_kernel_len;
+			tps[thread].folded_sums = folded_sums;
+			tps[thread].dog_folded_sums = dog_folded_sums;
 
-			// Create the thread
-			pthread_create(&threads[thread], NULL, multithreaded_blur, &tps[thread]);
+			// Create the thread (counting its hardware events if asked to)
+			struct Perf_Counters *counters = NULL;
+			if (config->perf) {
+				counters = &config->perf->counters[pass * num_threads + thread];
+				counters->pixels = thread_pass_pixels(&tps[thread]);
+			}
+			create_blur_thread(&threads[thread], thread_func, &tps[thread], &perf_threads[thread], counters, placement_cpu(config->placement, thread));
 		}
 
 		// Join up all the threads after their current pass
@@ -170,11 +1054,39 @@ void blur_cpu(struct Img_Data *img_datap, unsigned std_dev, unsigned num_threads
 		}
 	}
 
+	// Hand the colour planes (and the second blur of a difference of gaussians) back to the arena
+	release_to_arena_mark(img_datap->arena, mark);
+	free(dog_kernel);
+}
+
+/**
+ * Performs blur on the input image and stores it in new image space
+ * @param img_datap : struct storing all the info of the input image
+ * @param std_dev : desired standard deviation of the gaussian_blur
+ * @param config : how the blur should be performed (number of threads, image layout, area to blur)
+ */
+void blur_cpu(struct Img_Data *img_datap, unsigned std_dev, struct Cpu_Config *config) {
+	// Create the 1D Gaussian convolution kernel and output it
+	unsigned gaussian_kernel_len = std_dev * RADIUS * 2 + 1;
+	float *gaussian_kernel = malloc(sizeof(float) * gaussian_kernel_len);
+	calculate_kernel(&gaussian_kernel, gaussian_kernel_len, std_dev);
+	print_kernel(gaussian_kernel, gaussian_kernel_len);
+
+	// Start timing the duration of the blur
+	printf("Blurring...\n");
+	struct timespec start, finish;
+	float duration;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	blur_cpu_with_kernel(img_datap, gaussian_kernel, gaussian_kernel_len, config);
+
 	// Output the duration of the blur
 	clock_gettime(CLOCK_MONOTONIC, &finish);
 	duration = (finish.tv_sec - start.tv_sec);
        	duration += (finish.tv_nsec - start.tv_nsec) / 1000000000.0;
 	printf("Blur Duration: %f seconds\n\n", duration);
+	if (config->placement) { print_thread_placement(config->placement, config->num_threads); }
+	if (config->perf) { print_perf_report(config->perf); }
 	
 	/*
 	// Output the duration to the output file
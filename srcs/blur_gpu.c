@@ -15,11 +15,15 @@
 // Number of work items in a work group
 #define WORK_ITEMS_PER_GROUP 256
 
+// Number of command queues (each with its own band images) the banded blur goes round, so uploading, blurring and downloading bands overlap
+#define NUM_BAND_QUEUES 3
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <math.h>
 #include <time.h>
 #include <string.h>
+#include <stdbool.h>
 #include <CL/cl.h>
 #include "blur_gpu.h"
 #include "blur_helpers.h"
@@ -97,42 +101,337 @@ void initialize_format_and_desc(cl_image_format *formatp, cl_image_desc *descp,
 
 
 /**
- * Performs blur on the input image and stores it in the new image space
- * @param img_datap : struct storing all the info of the input image
- * @param std_dev : desired standard deviation of the gaussian_blur
+ * Copies the pixels of a region that are set in the mask from img_datap->arrays[1] into img_datap->arrays[0]
+ * @param img_datap : pointer to struct that stores all info about image
+ * @param region : the region of the image to copy
+ * @param mask : width * height bytes, non zero means copy the pixel
  */
-void blur_gpu(struct Img_Data *img_datap, unsigned std_dev) {
-	// Create the 1D Gaussian convolution kernel and output it
-	cl_uint gaussian_kernel_len = std_dev * RADIUS * 2 + 1;
-	cl_uint offset = std_dev * RADIUS;
-	cl_float *gaussian_kernel = malloc(sizeof(float) * gaussian_kernel_len);
-	calculate_kernel(&gaussian_kernel, gaussian_kernel_len, std_dev);
-	print_kernel(gaussian_kernel, gaussian_kernel_len);
+void copy_masked_pixels(struct Img_Data *img_datap, struct Region region, unsigned char *mask) {
+	unsigned pxl_length = img_datap->pixel_length;
+	for (unsigned row = region.y; row < region.y + region.height; ++row) {
+		for (unsigned col = region.x; col < region.x + region.width; ++col) {
+			if (!mask[(size_t) row * img_datap->width + col]) { continue; }
+			size_t pxl = (size_t) row * img_datap->row_stride + col * pxl_length;
+			memcpy(img_datap->arrays[0] + pxl, img_datap->arrays[1] + pxl, pxl_length);
+		}
+	}
+}
 
-	// Start timing the duration of the blur
-	printf("Blurring...\n");
-	struct timespec start, finish;
-	float duration;
-	clock_gettime(CLOCK_MONOTONIC, &start);
+
+/**
+ * Struct storing all the OpenCL objects needed to blur images of one size with one gaussian kernel
+ * context : the OpenCL context on the gpu
+ * command_queue : the command queue to the gpu
+ * program : the program built from CL_FILE
+ * first_pass_kernel : kernel for the first (horizontal) pass of the blur
+ * second_pass_kernel : kernel for the second (vertical) pass of the blur
+ * img1 : first pass input image / second pass output image (a buffer if buffers is true)
+ * img2 : first pass output image / second pass input image (a buffer if buffers is true)
+ * first_pass_any_len_kernel : kernel for the first pass of the blur with a gaussian kernel of any length
+ * second_pass_any_len_kernel : kernel for the second pass of the blur with a gaussian kernel of any length
+ * first_pass_linear_kernel : kernel for the first pass of the blur with merged taps and linear filtering
+ * second_pass_linear_kernel : kernel for the second pass of the blur with merged taps and linear filtering
+ * first_pass_buffer_kernel : kernel for the first pass of the blur on packed RGBA buffers
+ * second_pass_buffer_kernel : kernel for the second pass of the blur on packed RGBA buffers
+ * linear : true if the images are CL_UNORM_INT8 and blurred with the linear kernels (gaussian_kernel_mem then stores the merged taps)
+ * buffers : true if img1 and img2 are packed RGBA buffers blurred with the buffer kernels, false if they are images
+ * gaussian_kernel_mem : memory object storing the gaussian kernel
+ * gaussian_kernel_mem_len : number of floats gaussian_kernel_mem can store
+ * built_kernel_len : the gaussian kernel length the program was built for (first_pass_kernel and second_pass_kernel only work with it)
+ * gaussian_kernel_len : the length of the gaussian kernel currently in gaussian_kernel_mem
+ * offset : the index of the target pixel in the gaussian kernel
+ * width : the width of the images the context blurs in pixels
+ * height : the height of the images the context blurs in pixels
+ * num_bands : number of horizontal bands whole images are split into (1 means no bands)
+ * band_queues : the command queues bands are blurred on (only created if num_bands is more than 1)
+ * band_img1 : first pass input / second pass output band image of each band queue (NULL until the first banded blur)
+ * band_img2 : first pass output / second pass input band image of each band queue
+ * band_img_rows : the number of rows the band images have
+ * first_pass_resized_kernel : kernel for the first pass of the downscaling blur (only the sampled columns)
+ * second_pass_resized_kernel : kernel for the second pass of the downscaling blur (only the sampled rows)
+ * resized_mid_img : first pass output / second pass input image of the downscaling blur (NULL until the first downscaling blur)
+ * resized_img : second pass output image of the downscaling blur (the downscaled image)
+ * resized_width : the width of the downscaled image resized_img stores
+ * resized_height : the height of the downscaled image resized_img stores
+ * op : the operation output instead of the blurred image (type is 0 if there is none)
+ * second_pass_unsharp_kernel : kernel for the second pass of the blur fused with an unsharp mask
+ * first_pass_dog_kernel : kernel for the first pass of a difference of gaussians (with both gaussian kernels)
+ * second_pass_dog_kernel : kernel for the second pass of a difference of gaussians (subtracting the blurs)
+ * img3 : the output image of an unsharp mask, or the first pass output image of the subtracted blur of a difference of gaussians (only created with an operation)
+ * dog_kernel_mem : memory object storing the gaussian kernel of the blur a difference of gaussians subtracts (only created for a difference of gaussians)
+ * dog_kernel_len : the length of the gaussian kernel in dog_kernel_mem
+ * first_pass_batch_kernel : kernel for the first pass of the batched blur (one layer of an image array per image)
+ * second_pass_batch_kernel : kernel for the second pass of the batched blur
+ * max_batch_layers : the most layers an image array can have on the device (0 if the context uses buffers)
+ * batch_img1 : first pass input / second pass output image array of the batched blur (NULL until the first batched blur)
+ * batch_img2 : first pass output / second pass input image array of the batched blur
+ * batch_sizes_mem : memory object storing the width and height of the image in each layer of the batch images
+ * batch_width : the width of the batch images in pixels
+ * batch_height : the height of the batch images in pixels
+ * batch_layers : the number of layers the batch images have
+ */
+struct Gpu_Context {
+	cl_context context;
+	cl_command_queue command_queue;
+	cl_program program;
+	cl_kernel first_pass_kernel;
+	cl_kernel second_pass_kernel;
+	cl_kernel first_pass_any_len_kernel;
+	cl_kernel second_pass_any_len_kernel;
+	cl_kernel first_pass_linear_kernel;
+	cl_kernel second_pass_linear_kernel;
+	cl_kernel first_pass_buffer_kernel;
+	cl_kernel second_pass_buffer_kernel;
+	bool linear;
+	bool buffers;
+	cl_mem img1;
+	cl_mem img2;
+	cl_mem gaussian_kernel_mem;
+	cl_uint gaussian_kernel_mem_len;
+	cl_uint built_kernel_len;
+	cl_uint gaussian_kernel_len;
+	cl_uint offset;
+	cl_uint width;
+	cl_uint height;
+	unsigned num_bands;
+	cl_command_queue band_queues[NUM_BAND_QUEUES];
+	cl_mem band_img1[NUM_BAND_QUEUES];
+	cl_mem band_img2[NUM_BAND_QUEUES];
+	unsigned band_img_rows;
+	cl_kernel first_pass_resized_kernel;
+	cl_kernel second_pass_resized_kernel;
+	cl_mem resized_mid_img;
+	cl_mem resized_img;
+	unsigned resized_width;
+	unsigned resized_height;
+	struct Blur_Op op;
+	cl_kernel second_pass_unsharp_kernel;
+	cl_kernel first_pass_dog_kernel;
+	cl_kernel second_pass_dog_kernel;
+	cl_mem img3;
+	cl_mem dog_kernel_mem;
+	cl_uint dog_kernel_len;
+	cl_kernel first_pass_batch_kernel;
+	cl_kernel second_pass_batch_kernel;
+	unsigned max_batch_layers;
+	cl_mem batch_img1;
+	cl_mem batch_img2;
+	cl_mem batch_sizes_mem;
+	unsigned batch_width;
+	unsigned batch_height;
+	unsigned batch_layers;
+};
+
+
+/**
+ * Sets the image and gaussian kernel arguments of a blur kernel
+ * @param kernel : the OpenCL kernel to set the arguments of
+ * @param in_img : the image the kernel reads
+ * @param out_img : the image the kernel writes
+ * @param gaussian_kernel_mem : memory object storing the gaussian kernel
+ */
+void set_blur_kernel_args(cl_kernel kernel, cl_mem *in_img, cl_mem *out_img, cl_mem *gaussian_kernel_mem) {
+	if (clSetKernelArg(kernel, 0, sizeof(cl_mem), in_img) != CL_SUCCESS) { 
+		error("could not set input image OpenCL kernel argument\n"); 
+	} else if (clSetKernelArg(kernel, 1, sizeof(cl_mem), out_img) != CL_SUCCESS) { 
+		error("could not set output image OpenCL kernel argument\n");
+	} else if (clSetKernelArg(kernel, 2, sizeof(cl_mem), gaussian_kernel_mem) != CL_SUCCESS) { 
+		error("could not set gaussian filter OpenCL kernel argument\n");
+	}
+}
+
+
+/**
+ * Points the kernels a gpu context blurs with at a pair of images (only the kernels for the kind of memory object the context uses)
+ * @param ctx : the gpu context
+ * @param img1 : the first pass input / second pass output image
+ * @param img2 : the first pass output / second pass input image
+ * @param height : the height of the images in pixels (the buffer kernels need it to clamp at the bottom edge)
+ */
+void point_kernels_at(struct Gpu_Context *ctx, cl_mem *img1, cl_mem *img2, cl_uint height) {
+	if (ctx->buffers) {
+		set_blur_kernel_args(ctx->first_pass_buffer_kernel, img1, img2, &ctx->gaussian_kernel_mem);
+		set_blur_kernel_args(ctx->second_pass_buffer_kernel, img2, img1, &ctx->gaussian_kernel_mem);
+		if (clSetKernelArg(ctx->first_pass_buffer_kernel, 6, sizeof(cl_uint), &height) != CL_SUCCESS
+				|| clSetKernelArg(ctx->second_pass_buffer_kernel, 6, sizeof(cl_uint), &height) != CL_SUCCESS) {
+			error("could not set image size OpenCL kernel argument\n");
+		}
+	} else {
+		set_blur_kernel_args(ctx->first_pass_kernel, img1, img2, &ctx->gaussian_kernel_mem);
+		set_blur_kernel_args(ctx->second_pass_kernel, img2, img1, &ctx->gaussian_kernel_mem);
+		set_blur_kernel_args(ctx->first_pass_any_len_kernel, img1, img2, &ctx->gaussian_kernel_mem);
+		set_blur_kernel_args(ctx->second_pass_any_len_kernel, img2, img1, &ctx->gaussian_kernel_mem);
+		set_blur_kernel_args(ctx->first_pass_linear_kernel, img1, img2, &ctx->gaussian_kernel_mem);
+		set_blur_kernel_args(ctx->second_pass_linear_kernel, img2, img1, &ctx->gaussian_kernel_mem);
+	}
+}
+
+
+/**
+ * Changes the gaussian kernel a gpu context blurs with (without building the program again)
+ * @param ctx : the gpu context to change
+ * @param gaussian_kernel : the new 1D convolution kernel
+ * @param gaussian_kernel_len : the length of the new kernel
+ */
+void set_gpu_context_kernel(struct Gpu_Context *ctx, float *gaussian_kernel, unsigned gaussian_kernel_len) {
+	cl_int err;
+	ctx->gaussian_kernel_len = gaussian_kernel_len;
+	ctx->offset = gaussian_kernel_len / 2;
+
+	// The linear kernels read merged taps (an offset and a weight each) instead of the gaussian kernel
+	float *kernel_data = gaussian_kernel;
+	cl_uint kernel_data_len = gaussian_kernel_len;
+	if (ctx->linear) {
+		kernel_data_len = 2 * LINEAR_TAPS_LEN(gaussian_kernel_len);
+		kernel_data = malloc(sizeof(float) * kernel_data_len);
+		if (kernel_data == NULL) { error("could not allocate merged taps\n"); }
+		calculate_linear_taps(gaussian_kernel, gaussian_kernel_len, kernel_data);
+	}
 	
+	// Create a new gaussian kernel buffer memory object if the current one is too small, and point all the kernels at it
+	if (kernel_data_len > ctx->gaussian_kernel_mem_len) {
+		if (ctx->gaussian_kernel_mem) { clReleaseMemObject(ctx->gaussian_kernel_mem); }
+		ctx->gaussian_kernel_mem = clCreateBuffer(ctx->context, CL_MEM_READ_ONLY, kernel_data_len * sizeof(float), NULL, &err);
+		if (err) { error("could not create gaussian kernel global memory object\n"); }
+		ctx->gaussian_kernel_mem_len = kernel_data_len;
+		point_kernels_at(ctx, &ctx->img1, &ctx->img2, ctx->height);
+	}
+
+	// Write the gaussian kernel (or merged taps) into the gaussian kernel memory object
+	err = clEnqueueWriteBuffer(ctx->command_queue, ctx->gaussian_kernel_mem, CL_TRUE, 0, kernel_data_len * sizeof(float), kernel_data, 0, NULL, NULL);
+	if (err != CL_SUCCESS) { error("could not write gaussian kernel for first pass from host to device\n"); }
+	if (ctx->linear) { free(kernel_data); }
+
+	// Set the length arguments of the kernels that work with any length
+	cl_kernel any_len_kernels[] = { ctx->first_pass_any_len_kernel, ctx->second_pass_any_len_kernel, ctx->first_pass_buffer_kernel, ctx->second_pass_buffer_kernel };
+	for (unsigned i = 0; i < 4; ++i) {
+		if (clSetKernelArg(any_len_kernels[i], 3, sizeof(cl_uint), &ctx->gaussian_kernel_len) != CL_SUCCESS
+				|| clSetKernelArg(any_len_kernels[i], 4, sizeof(cl_uint), &ctx->offset) != CL_SUCCESS) {
+			error("could not set gaussian kernel length OpenCL kernel argument\n");
+		}
+	}
+
+	// Set the number of merged taps argument of the linear kernels
+	cl_uint num_linear_taps = LINEAR_TAPS_LEN(gaussian_kernel_len);
+	cl_kernel linear_kernels[] = { ctx->first_pass_linear_kernel, ctx->second_pass_linear_kernel };
+	for (unsigned i = 0; i < 2; ++i) {
+		if (clSetKernelArg(linear_kernels[i], 3, sizeof(cl_uint), &num_linear_taps) != CL_SUCCESS) {
+			error("could not set number of merged taps OpenCL kernel argument\n");
+		}
+	}
+}
+
+
+/**
+ * Finds the OpenCL device to blur on, a gpu if there is one, otherwise the first device of any type (like an OpenCL cpu device)
+ * @param [output] device : the device that was found
+ * @return NULL on success, otherwise a message saying what wasn't found
+ */
+char *find_opencl_device(cl_device_id *device) {
 	// Initialize platform id structure (for simplicity detect exactly 1 platform even if there are more)
-	cl_int err;
 	cl_platform_id platform;
 	cl_uint num_platforms;
-	err = clGetPlatformIDs(1, &platform, &num_platforms);
-	if (err || num_platforms != 1) { error("did not detect exactly 1 OpenCL platform\n"); }
+	if (clGetPlatformIDs(1, &platform, &num_platforms) != CL_SUCCESS || num_platforms != 1) { return "did not detect exactly 1 OpenCL platform\n"; }
 
-	// Initialize device id structure for the gpu (for simplicity detect exactly 1 gpu even if there are more)
-	cl_device_id device;
+	// Initialize device id structure for the gpu (for simplicity use the first gpu even if there are more)
 	cl_uint num_devices;
-	err = clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, 1, &device, &num_devices);
-	if (err || num_devices != 1) { error("did not detect exactly 1 GPU for this OpenCL platform\n"); }
+	if (clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, 1, device, &num_devices) == CL_SUCCESS && num_devices >= 1) { return NULL; }
+	if (clGetDeviceIDs(platform, CL_DEVICE_TYPE_ALL, 1, device, &num_devices) == CL_SUCCESS && num_devices >= 1) { return NULL; }
+	return "did not detect any OpenCL device for this OpenCL platform\n";
+}
+
+/**
+ * Checks if there is an OpenCL device to blur on, the same way create_gpu_context looks for it (but without exiting if there isn't)
+ * @return true if there is an OpenCL device, false otherwise
+ */
+bool gpu_available(void) {
+	cl_device_id device;
+	return find_opencl_device(&device) == NULL;
+}
+
+/**
+ * Decides if a device should blur packed RGBA buffers instead of images
+ * Images are used on gpus (where they go through the texture units), buffers on devices that emulate images (like cpus) or don't support them
+ * @param device : the device to blur on
+ * @param memory : 'i' to use images if the device supports them, 'b' to always use buffers, 'a' to decide from the device type
+ * @return true if the device should use buffers, false if it should use images
+ */
+bool device_uses_buffers(cl_device_id device, char memory) {
+	cl_bool image_support;
+	cl_device_type device_type;
+	if (clGetDeviceInfo(device, CL_DEVICE_IMAGE_SUPPORT, sizeof(image_support), &image_support, NULL) != CL_SUCCESS
+			|| clGetDeviceInfo(device, CL_DEVICE_TYPE, sizeof(device_type), &device_type, NULL) != CL_SUCCESS) {
+		error("could not get OpenCL device info\n");
+	}
+	
+	if (!image_support || memory == 'b') { return true; }
+	return memory == 'a' && !(device_type & CL_DEVICE_TYPE_GPU);
+}
+
+/**
+ * Creates an image (or packed RGBA buffer if the context uses buffers) on the device
+ * @param ctx : the gpu context
+ * @param img_datap : struct storing the info of the image
+ * @param width : the width of the image to create in pixels
+ * @param height : the height of the image to create in pixels
+ * @return the created memory object
+ */
+cl_mem create_device_image(struct Gpu_Context *ctx, struct Img_Data *img_datap, unsigned width, unsigned height) {
+	cl_int err;
+	cl_mem img;
+	if (ctx->buffers) {
+		img = clCreateBuffer(ctx->context, CL_MEM_READ_WRITE, (size_t) width * height * img_datap->pixel_length, NULL, &err);
+	} else {
+		// Linear filtering only works on normalized images, which store the same bytes
+		cl_image_format format;
+		cl_image_desc desc;
+		initialize_format_and_desc(&format, &desc, img_datap);
+		if (ctx->linear) { format.image_channel_data_type = CL_UNORM_INT8; }
+		desc.image_width = width;
+		desc.image_height = height;
+		img = clCreateImage(ctx->context, CL_MEM_READ_WRITE, (const cl_image_format *) &format, (const cl_image_desc *) &desc, NULL, &err);
+	}
+	if (err) { error("could not create image buffer object for the blur\n"); }
+	return img;
+}
+
+
+/**
+ * Sets up the gpu to blur images the size of img_datap with gaussian_kernel (the images stay allocated until the context is released)
+ * @param img_datap : struct storing the info of the (first) image to blur
+ * @param gaussian_kernel : the 1D convolution kernel that will apply the blur
+ * @param gaussian_kernel_len : the length of the kernel
+ * @param config : how the gpu blur should be performed (the area is ignored, it is given to each blur instead)
+ * @return the (malloced) gpu context
+ */
+struct Gpu_Context *create_gpu_context(struct Img_Data *img_datap, float *gaussian_kernel, unsigned gaussian_kernel_len, struct Gpu_Config *config) {
+	struct Gpu_Context *ctx = malloc(sizeof(struct Gpu_Context));
+	if (ctx == NULL) { error("could not allocate OpenCL context struct\n"); }
+	ctx->linear = config->linear;
+	ctx->built_kernel_len = gaussian_kernel_len;
+	ctx->offset = gaussian_kernel_len / 2;
+	ctx->width = img_datap->width;
+	ctx->height = img_datap->height;
+	ctx->num_bands = config->num_bands > 1 ? config->num_bands : 1;
+
+	// Find the device to blur on (a gpu, or any other OpenCL device if there is no gpu)
+	cl_int err;
+	cl_device_id device;
+	char *device_error = find_opencl_device(&device);
+	if (device_error) { error(device_error); }
+
+	// Pick images or buffers for the device (linear filtering and the operations only work on images)
+	ctx->op.type = 0;
+	if (config->op) { ctx->op = *config->op; }
+	ctx->buffers = device_uses_buffers(device, ctx->linear || ctx->op.type ? 'i' : config->memory);
+	if (ctx->buffers && ctx->linear) { error("linear filtering needs images, which this OpenCL device does not support\n"); }
+	if (ctx->buffers && ctx->op.type) { error("unsharp masks and differences of gaussians need images, which this OpenCL device does not support\n"); }
 	
 	// Print the platform name, version, and device name, vendor
 	// if (print_platform_and_device_info(platform, device)) { error("could not get some OpenCL platform info\n"); }
 
 	// Initialize a context
-	cl_context context = clCreateContext(NULL, 1, &device, NULL, NULL, &err);
+	ctx->context = clCreateContext(NULL, 1, &device, NULL, NULL, &err);
 	if (err) { error("could not create OpenCL context\n"); }
 	
 	// Determine size of kernel source file
@@ -149,104 +448,678 @@ void blur_gpu(struct Img_Data *img_datap, unsigned std_dev) {
 	if (fclose(fp)) { error("could not close " CL_FILE "\n"); }
 
 	// Create the program
-	cl_program program = clCreateProgramWithSource(context, 1, (const char **) &buf, NULL, &err);
+	ctx->program = clCreateProgramWithSource(ctx->context, 1, (const char **) &buf, NULL, &err);
 	if (err != CL_SUCCESS) { error("could not create OpenCL program\n"); }
 		
 	// Calculate the number of characters to represent each MACRO to be sent to the kernels
 	unsigned size = snprintf(NULL, 0, "%u", gaussian_kernel_len);
-	size += snprintf(NULL, 0, "%u", offset);
+	size += snprintf(NULL, 0, "%u", ctx->offset);
 	size += snprintf(NULL, 0, "%u", img_datap->height);
 	size += snprintf(NULL, 0, "%u", img_datap->width);
 
 	// Create options string for building program
 	char options[size + strlen(CL_OPTIONS) - (4 * 2) + 1];
-	snprintf(options, sizeof(options), CL_OPTIONS, gaussian_kernel_len, offset, img_datap->width, img_datap->height);
+	snprintf(options, sizeof(options), CL_OPTIONS, gaussian_kernel_len, ctx->offset, img_datap->width, img_datap->height);
 	options[size + strlen(CL_OPTIONS) - (4 * 2)] = '\0';
 	
 	// Build the program
-	err = clBuildProgram(program, 1, &device, (const char *) options, NULL, NULL);
-	if (err) { print_error_build_log(&program, device); }
+	err = clBuildProgram(ctx->program, 1, &device, (const char *) options, NULL, NULL);
+	if (err) { print_error_build_log(&ctx->program, device); }
+	free(buf);
 	
 	// Create the command queue to the gpu
-	cl_command_queue command_queue = clCreateCommandQueue(context, device, CL_QUEUE_PROFILING_ENABLE, &err);
+	ctx->command_queue = clCreateCommandQueue(ctx->context, device, CL_QUEUE_PROFILING_ENABLE, &err);
 	if (err != CL_SUCCESS) { error("could not create OpenCL command queue on the gpu\n"); }
 
+	// Create the command queues of the banded blur (their band images are created by the first banded blur, once the kernel length is known)
+	for (unsigned i = 0; i < NUM_BAND_QUEUES && ctx->num_bands > 1; ++i) {
+		ctx->band_queues[i] = clCreateCommandQueue(ctx->context, device, 0, &err);
+		if (err != CL_SUCCESS) { error("could not create OpenCL command queue on the gpu\n"); }
+		ctx->band_img1[i] = NULL;
+		ctx->band_img2[i] = NULL;
+	}
+	ctx->band_img_rows = 0;
+
 	// Create the kernel for the first pass of the blur
 	const char first_pass_kernel_name[] = "first_pass_blur";
-	cl_kernel first_pass_kernel = clCreateKernel(program, first_pass_kernel_name, &err);
+	ctx->first_pass_kernel = clCreateKernel(ctx->program, first_pass_kernel_name, &err);
+	if (err != CL_SUCCESS) { error("could not create OpenCL kernel for the first pass of the blur\n"); }
+
+	// Create the kernel for the second pass of the blur
+	const char second_pass_name[] = "second_pass_blur";
+	ctx->second_pass_kernel = clCreateKernel(ctx->program, second_pass_name, &err);
+	if (err != CL_SUCCESS) { error("could not create OpenCL kernel for the second pass of the blur\n"); }
+
+	// Create the kernels for both passes of the blur that work with gaussian kernels of any length
+	ctx->first_pass_any_len_kernel = clCreateKernel(ctx->program, "first_pass_blur_any_len", &err);
+	if (err != CL_SUCCESS) { error("could not create OpenCL kernel for the first pass of the blur\n"); }
+	ctx->second_pass_any_len_kernel = clCreateKernel(ctx->program, "second_pass_blur_any_len", &err);
+	if (err != CL_SUCCESS) { error("could not create OpenCL kernel for the second pass of the blur\n"); }
+
+	// Create the kernels for both passes of the blur on buffers
+	ctx->first_pass_buffer_kernel = clCreateKernel(ctx->program, "first_pass_blur_buffer", &err);
 	if (err != CL_SUCCESS) { error("could not create OpenCL kernel for the first pass of the blur\n"); }
+	ctx->second_pass_buffer_kernel = clCreateKernel(ctx->program, "second_pass_blur_buffer", &err);
+	if (err != CL_SUCCESS) { error("could not create OpenCL kernel for the second pass of the blur\n"); }
+
+	// Create the kernels for both passes of the blur with merged taps
+	ctx->first_pass_linear_kernel = clCreateKernel(ctx->program, "first_pass_blur_linear", &err);
+	if (err != CL_SUCCESS) { error("could not create OpenCL kernel for the first pass of the blur\n"); }
+	ctx->second_pass_linear_kernel = clCreateKernel(ctx->program, "second_pass_blur_linear", &err);
+	if (err != CL_SUCCESS) { error("could not create OpenCL kernel for the second pass of the blur\n"); }
+
+	// Create the kernels for both passes of the downscaling blur (their images are created by the first downscaling blur, once the size is known)
+	ctx->first_pass_resized_kernel = clCreateKernel(ctx->program, "first_pass_blur_resized", &err);
+	if (err != CL_SUCCESS) { error("could not create OpenCL kernel for the first pass of the blur\n"); }
+	ctx->second_pass_resized_kernel = clCreateKernel(ctx->program, "second_pass_blur_resized", &err);
+	if (err != CL_SUCCESS) { error("could not create OpenCL kernel for the second pass of the blur\n"); }
+	ctx->resized_mid_img = NULL;
+	ctx->resized_img = NULL;
+	ctx->resized_width = 0;
+	ctx->resized_height = 0;
+
+	// Create the kernels of the operations fused into the blur
+	ctx->second_pass_unsharp_kernel = clCreateKernel(ctx->program, "second_pass_blur_unsharp", &err);
+	if (err != CL_SUCCESS) { error("could not create OpenCL kernel for the second pass of the blur\n"); }
+	ctx->first_pass_dog_kernel = clCreateKernel(ctx->program, "first_pass_blur_dog", &err);
+	if (err != CL_SUCCESS) { error("could not create OpenCL kernel for the first pass of the blur\n"); }
+	ctx->second_pass_dog_kernel = clCreateKernel(ctx->program, "second_pass_blur_dog", &err);
+	if (err != CL_SUCCESS) { error("could not create OpenCL kernel for the second pass of the blur\n"); }
+
+	// Create the kernels for both passes of the batched blur (their image arrays are created by the first batch, once its size is known)
+	ctx->first_pass_batch_kernel = clCreateKernel(ctx->program, "first_pass_blur_batch", &err);
+	if (err != CL_SUCCESS) { error("could not create OpenCL kernel for the first pass of the blur\n"); }
+	ctx->second_pass_batch_kernel = clCreateKernel(ctx->program, "second_pass_blur_batch", &err);
+	if (err != CL_SUCCESS) { error("could not create OpenCL kernel for the second pass of the blur\n"); }
+	ctx->batch_img1 = NULL;
+	ctx->batch_img2 = NULL;
+	ctx->batch_sizes_mem = NULL;
+	ctx->batch_width = 0;
+	ctx->batch_height = 0;
+	ctx->batch_layers = 0;
+
+	// Image arrays are only used with images, and can have a limited number of layers
+	size_t max_array_size = 0;
+	if (!ctx->buffers && clGetDeviceInfo(device, CL_DEVICE_IMAGE_MAX_ARRAY_SIZE, sizeof(max_array_size), &max_array_size, NULL) != CL_SUCCESS) {
+		error("could not get OpenCL device info\n");
+	}
+	ctx->max_batch_layers = max_array_size;
+
+	// Create first pass input image / second pass output image, and first pass output image / second pass input image
+	ctx->img1 = create_device_image(ctx, img_datap, img_datap->width, img_datap->height);
+	ctx->img2 = create_device_image(ctx, img_datap, img_datap->width, img_datap->height);
+
+	// An operation needs a third image, and a difference of gaussians the kernel of the blur it subtracts
+	ctx->img3 = ctx->op.type ? create_device_image(ctx, img_datap, img_datap->width, img_datap->height) : NULL;
+	ctx->dog_kernel_mem = NULL;
+	if (ctx->op.type == 'd') {
+		ctx->dog_kernel_len = ctx->op.dog_std_dev * RADIUS * 2 + 1;
+		float *dog_kernel = malloc(sizeof(float) * ctx->dog_kernel_len);
+		if (dog_kernel == NULL) { error("could not allocate difference of gaussians kernel\n"); }
+		calculate_kernel(&dog_kernel, ctx->dog_kernel_len, ctx->op.dog_std_dev);
+		
+		ctx->dog_kernel_mem = clCreateBuffer(ctx->context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, ctx->dog_kernel_len * sizeof(float), dog_kernel, &err);
+		if (err) { error("could not create gaussian kernel global memory object\n"); }
+		free(dog_kernel);
+	}
+
+	// Set the width argument of the buffer kernels (the height is set with the images they are pointed at)
+	if (clSetKernelArg(ctx->first_pass_buffer_kernel, 5, sizeof(cl_uint), &img_datap->width) != CL_SUCCESS
+			|| clSetKernelArg(ctx->second_pass_buffer_kernel, 5, sizeof(cl_uint), &img_datap->width) != CL_SUCCESS) {
+		error("could not set image size OpenCL kernel argument\n");
+	}
+
+	// Create the gaussian kernel buffer memory object, write the gaussian kernel into it and set all the kernel arguments
+	ctx->gaussian_kernel_mem = NULL;
+	ctx->gaussian_kernel_mem_len = 0;
+	set_gpu_context_kernel(ctx, gaussian_kernel, gaussian_kernel_len);
+
+	return ctx;
+}
+
+
+/**
+ * Copies a region of an image between host memory and img1 of a gpu context (an image or a buffer)
+ * @param ctx : the gpu context
+ * @param img_datap : struct storing all the info of the image
+ * @param host_arr : the host array (height rows of img_datap->row_stride bytes) to copy from or into
+ * @param blurred : the region to copy
+ * @param write : true to copy from host_arr into img1, false to copy from img1 into host_arr
+ */
+void transfer_region(struct Gpu_Context *ctx, struct Img_Data *img_datap, unsigned char *host_arr, struct Region blurred, bool write) {
+	cl_int err;
+	size_t row_pitch = img_datap->row_stride;
+
+	if (ctx->buffers) {
+		// Buffer rects are given in bytes, the buffer rows are packed while the host rows can be padded
+		size_t buffer_row_pitch = img_datap->width * img_datap->pixel_length;
+		size_t origin[] = {blurred.x * img_datap->pixel_length, blurred.y, 0};
+		size_t region[] = {blurred.width * img_datap->pixel_length, blurred.height, 1};
+		if (write) {
+			err = clEnqueueWriteBufferRect(ctx->command_queue, ctx->img1, CL_TRUE, origin, origin, region, buffer_row_pitch, 0, row_pitch, 0, host_arr, 0, NULL, NULL);
+		} else {
+			err = clEnqueueReadBufferRect(ctx->command_queue, ctx->img1, CL_TRUE, origin, origin, region, buffer_row_pitch, 0, row_pitch, 0, host_arr, 0, NULL, NULL);
+		}
+	} else {
+		size_t origin[] = {blurred.x, blurred.y, 0};
+		size_t region[] = {blurred.width, blurred.height, 1};
+		unsigned char *host_ptr = host_arr + (size_t) blurred.y * row_pitch + blurred.x * img_datap->pixel_length;
+		if (write) {
+			err = clEnqueueWriteImage(ctx->command_queue, ctx->img1, CL_TRUE, origin, region, row_pitch, 0, host_ptr, 0, NULL, NULL);
+		} else {
+			err = clEnqueueReadImage(ctx->command_queue, ctx->img1, CL_TRUE, origin, region, row_pitch, 0, host_ptr, 0, NULL, NULL);
+		}
+	}
+
+	if (err != CL_SUCCESS) { error(write ? "could not write input image for first pass from host to device\n" : "could not read blurred image from device to host\n"); }
+}
+
+/**
+ * Enqueues a pass of the blur over a region
+ * Image kernels blur one pixel per work item, buffer kernels blur 4 neighbouring pixels of a row per work item (and get the columns as arguments)
+ * @param ctx : the gpu context
+ * @param queue : the command queue to enqueue the pass on
+ * @param kernel : the kernel of the pass
+ * @param blurred : the region to blur
+ */
+void enqueue_pass(struct Gpu_Context *ctx, cl_command_queue queue, cl_kernel kernel, struct Region blurred) {
+	if (ctx->buffers) {
+		cl_uint end_col = blurred.x + blurred.width;
+		if (clSetKernelArg(kernel, 7, sizeof(cl_uint), &blurred.x) != CL_SUCCESS || clSetKernelArg(kernel, 8, sizeof(cl_uint), &end_col) != CL_SUCCESS) {
+			error("could not set region OpenCL kernel argument\n");
+		}
+		size_t global_work_offset[] = {0, blurred.y};
+		size_t global_work_size[] = {(blurred.width + 3) / 4, blurred.height};
+		clEnqueueNDRangeKernel(queue, kernel, 2, global_work_offset, global_work_size, NULL, 0, NULL, NULL);
+	} else {
+		size_t global_work_offset[] = {blurred.x, blurred.y};
+		size_t global_work_size[] = {blurred.width, blurred.height};
+		clEnqueueNDRangeKernel(queue, kernel, 2, global_work_offset, global_work_size, NULL, 0, NULL, NULL);
+	}
+}
 
-	// Initialize image format and descriptor structs
-	cl_image_format format;
-	cl_image_desc desc;
-	initialize_format_and_desc(&format, &desc, img_datap);
+/**
+ * Enqueues a non-blocking copy of whole rows between host memory and a band image
+ * @param ctx : the gpu context
+ * @param queue : the command queue to enqueue the copy on
+ * @param band_img : the band image (or buffer) to copy into or out of
+ * @param host_rows : the first host row to copy from or into
+ * @param host_row_pitch : bytes between the starts of two host rows
+ * @param band_row : the first row of the band image to copy into or out of
+ * @param num_rows : the number of rows to copy
+ * @param write : true to copy from host_rows into band_img, false to copy from band_img into host_rows
+ * @param num_wait_events : number of events in wait_events
+ * @param wait_events : events the copy has to wait for (NULL if there are none)
+ * @param [output] event : event that completes when the copy does (NULL if not needed)
+ */
+void enqueue_band_transfer(struct Gpu_Context *ctx, cl_command_queue queue, cl_mem band_img, unsigned char *host_rows, size_t host_row_pitch,
+		unsigned band_row, unsigned num_rows, bool write, cl_uint num_wait_events, const cl_event *wait_events, cl_event *event) {
+	cl_int err;
+	size_t row_pitch = ctx->width * 4;
 	
-	// Create first pass input image / second pass output image
-	cl_mem img1 = clCreateImage(context, CL_MEM_READ_WRITE, (const cl_image_format *) &format, (const cl_image_desc *) &desc, NULL, &err);
-	if (err) { error("could not create input image buffer object for first pass of the blur\n"); }
+	if (ctx->buffers) {
+		// Whole rows of a buffer are one contiguous range, but the host rows can be padded so they are copied as a rect
+		size_t buffer_origin[] = {0, band_row, 0};
+		size_t host_origin[] = {0, 0, 0};
+		size_t region[] = {row_pitch, num_rows, 1};
+		if (write) {
+			err = clEnqueueWriteBufferRect(queue, band_img, CL_FALSE, buffer_origin, host_origin, region, row_pitch, 0, host_row_pitch, 0, host_rows,
+					num_wait_events, wait_events, event);
+		} else {
+			err = clEnqueueReadBufferRect(queue, band_img, CL_FALSE, buffer_origin, host_origin, region, row_pitch, 0, host_row_pitch, 0, host_rows,
+					num_wait_events, wait_events, event);
+		}
+	} else {
+		size_t origin[] = {0, band_row, 0};
+		size_t region[] = {ctx->width, num_rows, 1};
+		if (write) {
+			err = clEnqueueWriteImage(queue, band_img, CL_FALSE, origin, region, host_row_pitch, 0, host_rows, num_wait_events, wait_events, event);
+		} else {
+			err = clEnqueueReadImage(queue, band_img, CL_FALSE, origin, region, host_row_pitch, 0, host_rows, num_wait_events, wait_events, event);
+		}
+	}
+
+	if (err != CL_SUCCESS) { error(write ? "could not write band from host to device\n" : "could not read blurred band from device to host\n"); }
+}
+
+/**
+ * Gets where a band of an image and its halo are, and which row of the band images the halo is uploaded to
+ * A halo that reaches the bottom of the image is uploaded to the bottom of the band images, so the bottom edge is clamped in the right place
+ * @param ctx : the gpu context
+ * @param img_datap : struct storing all the info of the image
+ * @param band : the index of the band
+ * @param band_rows : the number of rows in every band (but the last one)
+ * @param [output] band_region : the rows of the band
+ * @param [output] halo : the rows of the band and the halo above and below it
+ * @return the row of the band images the first row of the halo goes in
+ */
+unsigned get_band(struct Gpu_Context *ctx, struct Img_Data *img_datap, unsigned band, unsigned band_rows, struct Region *band_region, struct Region *halo) {
+	band_region->x = 0;
+	band_region->y = band * band_rows;
+	band_region->width = img_datap->width;
+	band_region->height = band_region->y + band_rows < img_datap->height ? band_rows : img_datap->height - band_region->y;
+	*halo = expand_region(*band_region, 0, ctx->offset, img_datap->width, img_datap->height);
+	return halo->y + halo->height == img_datap->height ? ctx->band_img_rows - halo->height : 0;
+}
+
+/**
+ * Blurs a whole image on the gpu in horizontal bands, so uploading band k + 1, blurring band k and downloading band k - 1 happen at the same time
+ * Band k goes on band queue k % NUM_BAND_QUEUES with that queue's band images, so each queue finishes a band before it starts on the next one it gets
+ * Each band is uploaded with a halo of offset rows above and below it, so the band images are blurred on their own (clamping only at the image edges)
+ * @param ctx : the gpu context to blur with (must have been created with more than 1 band)
+ * @param img_datap : struct storing all the info of the image, the blurred image is stored in img_datap->arrays[0]
+ * @param first_pass_kernel : the kernel of the first pass
+ * @param second_pass_kernel : the kernel of the second pass
+ */
+void blur_gpu_banded(struct Gpu_Context *ctx, struct Img_Data *img_datap, cl_kernel first_pass_kernel, cl_kernel second_pass_kernel) {
+	unsigned offset = ctx->offset;
+	size_t row_pitch = img_datap->row_stride;
+
+	// Bands are at least offset rows high, so a band's halo only reaches into the bands right next to it
+	unsigned band_rows = (img_datap->height + ctx->num_bands - 1) / ctx->num_bands;
+	if (band_rows < offset) { band_rows = offset; }
+	unsigned num_bands = (img_datap->height + band_rows - 1) / band_rows;
+
+	// Create the band images of every queue if there are none yet, or they are too small for the halo of the current gaussian kernel
+	unsigned img_rows = band_rows + 2 * offset < img_datap->height ? band_rows + 2 * offset : img_datap->height;
+	if (img_rows > ctx->band_img_rows) {
+		for (unsigned i = 0; i < NUM_BAND_QUEUES; ++i) {
+			if (ctx->band_img1[i]) { clReleaseMemObject(ctx->band_img1[i]); }
+			if (ctx->band_img2[i]) { clReleaseMemObject(ctx->band_img2[i]); }
+			ctx->band_img1[i] = create_device_image(ctx, img_datap, img_datap->width, img_rows);
+			ctx->band_img2[i] = create_device_image(ctx, img_datap, img_datap->width, img_rows);
+		}
+		ctx->band_img_rows = img_rows;
+	}
+
+	cl_event *upload_events = malloc(sizeof(cl_event) * num_bands);
+	if (upload_events == NULL) { error("could not allocate band events\n"); }
+
+	for (unsigned band = 0; band <= num_bands; ++band) {
+		struct Region band_region, halo;
+
+		// Upload and blur this band
+		if (band < num_bands) {
+			unsigned queue = band % NUM_BAND_QUEUES;
+			unsigned halo_row = get_band(ctx, img_datap, band, band_rows, &band_region, &halo);
+
+			enqueue_band_transfer(ctx, ctx->band_queues[queue], ctx->band_img1[queue], img_datap->arrays[0] + halo.y * row_pitch, row_pitch,
+					halo_row, halo.height, true, 0, NULL, &upload_events[band]);
+
+			// The kernels read their arguments when they are enqueued, so they can be pointed at the next band's images straight after
+			point_kernels_at(ctx, &ctx->band_img1[queue], &ctx->band_img2[queue], ctx->band_img_rows);
+			struct Region first_pass_region = { 0, halo_row, img_datap->width, halo.height };
+			struct Region second_pass_region = { 0, halo_row + band_region.y - halo.y, img_datap->width, band_region.height };
+			enqueue_pass(ctx, ctx->band_queues[queue], first_pass_kernel, first_pass_region);
+			enqueue_pass(ctx, ctx->band_queues[queue], second_pass_kernel, second_pass_region);
+			clFlush(ctx->band_queues[queue]);
+		}
+
+		// Download the band before it, once the uploads of the bands on both sides of it (whose halos read its first and last rows) have read the input
+		// (its own upload is ordered before the download by its in-order queue, the uploads of its neighbours are on other queues)
+		if (band > 0) {
+			unsigned queue = (band - 1) % NUM_BAND_QUEUES;
+			unsigned halo_row = get_band(ctx, img_datap, band - 1, band_rows, &band_region, &halo);
+
+			cl_event wait_events[2];
+			cl_uint num_wait_events = 0;
+			if (band > 1) { wait_events[num_wait_events++] = upload_events[band - 2]; }
+			if (band < num_bands) { wait_events[num_wait_events++] = upload_events[band]; }
+			enqueue_band_transfer(ctx, ctx->band_queues[queue], ctx->band_img1[queue], img_datap->arrays[0] + band_region.y * row_pitch, row_pitch,
+					halo_row + band_region.y - halo.y, band_region.height, false, num_wait_events, num_wait_events ? wait_events : NULL, NULL);
+			clFlush(ctx->band_queues[queue]);
+		}
+	}
+
+	// Wait for every band to be downloaded
+	for (unsigned i = 0; i < NUM_BAND_QUEUES; ++i) {
+		clFinish(ctx->band_queues[i]);
+	}
+	for (unsigned band = 0; band < num_bands; ++band) {
+		clReleaseEvent(upload_events[band]);
+	}
+	free(upload_events);
+
+	// Point the kernels back at the whole images for blurs of areas
+	point_kernels_at(ctx, &ctx->img1, &ctx->img2, ctx->height);
+}
+
+/**
+ * Sets the arguments of a kernel of an operation fused into the blur
+ * The first 6 arguments are 3 images, the gaussian kernel, its length and offset, then the unsharp mask amount or the kernel of the subtracted blur
+ * @param ctx : the gpu context
+ * @param kernel : the OpenCL kernel to set the arguments of
+ * @param img_a : the first image argument
+ * @param img_b : the second image argument
+ * @param img_c : the third image argument
+ */
+void set_op_kernel_args(struct Gpu_Context *ctx, cl_kernel kernel, cl_mem *img_a, cl_mem *img_b, cl_mem *img_c) {
+	cl_int err = clSetKernelArg(kernel, 0, sizeof(cl_mem), img_a);
+	err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), img_b);
+	err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), img_c);
+	err |= clSetKernelArg(kernel, 3, sizeof(cl_mem), &ctx->gaussian_kernel_mem);
+	err |= clSetKernelArg(kernel, 4, sizeof(cl_uint), &ctx->gaussian_kernel_len);
+	err |= clSetKernelArg(kernel, 5, sizeof(cl_uint), &ctx->offset);
+	if (ctx->op.type == 'u') {
+		err |= clSetKernelArg(kernel, 6, sizeof(cl_float), &ctx->op.amount);
+	} else {
+		cl_uint dog_offset = ctx->dog_kernel_len / 2;
+		err |= clSetKernelArg(kernel, 6, sizeof(cl_mem), &ctx->dog_kernel_mem);
+		err |= clSetKernelArg(kernel, 7, sizeof(cl_uint), &ctx->dog_kernel_len);
+		err |= clSetKernelArg(kernel, 8, sizeof(cl_uint), &dog_offset);
+	}
+	if (err != CL_SUCCESS) { error("could not set operation OpenCL kernel arguments\n"); }
+}
 
-	// Create first pass output image / second pass input image
-	cl_mem img2 = clCreateImage(context, CL_MEM_READ_WRITE, (const cl_image_format *) &format, (const cl_image_desc *) &desc, NULL, &err);
-	if (err) { error("could not create output image buffer object for first pass of the blur\n"); }
+/**
+ * Blurs a whole image on the gpu and outputs an operation built on the blur instead of the blurred image, fused into the last pass
+ * An unsharp mask blurs img1 into img2 like the blur, then its second pass reads img2 and the original in img1 and writes img3
+ * A difference of gaussians blurs img1 with both kernels into img2 and img3 in one first pass, then its second pass subtracts them into img1
+ * @param ctx : the gpu context to blur with (must have been created with an operation)
+ * @param img_datap : struct storing all the info of the image, the output of the operation is stored in img_datap->arrays[0]
+ * @param first_pass_kernel : the kernel of the first pass of the blur (only used by an unsharp mask)
+ */
+void blur_gpu_op(struct Gpu_Context *ctx, struct Img_Data *img_datap, cl_kernel first_pass_kernel) {
+	struct Region whole_image = { 0, 0, img_datap->width, img_datap->height };
+	transfer_region(ctx, img_datap, img_datap->arrays[0], whole_image, true);
 
-	// Create the gaussian kernel buffer memory object
-	cl_mem gaussian_kernel_mem = clCreateBuffer(context, CL_MEM_READ_ONLY, gaussian_kernel_len * sizeof(float), NULL, &err);
-	if (err) { error("could not create gaussian kernel global memory object\n"); }
+	if (ctx->op.type == 'u') {
+		enqueue_pass(ctx, ctx->command_queue, first_pass_kernel, whole_image);
+		set_op_kernel_args(ctx, ctx->second_pass_unsharp_kernel, &ctx->img2, &ctx->img1, &ctx->img3);
+		enqueue_pass(ctx, ctx->command_queue, ctx->second_pass_unsharp_kernel, whole_image);
+
+		size_t origin[] = {0, 0, 0};
+		size_t region[] = {img_datap->width, img_datap->height, 1};
+		cl_int err = clEnqueueReadImage(ctx->command_queue, ctx->img3, CL_TRUE, origin, region, img_datap->row_stride, 0,
+				img_datap->arrays[0], 0, NULL, NULL);
+		if (err != CL_SUCCESS) { error("could not read blurred image from device to host\n"); }
 	
-	// Set the origin, region and pitch used by all the read/write operations
-	size_t origin[] = {0, 0, 0};
-	size_t region[] = {img_datap->width, img_datap->height, 1};
+	} else {
+		set_op_kernel_args(ctx, ctx->first_pass_dog_kernel, &ctx->img1, &ctx->img2, &ctx->img3);
+		set_op_kernel_args(ctx, ctx->second_pass_dog_kernel, &ctx->img2, &ctx->img3, &ctx->img1);
+		enqueue_pass(ctx, ctx->command_queue, ctx->first_pass_dog_kernel, whole_image);
+		enqueue_pass(ctx, ctx->command_queue, ctx->second_pass_dog_kernel, whole_image);
+		transfer_region(ctx, img_datap, img_datap->arrays[0], whole_image, false);
+	}
+}
+
+/**
+ * Blurs an image on the gpu with an existing context (the image must be the size the context was created for)
+ * @param ctx : the gpu context to blur with
+ * @param img_datap : struct storing all the info of the image, the blurred image is stored in img_datap->arrays[0]
+ * @param area : the parts of the image to blur (NULL means blur the whole image)
+ */
+void blur_gpu_with_context(struct Gpu_Context *ctx, struct Img_Data *img_datap, struct Blur_Area *area) {
+	cl_uint offset = ctx->offset;
 
-	// Write the input image into img1
-	err = clEnqueueWriteImage(command_queue, img1, CL_TRUE, origin, region, 0, 0, img_datap->arrays[0], 0, NULL, NULL);
-	if (err != CL_SUCCESS) { error("could not write input image for first pass from host to device\n"); }
+	// Use the kernels built for the gaussian kernel length if they can be used, since they are faster
+	bool built_len = ctx->gaussian_kernel_len == ctx->built_kernel_len;
+	cl_kernel first_pass_kernel = built_len ? ctx->first_pass_kernel : ctx->first_pass_any_len_kernel;
+	cl_kernel second_pass_kernel = built_len ? ctx->second_pass_kernel : ctx->second_pass_any_len_kernel;
+	if (ctx->linear) {
+		first_pass_kernel = ctx->first_pass_linear_kernel;
+		second_pass_kernel = ctx->second_pass_linear_kernel;
+	} else if (ctx->buffers) {
+		first_pass_kernel = ctx->first_pass_buffer_kernel;
+		second_pass_kernel = ctx->second_pass_buffer_kernel;
+	}
 	
-	// Write the gaussian kernel into the gaussian kernel memory object
-	err = clEnqueueWriteBuffer(command_queue, gaussian_kernel_mem, CL_TRUE, 0, gaussian_kernel_len * sizeof(float), gaussian_kernel, 0, NULL, NULL);
-	if (err != CL_SUCCESS) { error("could not write gaussian kernel for first pass from host to device\n"); }
+	// Operations always blur the whole image, without bands
+	if (ctx->op.type) {
+		blur_gpu_op(ctx, img_datap, first_pass_kernel);
+		return;
+	}
 
-	// Set the kernel arguments for the first pass
-	if (clSetKernelArg(first_pass_kernel, 0, sizeof(cl_mem), &img1) != CL_SUCCESS) { 
-		error("could not set input image OpenCL kernel argument\n"); 
-	} else if (clSetKernelArg(first_pass_kernel, 1, sizeof(cl_mem), &img2) != CL_SUCCESS) { 
-		error("could not set output image OpenCL kernel argument\n");
-	} else if (clSetKernelArg(first_pass_kernel, 2, sizeof(cl_mem), &gaussian_kernel_mem) != CL_SUCCESS) { 
-		error("could not set gaussian filter OpenCL kernel argument\n");
+	// Whole images are blurred in bands if the context was created for it
+	if (area == NULL && ctx->num_bands > 1) {
+		blur_gpu_banded(ctx, img_datap, first_pass_kernel, second_pass_kernel);
+		return;
 	}
 
-	// Enqueue the kernel the first pass kernel
-	size_t global_work_size[] = {img_datap->width, img_datap->height};
-	clEnqueueNDRangeKernel(command_queue, first_pass_kernel, 2, NULL, global_work_size, NULL, 0, NULL, NULL); 
+	// Blur the whole image if no area was given
+	struct Region whole_image = { 0, 0, img_datap->width, img_datap->height };
+	struct Blur_Area whole_area = { &whole_image, 1, NULL };
+	if (area == NULL) { area = &whole_area; }
 
-	// Create the kernel for the second pass of the blur
-	const char second_pass_name[] = "second_pass_blur";
-	cl_kernel second_pass_kernel = clCreateKernel(program, second_pass_name, &err);
-	if (err != CL_SUCCESS) { error("could not create OpenCL kernel for the second pass of the blur\n"); }
+	// Write the part of the input image each region reads (the region and a halo of offset pixels on every side) into img1
+	for (unsigned i = 0; i < area->num_regions; ++i) {
+		struct Region halo = expand_region(area->regions[i], offset, offset, img_datap->width, img_datap->height);
+		transfer_region(ctx, img_datap, img_datap->arrays[0], halo, true);
+	}
 
-	// Set the kernel arguments for the second pass
-	if (clSetKernelArg(second_pass_kernel, 0, sizeof(cl_mem), &img2) != CL_SUCCESS) { 
-		error("could not set input image OpenCL kernel argument\n"); 
-	} else if (clSetKernelArg(second_pass_kernel, 1, sizeof(cl_mem), &img1) != CL_SUCCESS) { 
-		error("could not set output image OpenCL kernel argument\n");
-	} else if (clSetKernelArg(second_pass_kernel, 2, sizeof(cl_mem), &gaussian_kernel_mem) != CL_SUCCESS) { 
-		error("could not set gaussian filter OpenCL kernel argument\n");
+	// Enqueue the first pass kernel over each region and the rows above and below it that the second pass reads
+	for (unsigned i = 0; i < area->num_regions; ++i) {
+		enqueue_pass(ctx, ctx->command_queue, first_pass_kernel, expand_region(area->regions[i], 0, offset, img_datap->width, img_datap->height));
+	}
+
+	// Enqueue the second pass kernel over each region
+	for (unsigned i = 0; i < area->num_regions; ++i) {
+		enqueue_pass(ctx, ctx->command_queue, second_pass_kernel, area->regions[i]);
 	}
 	
-	// Enqueue the second pass kernel
-	clEnqueueNDRangeKernel(command_queue, second_pass_kernel, 2, NULL, global_work_size, NULL, 0, NULL, NULL);
-	
-	// Read the processed image back to host memory
-	clEnqueueReadImage(command_queue, img1, CL_TRUE, origin, region, 0, 0, img_datap->arrays[0], 0, NULL, NULL);
+	// Read each blurred region back to host memory (pixels outside the regions are still the input image)
+	// With a mask the regions are read into arrays[1] first, and only the masked pixels are copied into arrays[0]
+	unsigned char *read_arr = area->mask ? img_datap->arrays[1] : img_datap->arrays[0];
+	for (unsigned i = 0; i < area->num_regions; ++i) {
+		transfer_region(ctx, img_datap, read_arr, area->regions[i], false);
+		if (area->mask) { copy_masked_pixels(img_datap, area->regions[i], area->mask); }
+	}
+}
+
+
+/**
+ * Blurs an image on the gpu and downscales it in one go, with an existing context (the image must be the size the context was created for)
+ * The first pass only blurs the columns the downscaled image samples and the second pass only the rows, so the result is the same as
+ * blurring the whole image and then sampling it at SAMPLE_POSITION, and only the downscaled image is read back
+ * @param ctx : the gpu context to blur with (must use images that are not normalized, so not linear or buffers)
+ * @param img_datap : struct storing all the info of the image (in img_datap->arrays[0], which is not changed)
+ * @param out_width : width of the downscaled image in pixels (at most the width of the image)
+ * @param out_height : height of the downscaled image in pixels (at most the height of the image)
+ * @param [output] out_pixels : the downscaled RGBA pixels (out_width * out_height)
+ */
+void blur_gpu_resized_with_context(struct Gpu_Context *ctx, struct Img_Data *img_datap, unsigned out_width, unsigned out_height, unsigned char *out_pixels) {
+	if (ctx->buffers || ctx->linear) { error("the downscaling blur needs images, which this OpenCL device does not support\n"); }
+
+	// Create the downscaling images if there are none yet, or they are for another size
+	if (out_width != ctx->resized_width || out_height != ctx->resized_height) {
+		if (ctx->resized_mid_img) { clReleaseMemObject(ctx->resized_mid_img); }
+		if (ctx->resized_img) { clReleaseMemObject(ctx->resized_img); }
+		ctx->resized_mid_img = create_device_image(ctx, img_datap, out_width, img_datap->height);
+		ctx->resized_img = create_device_image(ctx, img_datap, out_width, out_height);
+		ctx->resized_width = out_width;
+		ctx->resized_height = out_height;
+	}
+
+	// Point the kernels at the images and the current gaussian kernel
+	set_blur_kernel_args(ctx->first_pass_resized_kernel, &ctx->img1, &ctx->resized_mid_img, &ctx->gaussian_kernel_mem);
+	set_blur_kernel_args(ctx->second_pass_resized_kernel, &ctx->resized_mid_img, &ctx->resized_img, &ctx->gaussian_kernel_mem);
+	cl_kernel resized_kernels[] = { ctx->first_pass_resized_kernel, ctx->second_pass_resized_kernel };
+	for (unsigned i = 0; i < 2; ++i) {
+		if (clSetKernelArg(resized_kernels[i], 3, sizeof(cl_uint), &ctx->gaussian_kernel_len) != CL_SUCCESS
+				|| clSetKernelArg(resized_kernels[i], 4, sizeof(cl_uint), &ctx->offset) != CL_SUCCESS) {
+			error("could not set gaussian kernel length OpenCL kernel argument\n");
+		}
+	}
+
+	// Write the input image, blur the sampled columns of every row, then the sampled rows of those columns
+	struct Region whole_image = { 0, 0, img_datap->width, img_datap->height };
+	struct Region mid_image = { 0, 0, out_width, img_datap->height };
+	struct Region out_image = { 0, 0, out_width, out_height };
+	transfer_region(ctx, img_datap, img_datap->arrays[0], whole_image, true);
+	enqueue_pass(ctx, ctx->command_queue, ctx->first_pass_resized_kernel, mid_image);
+	enqueue_pass(ctx, ctx->command_queue, ctx->second_pass_resized_kernel, out_image);
+
+	// Read the downscaled image back to host memory
+	size_t origin[] = {0, 0, 0};
+	size_t region[] = {out_width, out_height, 1};
+	cl_int err = clEnqueueReadImage(ctx->command_queue, ctx->resized_img, CL_TRUE, origin, region, out_width * img_datap->pixel_length, 0, out_pixels, 0, NULL, NULL);
+	if (err != CL_SUCCESS) { error("could not read blurred image from device to host\n"); }
+}
+
+
+/**
+ * Gets the most images blur_gpu_batch_with_context can blur in one batch on the device of a gpu context
+ * @param ctx : the gpu context
+ * @return the most layers an image array can have (0 if the context uses buffers, which can't blur batches)
+ */
+unsigned gpu_max_batch_layers(struct Gpu_Context *ctx) {
+	return ctx->max_batch_layers;
+}
+
+/**
+ * Blurs a batch of images on the gpu with one dispatch per pass, with each image in its own layer of a 2D image array
+ * The image arrays are the size of the batch's size class, every image is uploaded into the corner of its layer and clamped at its own edges,
+ * so each blurred image is the same as blurring it on its own, but a batch of small images costs two kernel launches instead of two per image
+ * @param ctx : the gpu context to blur with (must use images that are not normalized, so not linear or buffers)
+ * @param imgs : the images to blur (in their arrays[0]), each one is blurred in place
+ * @param num_imgs : the number of images in the batch (at most gpu_max_batch_layers)
+ * @param width : the width of the size class in pixels (at least the width of every image)
+ * @param height : the height of the size class in pixels (at least the height of every image)
+ */
+void blur_gpu_batch_with_context(struct Gpu_Context *ctx, struct Img_Data **imgs, unsigned num_imgs, unsigned width, unsigned height) {
+	if (ctx->buffers || ctx->linear) { error("the batched blur needs images, which this OpenCL device does not support\n"); }
+	if (num_imgs > ctx->max_batch_layers) { error("batch has more images than an OpenCL image array can have layers\n"); }
+	cl_int err;
+
+	// Create the image arrays if there are none yet, they are for another size class, or they have too few layers
+	if (width != ctx->batch_width || height != ctx->batch_height || num_imgs > ctx->batch_layers) {
+		if (ctx->batch_img1) { clReleaseMemObject(ctx->batch_img1); }
+		if (ctx->batch_img2) { clReleaseMemObject(ctx->batch_img2); }
+		if (ctx->batch_sizes_mem) { clReleaseMemObject(ctx->batch_sizes_mem); }
+
+		cl_image_format format;
+		cl_image_desc desc;
+		initialize_format_and_desc(&format, &desc, imgs[0]);
+		desc.image_type = CL_MEM_OBJECT_IMAGE2D_ARRAY;
+		desc.image_width = width;
+		desc.image_height = height;
+		desc.image_array_size = num_imgs;
+		ctx->batch_img1 = clCreateImage(ctx->context, CL_MEM_READ_WRITE, (const cl_image_format *) &format, (const cl_image_desc *) &desc, NULL, &err);
+		if (err) { error("could not create image array object for the batched blur\n"); }
+		ctx->batch_img2 = clCreateImage(ctx->context, CL_MEM_READ_WRITE, (const cl_image_format *) &format, (const cl_image_desc *) &desc, NULL, &err);
+		if (err) { error("could not create image array object for the batched blur\n"); }
+		ctx->batch_sizes_mem = clCreateBuffer(ctx->context, CL_MEM_READ_ONLY, sizeof(cl_int) * 2 * num_imgs, NULL, &err);
+		if (err) { error("could not create layer sizes global memory object\n"); }
+
+		ctx->batch_width = width;
+		ctx->batch_height = height;
+		ctx->batch_layers = num_imgs;
+	}
+
+	// Point the kernels at the image arrays, the current gaussian kernel and the layer sizes
+	set_blur_kernel_args(ctx->first_pass_batch_kernel, &ctx->batch_img1, &ctx->batch_img2, &ctx->gaussian_kernel_mem);
+	set_blur_kernel_args(ctx->second_pass_batch_kernel, &ctx->batch_img2, &ctx->batch_img1, &ctx->gaussian_kernel_mem);
+	cl_kernel batch_kernels[] = { ctx->first_pass_batch_kernel, ctx->second_pass_batch_kernel };
+	for (unsigned i = 0; i < 2; ++i) {
+		if (clSetKernelArg(batch_kernels[i], 3, sizeof(cl_uint), &ctx->gaussian_kernel_len) != CL_SUCCESS
+				|| clSetKernelArg(batch_kernels[i], 4, sizeof(cl_uint), &ctx->offset) != CL_SUCCESS) {
+			error("could not set gaussian kernel length OpenCL kernel argument\n");
+		}
+		if (clSetKernelArg(batch_kernels[i], 5, sizeof(cl_mem), &ctx->batch_sizes_mem) != CL_SUCCESS) {
+			error("could not set layer sizes OpenCL kernel argument\n");
+		}
+	}
+
+	// Write the size of every image, then every image into its layer (the in order queue runs the writes before the kernels, without waiting on each one)
+	cl_int *layer_sizes = malloc(sizeof(cl_int) * 2 * num_imgs);
+	if (layer_sizes == NULL) { error("could not allocate layer sizes\n"); }
+	for (unsigned layer = 0; layer < num_imgs; ++layer) {
+		layer_sizes[2 * layer] = imgs[layer]->width;
+		layer_sizes[2 * layer + 1] = imgs[layer]->height;
+	}
+	err = clEnqueueWriteBuffer(ctx->command_queue, ctx->batch_sizes_mem, CL_FALSE, 0, sizeof(cl_int) * 2 * num_imgs, layer_sizes, 0, NULL, NULL);
+	if (err != CL_SUCCESS) { error("could not write layer sizes from host to device\n"); }
 
+	for (unsigned layer = 0; layer < num_imgs; ++layer) {
+		size_t origin[] = {0, 0, layer};
+		size_t region[] = {imgs[layer]->width, imgs[layer]->height, 1};
+		err = clEnqueueWriteImage(ctx->command_queue, ctx->batch_img1, CL_FALSE, origin, region, imgs[layer]->row_stride, 0, imgs[layer]->arrays[0], 0, NULL, NULL);
+		if (err != CL_SUCCESS) { error("could not write input image for first pass from host to device\n"); }
+	}
+
+	// Blur every layer with one 3D dispatch per pass (work items past the edges of a smaller image return straight away)
+	size_t global_work_size[] = {width, height, num_imgs};
+	clEnqueueNDRangeKernel(ctx->command_queue, ctx->first_pass_batch_kernel, 3, NULL, global_work_size, NULL, 0, NULL, NULL);
+	clEnqueueNDRangeKernel(ctx->command_queue, ctx->second_pass_batch_kernel, 3, NULL, global_work_size, NULL, 0, NULL, NULL);
+
+	// Read every blurred layer back over its image, and wait for the whole batch
+	for (unsigned layer = 0; layer < num_imgs; ++layer) {
+		size_t origin[] = {0, 0, layer};
+		size_t region[] = {imgs[layer]->width, imgs[layer]->height, 1};
+		err = clEnqueueReadImage(ctx->command_queue, ctx->batch_img1, CL_FALSE, origin, region, imgs[layer]->row_stride, 0, imgs[layer]->arrays[0], 0, NULL, NULL);
+		if (err != CL_SUCCESS) { error("could not read blurred image from device to host\n"); }
+	}
+	if (clFinish(ctx->command_queue) != CL_SUCCESS) { error("could not finish the batched blur on the device\n"); }
+	free(layer_sizes);
+}
+
+
+/**
+ * Releases all the OpenCL objects of a gpu context and frees it
+ * @param ctx : the gpu context to release
+ */
+void release_gpu_context(struct Gpu_Context *ctx) {
 	// Release all OpenCL objects
-	clReleaseMemObject(gaussian_kernel_mem);
-	clReleaseMemObject(img1);
-	clReleaseMemObject(img2);
-	clReleaseKernel(first_pass_kernel);
-	clReleaseKernel(second_pass_kernel);
-	clReleaseCommandQueue(command_queue);
-	clReleaseProgram(program); // This line causes a memory error in Valgrind, idk why
-	clReleaseContext(context);
+	clReleaseMemObject(ctx->gaussian_kernel_mem);
+	clReleaseMemObject(ctx->img1);
+	clReleaseMemObject(ctx->img2);
+	clReleaseKernel(ctx->first_pass_kernel);
+	clReleaseKernel(ctx->second_pass_kernel);
+	clReleaseKernel(ctx->first_pass_any_len_kernel);
+	clReleaseKernel(ctx->second_pass_any_len_kernel);
+	clReleaseKernel(ctx->first_pass_linear_kernel);
+	clReleaseKernel(ctx->second_pass_linear_kernel);
+	clReleaseKernel(ctx->first_pass_buffer_kernel);
+	clReleaseKernel(ctx->second_pass_buffer_kernel);
+	clReleaseKernel(ctx->first_pass_resized_kernel);
+	clReleaseKernel(ctx->second_pass_resized_kernel);
+	if (ctx->resized_mid_img) { clReleaseMemObject(ctx->resized_mid_img); }
+	if (ctx->resized_img) { clReleaseMemObject(ctx->resized_img); }
+	clReleaseKernel(ctx->second_pass_unsharp_kernel);
+	clReleaseKernel(ctx->first_pass_dog_kernel);
+	clReleaseKernel(ctx->second_pass_dog_kernel);
+	clReleaseKernel(ctx->first_pass_batch_kernel);
+	clReleaseKernel(ctx->second_pass_batch_kernel);
+	if (ctx->batch_img1) { clReleaseMemObject(ctx->batch_img1); }
+	if (ctx->batch_img2) { clReleaseMemObject(ctx->batch_img2); }
+	if (ctx->batch_sizes_mem) { clReleaseMemObject(ctx->batch_sizes_mem); }
+	if (ctx->img3) { clReleaseMemObject(ctx->img3); }
+	if (ctx->dog_kernel_mem) { clReleaseMemObject(ctx->dog_kernel_mem); }
+	clReleaseCommandQueue(ctx->command_queue);
+	for (unsigned i = 0; i < NUM_BAND_QUEUES && ctx->num_bands > 1; ++i) {
+		if (ctx->band_img1[i]) { clReleaseMemObject(ctx->band_img1[i]); }
+		if (ctx->band_img2[i]) { clReleaseMemObject(ctx->band_img2[i]); }
+		clReleaseCommandQueue(ctx->band_queues[i]);
+	}
+	clReleaseProgram(ctx->program); // This line causes a memory error in Valgrind, idk why
+	clReleaseContext(ctx->context);
+	free(ctx);
+}
+
+
+/**
+ * Performs blur on the input image and stores it in the new image space
+ * @param img_datap : struct storing all the info of the input image
+ * @param std_dev : desired standard deviation of the gaussian_blur
+ * @param config : how the blur should be performed (area to blur, linear filtering)
+ */
+void blur_gpu(struct Img_Data *img_datap, unsigned std_dev, struct Gpu_Config *config) {
+	// Create the 1D Gaussian convolution kernel and output it
+	cl_uint gaussian_kernel_len = std_dev * RADIUS * 2 + 1;
+	cl_float *gaussian_kernel = malloc(sizeof(float) * gaussian_kernel_len);
+	calculate_kernel(&gaussian_kernel, gaussian_kernel_len, std_dev);
+	print_kernel(gaussian_kernel, gaussian_kernel_len);
+
+	// Start timing the duration of the blur
+	printf("Blurring...\n");
+	struct timespec start, finish;
+	float duration;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	
+	// Set up the gpu, perform the blur, and release everything again
+	struct Gpu_Context *ctx = create_gpu_context(img_datap, gaussian_kernel, gaussian_kernel_len, config);
+	blur_gpu_with_context(ctx, img_datap, config->area);
+	release_gpu_context(ctx);
 
 	// Output the duration of the blur
 	clock_gettime(CLOCK_MONOTONIC, &finish);
@@ -256,5 +1129,4 @@ void blur_gpu(struct Img_Data *img_datap, unsigned std_dev) {
 	
 	// Free allocated memory
 	free(gaussian_kernel);
-	free(buf);
 }
@@ -3,22 +3,33 @@
 //
 // Functions used by both blur_cpu and blur_gpu
 
+#include <stdlib.h>
 #include <stdio.h>
 #include <math.h>
 #include "blur_helpers.h"
+#include "error.h"
 
 #define RADIUS 3
 
 
 /**
- * Calculates the values for all the elements of the 1D gaussian convolution kernel (values are normalized)
+ * Calculates the length of the 1D gaussian convolution kernel for any (not necessarily integer) standard deviation
+ * @param std_dev : the standard deviation of the gaussian filter
+ * @return the length of the kernel in pixels (always odd, RADIUS standard deviations on each side rounded up)
+ */
+unsigned kernel_len_for_std_dev(float std_dev) {
+	return (unsigned) ceil(RADIUS * std_dev) * 2 + 1;
+}
+
+/**
+ * Calculates the values for all the elements of the 1D gaussian convolution kernel for any standard deviation (values are normalized)
  * @param [output] gaussian_kernel : the 1D kernel to fill the values with
- * @param gaussian_kernel_len : length of the gaussian kernel in pixels
+ * @param gaussian_kernel_len : length of the gaussian kernel in pixels (the target pixel is in the middle)
  * @param std_dev : the standard deviation of the gaussian filter
  */
-void calculate_kernel(float **gaussian_kernel, unsigned gaussian_kernel_len, unsigned std_dev) {
+void calculate_kernel_float(float **gaussian_kernel, unsigned gaussian_kernel_len, float std_dev) {
 	// Calculate some constants used in gaussian blur calculation
-	unsigned offset = RADIUS * std_dev;
+	unsigned offset = gaussian_kernel_len / 2;
 	float exponent_denominator = 2 * std_dev * std_dev;
 	
 	// Process gaussian value of x = 0 so it doesn't get processed twice in the loop
@@ -47,6 +58,73 @@ void calculate_kernel(float **gaussian_kernel, unsigned gaussian_kernel_len, uns
 	}
 }
 
+/**
+ * Calculates the values for all the elements of the 1D gaussian convolution kernel (values are normalized)
+ * @param [output] gaussian_kernel : the 1D kernel to fill the values with
+ * @param gaussian_kernel_len : length of the gaussian kernel in pixels
+ * @param std_dev : the standard deviation of the gaussian filter
+ */
+void calculate_kernel(float **gaussian_kernel, unsigned gaussian_kernel_len, unsigned std_dev) {
+	calculate_kernel_float(gaussian_kernel, gaussian_kernel_len, std_dev);
+}
+
+/**
+ * Merges each pair of neighbouring taps of a 1D convolution kernel into one tap that samples between the two pixels,
+ * so a sampler with linear filtering reads both pixels (weighted by the fraction) in one fetch
+ * @param gaussian_kernel : the 1D convolution kernel to merge
+ * @param gaussian_kernel_len : the length of the kernel (the target pixel is at gaussian_kernel_len / 2)
+ * @param [output] linear_taps : LINEAR_TAPS_LEN(gaussian_kernel_len) pairs of (offset in pixels from the target pixel, weight)
+ */
+void calculate_linear_taps(float *gaussian_kernel, unsigned gaussian_kernel_len, float *linear_taps) {
+	int offset = gaussian_kernel_len / 2;
+	for (unsigned i = 0; i < gaussian_kernel_len; i += 2) {
+		// The last tap has no neighbour to merge with if the length is odd, so it samples its own pixel
+		float first_weight = gaussian_kernel[i];
+		float second_weight = i + 1 < gaussian_kernel_len ? gaussian_kernel[i + 1] : 0;
+		float weight = first_weight + second_weight;
+
+		linear_taps[i + 0] = (int) i - offset + (weight > 0 ? second_weight / weight : 0);
+		linear_taps[i + 1] = weight;
+	}
+}
+
+/**
+ * Calculates the widths of NUM_BOXES box blurs that applied one after another approximate a gaussian blur
+ * (the variance of a box of width w is (w^2 - 1) / 12, so the widths are picked to add up to the variance of the gaussian)
+ * @param [output] box_widths : NUM_BOXES odd box widths in pixels
+ * @param std_dev : the standard deviation of the gaussian filter being approximated
+ */
+void calculate_box_widths(unsigned *box_widths, float std_dev) {
+	// Largest odd width under the ideal width, and the next odd width above it
+	float ideal_width = sqrt(12 * std_dev * std_dev / NUM_BOXES + 1);
+	int lower_width = floor(ideal_width);
+	if (lower_width % 2 == 0) { lower_width --; }
+	int upper_width = lower_width + 2;
+
+	// Number of boxes that use the lower width so the total variance is as close as possible to the gaussian
+	float num_lower = (12 * std_dev * std_dev - NUM_BOXES * lower_width * lower_width - 4 * NUM_BOXES * lower_width - 3 * NUM_BOXES) / (-4 * lower_width - 4);
+	int num_lower_boxes = round(num_lower);
+	
+	for (int i = 0; i < NUM_BOXES; ++i) {
+		box_widths[i] = i < num_lower_boxes ? lower_width : upper_width;
+	}
+}
+
+/**
+ * Calculates the standard deviation of a (normalized, symmetric) 1D convolution kernel
+ * @param gaussian_kernel : the kernel
+ * @param gaussian_kernel_len : the length of the kernel in pixels
+ * @return the standard deviation of the kernel
+ */
+float kernel_std_dev(float *gaussian_kernel, unsigned gaussian_kernel_len) {
+	int offset = gaussian_kernel_len / 2;
+	float variance = 0;
+	for (int i = 0; i < (int) gaussian_kernel_len; ++i) {
+		variance += gaussian_kernel[i] * (i - offset) * (i - offset);
+	}
+	return sqrt(variance);
+}
+
 /**
  * Prints out the gaussian kernel to be used in the program
  * @param gaussian_kernel : pointer to the kernel to be output
@@ -65,3 +143,116 @@ void print_kernel(float *gaussian_kernel, unsigned gaussian_kernel_len) {
 	
 	printf("]\nLength: %u, Sum: %f\n\n", gaussian_kernel_len, sum);
 }
+
+/**
+ * Grows a region by a halo on each side, without letting it extend past the edges of the image
+ * @param region : the region to grow
+ * @param halo_x : number of columns to add to the left and right of the region
+ * @param halo_y : number of rows to add to the top and bottom of the region
+ * @param width : width of the image in pixels
+ * @param height : height of the image in pixels
+ * @return the grown region
+ */
+struct Region expand_region(struct Region region, unsigned halo_x, unsigned halo_y, unsigned width, unsigned height) {
+	// Get the edges of the grown region, clamped to the image
+	unsigned left = region.x > halo_x ? region.x - halo_x : 0;
+	unsigned top = region.y > halo_y ? region.y - halo_y : 0;
+	unsigned right = region.x + region.width + halo_x;
+	unsigned bottom = region.y + region.height + halo_y;
+	if (right > width) { right = width; }
+	if (bottom > height) { bottom = height; }
+
+	struct Region expanded = { left, top, right - left, bottom - top };
+	return expanded;
+}
+
+/**
+ * Clips every region to the image and removes the regions that end up empty
+ * @param regions : the regions to clip
+ * @param num_regions : number of regions
+ * @param width : width of the image in pixels
+ * @param height : height of the image in pixels
+ * @return the number of regions left (they are moved to the front of regions)
+ */
+unsigned clip_regions(struct Region *regions, unsigned num_regions, unsigned width, unsigned height) {
+	unsigned num_left = 0;
+	for (unsigned i = 0; i < num_regions; ++i) {
+		struct Region region = regions[i];
+		
+		// Drop regions that start outside of the image
+		if (region.x >= width || region.y >= height || !region.width || !region.height) { continue; }
+		
+		// Cut off the part of the region outside of the image
+		if (region.width > width - region.x) { region.width = width - region.x; }
+		if (region.height > height - region.y) { region.height = height - region.y; }
+		regions[num_left++] = region;
+	}
+	return num_left;
+}
+
+/**
+ * Turns a map of marked tiles into regions, merging each horizontal run of marked tiles into one region
+ * @param tile_map : tiles_x * tiles_y bytes, non zero means the tile is marked
+ * @param tile_size : side length of each tile in pixels
+ * @param width : width of the image in pixels
+ * @param height : height of the image in pixels
+ * @param [output] regions : pointer to where the (malloced) array of regions is stored
+ * @return the number of regions
+ */
+unsigned regions_from_tile_map(unsigned char *tile_map, unsigned tile_size, unsigned width, unsigned height, struct Region **regions) {
+	unsigned tiles_x = (width + tile_size - 1) / tile_size;
+	unsigned tiles_y = (height + tile_size - 1) / tile_size;
+
+	// There can never be more runs than half the tiles (rounded up) in every row
+	*regions = malloc(sizeof(struct Region) * (((tiles_x + 1) / 2) * tiles_y + 1));
+	if (*regions == NULL) { error("could not allocate regions\n"); }
+
+	// Find every run of marked tiles in every row of tiles
+	unsigned num_regions = 0;
+	for (unsigned tile_row = 0; tile_row < tiles_y; ++tile_row) {
+		unsigned tile_col = 0;
+		while (tile_col < tiles_x) {
+			if (!tile_map[tile_row * tiles_x + tile_col]) {
+				tile_col ++;
+				continue;
+			}
+
+			unsigned run_start = tile_col;
+			while (tile_col < tiles_x && tile_map[tile_row * tiles_x + tile_col]) { tile_col ++; }
+
+			struct Region region = { run_start * tile_size, tile_row * tile_size, (tile_col - run_start) * tile_size, tile_size };
+			(*regions)[num_regions++] = region;
+		}
+	}
+
+	// The last row and column of tiles can hang off the edge of the image
+	return clip_regions(*regions, num_regions, width, height);
+}
+
+/**
+ * Finds the regions that cover all the non zero bytes of a mask, in MASK_TILE_SIZE tiles
+ * @param mask : width * height bytes, non zero means the pixel should be blurred
+ * @param width : width of the image in pixels
+ * @param height : height of the image in pixels
+ * @param [output] regions : pointer to where the (malloced) array of regions is stored
+ * @return the number of regions
+ */
+unsigned regions_from_mask(unsigned char *mask, unsigned width, unsigned height, struct Region **regions) {
+	unsigned tiles_x = (width + MASK_TILE_SIZE - 1) / MASK_TILE_SIZE;
+	unsigned tiles_y = (height + MASK_TILE_SIZE - 1) / MASK_TILE_SIZE;
+	unsigned char *tile_map = calloc((size_t) tiles_x * tiles_y, sizeof(unsigned char));
+	if (tile_map == NULL) { error("could not allocate mask tile map\n"); }
+
+	// Mark every tile that has at least one masked pixel
+	for (unsigned row = 0; row < height; ++row) {
+		for (unsigned col = 0; col < width; ++col) {
+			if (mask[(size_t) row * width + col]) {
+				tile_map[(row / MASK_TILE_SIZE) * tiles_x + col / MASK_TILE_SIZE] = 1;
+			}
+		}
+	}
+
+	unsigned num_regions = regions_from_tile_map(tile_map, MASK_TILE_SIZE, width, height, regions);
+	free(tile_map);
+	return num_regions;
+}
@@ -0,0 +1,124 @@
+// Ivan Bystrov
+// 18 October 2026
+//
+// Finds the parts of an image that are one flat colour so blurring them can be skipped
+
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include "flat_tiles.h"
+#include "error.h"
+
+// Number of colour components summarized (alpha is never blurred, so it doesn't matter if it is flat)
+#define NUM_COLOUR_CHANNELS 3
+
+
+/**
+ * Struct storing the smallest and largest value of each colour component in a tile
+ * min : the smallest R, G, B values
+ * max : the largest R, G, B values
+ */
+struct Tile_Range {
+	unsigned char min[NUM_COLOUR_CHANNELS];
+	unsigned char max[NUM_COLOUR_CHANNELS];
+};
+
+/**
+ * Finds the smallest and largest value of each colour component in a tile of the input image
+ * @param img_datap : struct storing the input image (in img_datap->arrays[0])
+ * @param tile : the pixels of the tile
+ * @param [output] range : the range of the tile
+ */
+void summarize_tile(struct Img_Data *img_datap, struct Region tile, struct Tile_Range *range) {
+	unsigned pxl_length = img_datap->pixel_length;
+	unsigned char *first_pxl = img_datap->arrays[0] + (size_t) tile.y * img_datap->row_stride + (size_t) tile.x * pxl_length;
+	for (unsigned channel = 0; channel < NUM_COLOUR_CHANNELS; ++channel) {
+		range->min[channel] = first_pxl[channel];
+		range->max[channel] = first_pxl[channel];
+	}
+
+	for (unsigned row = tile.y; row < tile.y + tile.height; ++row) {
+		unsigned char *pxl = img_datap->arrays[0] + (size_t) row * img_datap->row_stride + (size_t) tile.x * pxl_length;
+		for (unsigned col = 0; col < tile.width; ++col, pxl += pxl_length) {
+			for (unsigned channel = 0; channel < NUM_COLOUR_CHANNELS; ++channel) {
+				if (pxl[channel] < range->min[channel]) { range->min[channel] = pxl[channel]; }
+				if (pxl[channel] > range->max[channel]) { range->max[channel] = pxl[channel]; }
+			}
+		}
+	}
+}
+
+/**
+ * Checks if a block of tiles is all one colour
+ * @param ranges : the range of every tile
+ * @param tiles_x : number of tiles in each row of tiles
+ * @param footprint : the block of tiles to check (in tiles, not pixels)
+ * @return true if every tile is flat and the same colour, false otherwise
+ */
+bool tiles_flat(struct Tile_Range *ranges, unsigned tiles_x, struct Region footprint) {
+	struct Tile_Range *first = &ranges[footprint.y * tiles_x + footprint.x];
+
+	for (unsigned tile_row = footprint.y; tile_row < footprint.y + footprint.height; ++tile_row) {
+		for (unsigned tile_col = footprint.x; tile_col < footprint.x + footprint.width; ++tile_col) {
+			struct Tile_Range *range = &ranges[tile_row * tiles_x + tile_col];
+			for (unsigned channel = 0; channel < NUM_COLOUR_CHANNELS; ++channel) {
+				if (range->min[channel] != range->max[channel] || range->min[channel] != first->min[channel]) { return false; }
+			}
+		}
+	}
+	return true;
+}
+
+/**
+ * Finds the regions of the output image that have to be blurred, leaving out every tile whose whole kernel footprint is one colour
+ * (the cpu blur of a flat footprint gives back that colour, which is already the input pixel, so those tiles are left as they are,
+ * the first gpu pass truncates instead of rounding so a full gpu blur can give back one less than that colour)
+ * Tiles whose footprint reaches past the edge of the image are always blurred, since the taps past the edge are dropped by the cpu blur
+ * @param img_datap : struct storing the input image (in img_datap->arrays[0])
+ * @param offset : the index of the target pixel in the gaussian kernel (how far the footprint of a pixel reaches)
+ * @param [output] regions : pointer to where the (malloced) array of regions is stored
+ * @return the number of regions
+ */
+unsigned find_non_flat_regions(struct Img_Data *img_datap, unsigned offset, struct Region **regions) {
+	unsigned width = img_datap->width;
+	unsigned height = img_datap->height;
+	unsigned tiles_x = (width + FLAT_TILE_SIZE - 1) / FLAT_TILE_SIZE;
+	unsigned tiles_y = (height + FLAT_TILE_SIZE - 1) / FLAT_TILE_SIZE;
+
+	struct Tile_Range *ranges = malloc(sizeof(struct Tile_Range) * tiles_x * tiles_y);
+	unsigned char *blur_tiles = calloc((size_t) tiles_x * tiles_y, sizeof(unsigned char));
+	if (ranges == NULL || blur_tiles == NULL) { error("could not allocate flat tile map\n"); }
+
+	// Summarize every tile of the input image in one pass over it
+	for (unsigned tile_row = 0; tile_row < tiles_y; ++tile_row) {
+		for (unsigned tile_col = 0; tile_col < tiles_x; ++tile_col) {
+			struct Region tile = { tile_col * FLAT_TILE_SIZE, tile_row * FLAT_TILE_SIZE, FLAT_TILE_SIZE, FLAT_TILE_SIZE };
+			clip_regions(&tile, 1, width, height);
+			summarize_tile(img_datap, tile, &ranges[tile_row * tiles_x + tile_col]);
+		}
+	}
+
+	// Mark every output tile whose footprint (the tile and offset pixels on every side) leaves the image or covers more than one colour
+	for (unsigned tile_row = 0; tile_row < tiles_y; ++tile_row) {
+		for (unsigned tile_col = 0; tile_col < tiles_x; ++tile_col) {
+			struct Region tile = { tile_col * FLAT_TILE_SIZE, tile_row * FLAT_TILE_SIZE, FLAT_TILE_SIZE, FLAT_TILE_SIZE };
+			clip_regions(&tile, 1, width, height);
+
+			if (tile.x < offset || tile.y < offset || tile.x + tile.width + offset > width || tile.y + tile.height + offset > height) {
+				blur_tiles[tile_row * tiles_x + tile_col] = 1;
+				continue;
+			}
+
+			unsigned first_col = (tile.x - offset) / FLAT_TILE_SIZE;
+			unsigned first_row = (tile.y - offset) / FLAT_TILE_SIZE;
+			struct Region footprint = { first_col, first_row, (tile.x + tile.width + offset - 1) / FLAT_TILE_SIZE - first_col + 1,
+					(tile.y + tile.height + offset - 1) / FLAT_TILE_SIZE - first_row + 1 };
+			blur_tiles[tile_row * tiles_x + tile_col] = !tiles_flat(ranges, tiles_x, footprint);
+		}
+	}
+
+	unsigned num_regions = regions_from_tile_map(blur_tiles, FLAT_TILE_SIZE, width, height, regions);
+	free(ranges);
+	free(blur_tiles);
+	return num_regions;
+}
@@ -0,0 +1,101 @@
+// Ivan Bystrov
+// 18 October 2026
+//
+// Unrolled cpu blur kernels for each small radius, which fold the mirrored taps of the symmetric gaussian kernel
+
+
+#include "folded_kernels.h"
+
+
+// Adds the two taps k pixels before and after the target pixel to the sums, adding the mirrored components first so each weight is only multiplied once
+#define FOLD_TAP(k) { \
+	unsigned char *before = center - (size_t) (k) * step; \
+	unsigned char *after = center + (size_t) (k) * step; \
+	float weight = half_kernel[k]; \
+	sum_r += (before[0] + after[0]) * weight; \
+	sum_g += (before[1] + after[1]) * weight; \
+	sum_b += (before[2] + after[2]) * weight; \
+}
+
+// FOLD_TAPS_n adds the taps n pixels away down to 1 pixel away (the smallest weights first, which loses the least precision)
+#define FOLD_TAPS_1 FOLD_TAP(1)
+#define FOLD_TAPS_2 FOLD_TAP(2) FOLD_TAPS_1
+#define FOLD_TAPS_3 FOLD_TAP(3) FOLD_TAPS_2
+#define FOLD_TAPS_4 FOLD_TAP(4) FOLD_TAPS_3
+#define FOLD_TAPS_5 FOLD_TAP(5) FOLD_TAPS_4
+#define FOLD_TAPS_6 FOLD_TAP(6) FOLD_TAPS_5
+#define FOLD_TAPS_7 FOLD_TAP(7) FOLD_TAPS_6
+#define FOLD_TAPS_8 FOLD_TAP(8) FOLD_TAPS_7
+#define FOLD_TAPS_9 FOLD_TAP(9) FOLD_TAPS_8
+#define FOLD_TAPS_10 FOLD_TAP(10) FOLD_TAPS_9
+#define FOLD_TAPS_11 FOLD_TAP(11) FOLD_TAPS_10
+#define FOLD_TAPS_12 FOLD_TAP(12) FOLD_TAPS_11
+#define FOLD_TAPS_13 FOLD_TAP(13) FOLD_TAPS_12
+#define FOLD_TAPS_14 FOLD_TAP(14) FOLD_TAPS_13
+#define FOLD_TAPS_15 FOLD_TAP(15) FOLD_TAPS_14
+#define FOLD_TAPS_16 FOLD_TAP(16) FOLD_TAPS_15
+#define FOLD_TAPS_17 FOLD_TAP(17) FOLD_TAPS_16
+#define FOLD_TAPS_18 FOLD_TAP(18) FOLD_TAPS_17
+#define FOLD_TAPS_19 FOLD_TAP(19) FOLD_TAPS_18
+#define FOLD_TAPS_20 FOLD_TAP(20) FOLD_TAPS_19
+#define FOLD_TAPS_21 FOLD_TAP(21) FOLD_TAPS_20
+#define FOLD_TAPS_22 FOLD_TAP(22) FOLD_TAPS_21
+#define FOLD_TAPS_23 FOLD_TAP(23) FOLD_TAPS_22
+#define FOLD_TAPS_24 FOLD_TAP(24) FOLD_TAPS_23
+
+// Defines folded_sums_<radius>, the weighted sums of a pixel with every tap of a kernel of that radius unrolled, and the target pixel added last
+#define DEFINE_FOLDED_SUMS(radius) \
+static void folded_sums_##radius(unsigned char *center, size_t step, float *half_kernel, float *sums) { \
+	float sum_r = 0; \
+	float sum_g = 0; \
+	float sum_b = 0; \
+	FOLD_TAPS_##radius \
+	sums[0] = sum_r + center[0] * half_kernel[0]; \
+	sums[1] = sum_g + center[1] * half_kernel[0]; \
+	sums[2] = sum_b + center[2] * half_kernel[0]; \
+}
+
+DEFINE_FOLDED_SUMS(1)
+DEFINE_FOLDED_SUMS(2)
+DEFINE_FOLDED_SUMS(3)
+DEFINE_FOLDED_SUMS(4)
+DEFINE_FOLDED_SUMS(5)
+DEFINE_FOLDED_SUMS(6)
+DEFINE_FOLDED_SUMS(7)
+DEFINE_FOLDED_SUMS(8)
+DEFINE_FOLDED_SUMS(9)
+DEFINE_FOLDED_SUMS(10)
+DEFINE_FOLDED_SUMS(11)
+DEFINE_FOLDED_SUMS(12)
+DEFINE_FOLDED_SUMS(13)
+DEFINE_FOLDED_SUMS(14)
+DEFINE_FOLDED_SUMS(15)
+DEFINE_FOLDED_SUMS(16)
+DEFINE_FOLDED_SUMS(17)
+DEFINE_FOLDED_SUMS(18)
+DEFINE_FOLDED_SUMS(19)
+DEFINE_FOLDED_SUMS(20)
+DEFINE_FOLDED_SUMS(21)
+DEFINE_FOLDED_SUMS(22)
+DEFINE_FOLDED_SUMS(23)
+DEFINE_FOLDED_SUMS(24)
+
+// The kernel of each radius (there is no kernel of radius 0)
+static Folded_Sums_Func FOLDED_SUMS[MAX_FOLDED_RADIUS + 1] = {
+	NULL, folded_sums_1, folded_sums_2, folded_sums_3, folded_sums_4, folded_sums_5, folded_sums_6,
+	folded_sums_7, folded_sums_8, folded_sums_9, folded_sums_10, folded_sums_11, folded_sums_12, folded_sums_13,
+	folded_sums_14, folded_sums_15, folded_sums_16, folded_sums_17, folded_sums_18, folded_sums_19, folded_sums_20,
+	folded_sums_21, folded_sums_22, folded_sums_23, folded_sums_24
+};
+
+
+/**
+ * Gets the unrolled kernel of a radius
+ * @param gaussian_kernel_len : the length of the kernel (must be symmetric, like every kernel from calculate_kernel)
+ * @param offset : the index of the target pixel in the kernel
+ * @return the unrolled kernel, or NULL if there isn't one for this radius (the generic loop has to be used)
+ */
+Folded_Sums_Func get_folded_sums(unsigned gaussian_kernel_len, unsigned offset) {
+	if (offset == 0 || offset > MAX_FOLDED_RADIUS || gaussian_kernel_len != 2 * offset + 1) { return NULL; }
+	return FOLDED_SUMS[offset];
+}
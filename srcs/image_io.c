@@ -0,0 +1,467 @@
+// Ivan Bystrov
+// 18 October 2026
+//
+// Reads and writes images in every supported format (PNG, raw RGBA, PAM, PPM and QOI), picked from the file extension
+
+// Needed for mmap, ftruncate and fstat
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "image_io.h"
+#include "qoi.h"
+#include "error.h"
+
+// Longest netpbm header token that is read (longer tokens are cut, which makes them invalid)
+#define MAX_TOKEN_LEN 32
+
+
+/**
+ * Struct storing where the pixels of a mapped image are and how they are laid out
+ * format : the format of the image (found from the start of the file, not the extension)
+ * width : width of the image in pixels
+ * height : height of the image in pixels
+ * depth : number of components of each pixel in the file (4 for RGBA, 3 for RGB)
+ * row_stride : bytes between the starts of two rows in the file (not used by QOI)
+ * pixels_offset : where the pixels (or the QOI chunks) start in the file
+ */
+struct Mapped_Layout {
+	enum Image_Format format;
+	unsigned width;
+	unsigned height;
+	unsigned depth;
+	size_t row_stride;
+	size_t pixels_offset;
+};
+
+/**
+ * Gets the format of an image file from its extension
+ * @param filename : the filename of the image
+ * @return the format of the image (FORMAT_UNKNOWN if the extension isn't supported)
+ */
+enum Image_Format image_format(char *filename) {
+	char *extension = strrchr(filename, '.');
+	if (extension == NULL) { return FORMAT_UNKNOWN; }
+
+	if (!strcmp(extension, ".png")) { return FORMAT_PNG; }
+	if (!strcmp(extension, ".rgba")) { return FORMAT_RAW; }
+	if (!strcmp(extension, ".pam")) { return FORMAT_PAM; }
+	if (!strcmp(extension, ".ppm")) { return FORMAT_PPM; }
+	if (!strcmp(extension, ".qoi")) { return FORMAT_QOI; }
+	return FORMAT_UNKNOWN;
+}
+
+/**
+ * Reads a little endian 32 bit unsigned integer
+ * @param bytes : the 4 bytes to read
+ * @return the integer
+ */
+static unsigned read_u32_le(unsigned char *bytes) {
+	return bytes[0] | ((unsigned) bytes[1] << 8) | ((unsigned) bytes[2] << 16) | ((unsigned) bytes[3] << 24);
+}
+
+/**
+ * Writes a little endian 32 bit unsigned integer
+ * @param [output] bytes : the 4 bytes to write
+ * @param value : the integer
+ */
+static void write_u32_le(unsigned char *bytes, unsigned value) {
+	bytes[0] = value;
+	bytes[1] = value >> 8;
+	bytes[2] = value >> 16;
+	bytes[3] = value >> 24;
+}
+
+/**
+ * Reads the next whitespace separated token of a netpbm header, skipping comments
+ * @param data : the mapped file
+ * @param size : size of the mapped file in bytes
+ * @param [output] pos : position in the file to read from, left on the byte right after the token
+ * @param [output] token : the token (at most MAX_TOKEN_LEN characters)
+ */
+void read_netpbm_token(unsigned char *data, size_t size, size_t *pos, char *token) {
+	// Skip whitespace and comments (which run to the end of the line)
+	while (*pos < size && (isspace(data[*pos]) || data[*pos] == '#')) {
+		if (data[*pos] == '#') {
+			while (*pos < size && data[*pos] != '\n') { (*pos) ++; }
+		} else {
+			(*pos) ++;
+		}
+	}
+	if (*pos == size) { error("netpbm image header is truncated\n"); }
+
+	unsigned len = 0;
+	while (*pos < size && !isspace(data[*pos])) {
+		if (len < MAX_TOKEN_LEN) { token[len++] = data[*pos]; }
+		(*pos) ++;
+	}
+	token[len] = '\0';
+}
+
+/**
+ * Reads a netpbm header token that must be a positive integer
+ * @param data : the mapped file
+ * @param size : size of the mapped file in bytes
+ * @param [output] pos : position in the file to read from, left on the byte right after the token
+ * @return the integer
+ */
+unsigned read_netpbm_uint(unsigned char *data, size_t size, size_t *pos) {
+	char token[MAX_TOKEN_LEN + 1];
+	read_netpbm_token(data, size, pos, token);
+
+	char *end;
+	unsigned long value = strtoul(token, &end, 10);
+	if (*end != '\0' || !value || value > 0xffffffffUL || !isdigit(token[0])) { error("netpbm image header has an invalid number\n"); }
+	return value;
+}
+
+/**
+ * Finds the layout of a PAM (P7) or PPM (P6) image from its header
+ * @param data : the mapped file (starting with "P7" or "P6")
+ * @param size : size of the mapped file in bytes
+ * @param [output] layout : the layout of the image
+ */
+void read_netpbm_layout(unsigned char *data, size_t size, struct Mapped_Layout *layout) {
+	size_t pos = 2;
+	unsigned maxval = 0;
+
+	if (data[1] == '6') {
+		layout->format = FORMAT_PPM;
+		layout->width = read_netpbm_uint(data, size, &pos);
+		layout->height = read_netpbm_uint(data, size, &pos);
+		maxval = read_netpbm_uint(data, size, &pos);
+		layout->depth = 3;
+
+	} else {
+		// PAM headers are "KEY value" lines up to ENDHDR
+		layout->format = FORMAT_PAM;
+		layout->width = 0;
+		layout->height = 0;
+		layout->depth = 0;
+		char token[MAX_TOKEN_LEN + 1];
+		for (;;) {
+			read_netpbm_token(data, size, &pos, token);
+			if (!strcmp(token, "ENDHDR")) { break; }
+
+			if (!strcmp(token, "WIDTH")) {
+				layout->width = read_netpbm_uint(data, size, &pos);
+			} else if (!strcmp(token, "HEIGHT")) {
+				layout->height = read_netpbm_uint(data, size, &pos);
+			} else if (!strcmp(token, "DEPTH")) {
+				layout->depth = read_netpbm_uint(data, size, &pos);
+			} else if (!strcmp(token, "MAXVAL")) {
+				maxval = read_netpbm_uint(data, size, &pos);
+			} else if (!strcmp(token, "TUPLTYPE")) {
+				read_netpbm_token(data, size, &pos, token);
+			} else {
+				error("PAM image header has an unknown line\n");
+			}
+		}
+		if (!layout->width || !layout->height) { error("PAM image header has no size\n"); }
+	}
+
+	if (maxval != 255 || (layout->depth != 3 && layout->depth != 4)) { error("input image is not RGB or RGBA with bit depth 8\n"); }
+
+	// A single whitespace byte separates the header from the pixels
+	layout->pixels_offset = pos + 1;
+	layout->row_stride = (size_t) layout->width * layout->depth;
+	if (layout->pixels_offset > size || size - layout->pixels_offset < layout->row_stride * layout->height) { error("netpbm image is truncated\n"); }
+}
+
+/**
+ * Finds the format and layout of a mapped image from the start of the file
+ * @param img_datap : struct storing the mapped image
+ * @param [output] layout : the layout of the image
+ */
+void read_mapped_layout(struct Img_Data *img_datap, struct Mapped_Layout *layout) {
+	unsigned char *data = img_datap->mapped_file;
+	size_t size = img_datap->mapped_size;
+
+	if (size >= RAW_HEADER_SIZE && !memcmp(data, "RGBA", 4)) {
+		layout->format = FORMAT_RAW;
+		layout->width = read_u32_le(data + 4);
+		layout->height = read_u32_le(data + 8);
+		layout->depth = 4;
+		layout->row_stride = read_u32_le(data + 12);
+		layout->pixels_offset = RAW_HEADER_SIZE;
+		if (!layout->width || !layout->height || layout->row_stride < (size_t) layout->width * 4 || layout->row_stride % 4) {
+			error("raw image header is invalid\n");
+		}
+		if ((size - RAW_HEADER_SIZE) / layout->row_stride < layout->height) { error("raw image is truncated\n"); }
+
+	} else if (size >= 3 && data[0] == 'P' && (data[1] == '7' || data[1] == '6') && isspace(data[2])) {
+		read_netpbm_layout(data, size, layout);
+
+	} else if (qoi_read_header(data, size, &layout->width, &layout->height)) {
+		layout->format = FORMAT_QOI;
+		layout->depth = 4;
+		layout->row_stride = 0;
+		layout->pixels_offset = QOI_HEADER_SIZE;
+
+	} else {
+		error("input image is not a valid raw, PAM, PPM or QOI file\n");
+	}
+}
+
+/**
+ * Reads an image like read_image, without outputting anything (the colour type of a PNG image is not checked, read_image_size checks it)
+ * @param [output] img_datap : pointer to struct storing input image data needed for program
+ * @param filename : filepath to the image (its extension picks the format)
+ */
+void open_image(struct Img_Data *img_datap, char *filename) {
+	if (image_format(filename) == FORMAT_PNG) {
+		decode_png(img_datap, filename);
+		return;
+	}
+
+	// Map the whole file, privately so blurring a raw image in place never changes the file
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0) { error(NULL); }
+	struct stat file_stat;
+	if (fstat(fd, &file_stat)) { error(NULL); }
+	if (file_stat.st_size == 0) { error("input image is empty\n"); }
+
+	void *mapping = mmap(NULL, file_stat.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	if (mapping == MAP_FAILED) { error(NULL); }
+	close(fd);
+
+	img_datap->png_ptr = NULL;
+	img_datap->info_ptr = NULL;
+	img_datap->row_pointers = NULL;
+	img_datap->colour_type = 6;
+	img_datap->bit_depth = 8;
+	img_datap->pixel_length = 4;
+	img_datap->arrays = NULL;
+	img_datap->arena = NULL;
+	img_datap->mapped_file = mapping;
+	img_datap->mapped_size = file_stat.st_size;
+
+	struct Mapped_Layout layout;
+	read_mapped_layout(img_datap, &layout);
+	img_datap->width = layout.width;
+	img_datap->height = layout.height;
+	img_datap->row_stride = layout.format == FORMAT_RAW ? layout.row_stride : layout.width * img_datap->pixel_length;
+}
+
+/**
+ * Reads the size of an image and outputs its core information (the pixels are loaded by load_image_arrays)
+ * PNG images are decoded by libpng, every other format is mapped into memory
+ * @param [output] img_datap : pointer to struct storing input image data needed for program
+ * @param filename : filepath to the image (its extension picks the format)
+ */
+void read_image(struct Img_Data *img_datap, char *filename) {
+	if (image_format(filename) == FORMAT_PNG) {
+		read_png(img_datap, filename);
+		return;
+	}
+	open_image(img_datap, filename);
+
+	// Output core image information the same way read_png does
+	printf("Image Width: %u, Image Height: %u, Bit Depth: %u, Colour Type: %u\n\n",
+			img_datap->width, img_datap->height, img_datap->bit_depth, img_datap->colour_type);
+}
+
+/**
+ * Reads only the size of an image, from the header of a PNG image or the start of a mapping of any other format (nothing is decoded or output)
+ * @param filename : filepath to the image (its extension picks the format)
+ * @param [output] width : width of the image in pixels
+ * @param [output] height : height of the image in pixels
+ */
+void read_image_size(char *filename, unsigned *width, unsigned *height) {
+	if (image_format(filename) == FORMAT_PNG) {
+		read_png_size(filename, width, height);
+		return;
+	}
+
+	// Only the pages of the header are touched before the mapping is dropped again
+	struct Img_Data img_data;
+	open_image(&img_data, filename);
+	*width = img_data.width;
+	*height = img_data.height;
+	free_image(&img_data);
+}
+
+/**
+ * Sets up the two temp image arrays of an image that was read, with the pixels of the image in arrays[0]
+ * A raw image is blurred straight in its (private) mapping with the row stride of the file, so its pixels are never copied,
+ * the pixels of every other format are decoded into arrays from the arena with the given row stride
+ * @param img_datap : pointer to the img_data struct of the image read with read_image
+ * @param arena : the arena to allocate the arrays from
+ * @param row_stride : bytes between the starts of two rows (at least width * pixel_length, ignored for raw images)
+ */
+void load_image_arrays(struct Img_Data *img_datap, struct Img_Arena *arena, unsigned row_stride) {
+	if (img_datap->mapped_file == NULL) {
+		create_img_arrays(img_datap, arena, row_stride);
+		copy_row_pointers_and_arr(img_datap, 0, 1);
+		return;
+	}
+
+	struct Mapped_Layout layout;
+	read_mapped_layout(img_datap, &layout);
+	unsigned char *file_pixels = img_datap->mapped_file + layout.pixels_offset;
+
+	// Only the temp array is allocated for a raw image, the pages of the mapping are only copied (by the kernel) once the blur writes them
+	if (layout.format == FORMAT_RAW) {
+		if (!(img_datap->arrays = malloc(sizeof(unsigned char *) * 2))) { error("could not allocate image arrays\n"); }
+		img_datap->arrays[0] = file_pixels;
+		img_datap->arrays[1] = arena_alloc(arena, layout.row_stride * img_datap->height);
+		img_datap->row_stride = layout.row_stride;
+		img_datap->arena = arena;
+		return;
+	}
+
+	create_img_arrays(img_datap, arena, row_stride);
+	if (layout.format == FORMAT_QOI) {
+		qoi_decode(img_datap->mapped_file, img_datap->mapped_size, img_datap->arrays[0], row_stride);
+
+	} else {
+		for (unsigned row = 0; row < img_datap->height; ++row) {
+			unsigned char *in_pxl = file_pixels + row * layout.row_stride;
+			unsigned char *out_row = img_datap->arrays[0] + (size_t) row * row_stride;
+			if (layout.depth == 4) {
+				memcpy(out_row, in_pxl, layout.row_stride);
+				continue;
+			}
+
+			for (unsigned char *out_pxl = out_row; out_pxl < out_row + img_datap->width * 4; out_pxl += 4, in_pxl += 3) {
+				out_pxl[0] = in_pxl[0];
+				out_pxl[1] = in_pxl[1];
+				out_pxl[2] = in_pxl[2];
+				out_pxl[3] = 255;
+			}
+		}
+	}
+
+	// The file isn't needed once it is decoded
+	munmap(img_datap->mapped_file, img_datap->mapped_size);
+	img_datap->mapped_file = NULL;
+	img_datap->mapped_size = 0;
+}
+
+/**
+ * Creates an output file of the given size and maps it
+ * @param filename : filepath of the output file
+ * @param size : size of the file in bytes
+ * @param [output] fd : file descriptor of the file
+ * @return the mapping of the file
+ */
+unsigned char *map_output_file(char *filename, size_t size, int *fd) {
+	*fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (*fd < 0 || ftruncate(*fd, size)) { error(NULL); }
+
+	void *mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, *fd, 0);
+	if (mapping == MAP_FAILED) { error(NULL); }
+	return mapping;
+}
+
+/**
+ * Unmaps an output file and cuts it to the size that was actually written
+ * @param mapping : the mapping of the file
+ * @param mapped_size : size of the mapping in bytes
+ * @param size : size of the file in bytes
+ * @param fd : file descriptor of the file
+ */
+void unmap_output_file(unsigned char *mapping, size_t mapped_size, size_t size, int fd) {
+	if (munmap(mapping, mapped_size)) { error(NULL); }
+	if (size != mapped_size && ftruncate(fd, size)) { error(NULL); }
+	if (close(fd)) { error(NULL); }
+}
+
+/**
+ * Writes RGBA pixels to an image file in the format of its extension (everything but PNG is written through a mapping of the file)
+ * @param filename : filepath of the output image
+ * @param pixels : the RGBA pixels to write
+ * @param width : width of the image in pixels
+ * @param height : height of the image in pixels
+ * @param row_stride : bytes between the starts of two rows of pixels
+ */
+void write_image_pixels(char *filename, unsigned char *pixels, unsigned width, unsigned height, unsigned row_stride) {
+	enum Image_Format format = image_format(filename);
+	if (format == FORMAT_PNG) {
+		write_png_pixels(filename, pixels, width, height, row_stride);
+		return;
+	}
+	if (format == FORMAT_UNKNOWN) { error("output image format is not supported\n"); }
+
+	int fd;
+	size_t row_len = (size_t) width * 4;
+
+	if (format == FORMAT_RAW) {
+		// Raw images keep the row stride, so a padded image can be mapped by the next program with its padding
+		size_t size = RAW_HEADER_SIZE + (size_t) row_stride * height;
+		unsigned char *out = map_output_file(filename, size, &fd);
+		memset(out, 0, RAW_HEADER_SIZE);
+		memcpy(out, "RGBA", 4);
+		write_u32_le(out + 4, width);
+		write_u32_le(out + 8, height);
+		write_u32_le(out + 12, row_stride);
+		memcpy(out + RAW_HEADER_SIZE, pixels, (size_t) row_stride * height);
+		unmap_output_file(out, size, size, fd);
+
+	} else if (format == FORMAT_QOI) {
+		// The encoded size isn't known until the image is encoded, so the file is mapped at the largest size and cut after
+		size_t max_size = QOI_MAX_SIZE(width, height);
+		unsigned char *out = map_output_file(filename, max_size, &fd);
+		size_t size = qoi_encode(pixels, width, height, row_stride, out);
+		unmap_output_file(out, max_size, size, fd);
+
+	} else {
+		char header[128];
+		unsigned depth = format == FORMAT_PAM ? 4 : 3;
+		int header_len = format == FORMAT_PAM
+			? snprintf(header, sizeof(header), "P7\nWIDTH %u\nHEIGHT %u\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n", width, height)
+			: snprintf(header, sizeof(header), "P6\n%u %u\n255\n", width, height);
+
+		size_t size = header_len + (size_t) width * depth * height;
+		unsigned char *out = map_output_file(filename, size, &fd);
+		memcpy(out, header, header_len);
+
+		unsigned char *out_pxl = out + header_len;
+		for (unsigned row = 0; row < height; ++row) {
+			unsigned char *in_row = pixels + (size_t) row * row_stride;
+			if (depth == 4) {
+				memcpy(out_pxl, in_row, row_len);
+				out_pxl += row_len;
+				continue;
+			}
+
+			// PPM has no alpha, so it is dropped
+			for (unsigned char *in_pxl = in_row; in_pxl < in_row + row_len; in_pxl += 4, out_pxl += 3) {
+				out_pxl[0] = in_pxl[0];
+				out_pxl[1] = in_pxl[1];
+				out_pxl[2] = in_pxl[2];
+			}
+		}
+		unmap_output_file(out, size, size, fd);
+	}
+}
+
+/**
+ * Writes the image in img_datap->arrays[0] to a file in the format of its extension (a PNG input written as PNG keeps its png info)
+ * @param img_datap : pointer to struct storing the image
+ * @param filename : filepath of the output image
+ */
+void write_image(struct Img_Data *img_datap, char *filename) {
+	if (image_format(filename) == FORMAT_PNG && img_datap->png_ptr) {
+		copy_row_pointers_and_arr(img_datap, 0, 0);
+		write_png(img_datap, filename);
+		return;
+	}
+
+	write_image_pixels(filename, img_datap->arrays[0], img_datap->width, img_datap->height, img_datap->row_stride);
+}
+
+/**
+ * Frees an image read with read_image, unmapping it if it was mapped
+ * @param img_datap : pointer to the img_data struct to be freed
+ */
+void free_image(struct Img_Data *img_datap) {
+	if (img_datap->mapped_file) { munmap(img_datap->mapped_file, img_datap->mapped_size); }
+	free_img_data_struct(img_datap);
+}
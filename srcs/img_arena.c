@@ -0,0 +1,132 @@
+// Ivan Bystrov
+// 18 October 2026
+//
+// Allocates the image arrays from an arena of aligned (optionally huge page) mappings that is reused across blurs
+
+// Needed for MAP_ANONYMOUS, MAP_HUGETLB and madvise
+#define _DEFAULT_SOURCE
+
+#include <stdlib.h>
+#include <sys/mman.h>
+#include "img_arena.h"
+#include "error.h"
+
+
+/**
+ * Initializes an empty arena (nothing is mapped until the first allocation)
+ * @param [output] arena : the arena to initialize
+ * @param huge_pages : true to map from the reserved huge pages (falls back to advised pages if there are none)
+ */
+void init_img_arena(struct Img_Arena *arena, bool huge_pages) {
+	arena->num_blocks = 0;
+	arena->block = 0;
+	arena->used = 0;
+	arena->huge_pages = huge_pages;
+}
+
+/**
+ * Maps a new block for an arena
+ * @param arena : the arena the block is for
+ * @param size : size of the block in bytes (a multiple of ARENA_BLOCK_SIZE)
+ * @return start of the block
+ */
+static unsigned char *map_arena_block(struct Img_Arena *arena, size_t size) {
+	void *base = MAP_FAILED;
+
+#ifdef MAP_HUGETLB
+	// Take the block from the reserved huge pages if asked to (fails if not enough of them are reserved)
+	if (arena->huge_pages) {
+		base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	}
+#endif
+
+	if (base == MAP_FAILED) {
+		base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (base == MAP_FAILED) { error("could not map image arena\n"); }
+
+#ifdef MADV_HUGEPAGE
+		// Ask for transparent huge pages so the passes walking down columns miss the tlb less (only advice, so failing is fine)
+		madvise(base, size, MADV_HUGEPAGE);
+#endif
+	}
+
+	return base;
+}
+
+/**
+ * Allocates memory from an arena, aligned to IMG_ALIGNMENT (the memory is not zeroed, it can hold an earlier job's pixels)
+ * @param arena : the arena to allocate from
+ * @param size : size of the allocation in bytes
+ * @return the allocated memory
+ */
+void *arena_alloc(struct Img_Arena *arena, size_t size) {
+	// Keep every allocation (and so the next one) aligned
+	size = (size + IMG_ALIGNMENT - 1) / IMG_ALIGNMENT * IMG_ALIGNMENT;
+
+	// Move on to the first block from the current one the allocation fits in
+	while (arena->block < arena->num_blocks && arena->used + size > arena->blocks[arena->block].size) {
+		++arena->block;
+		arena->used = 0;
+	}
+
+	// Map a new block if none of them have room left, at least as large as all the blocks before it so the arena doubles each time it grows
+	// (many small allocations then take a few blocks, rather than one block each)
+	if (arena->block == arena->num_blocks) {
+		if (arena->num_blocks == MAX_ARENA_BLOCKS) { error("image arena has too many blocks\n"); }
+
+		size_t block_size = (size + ARENA_BLOCK_SIZE - 1) / ARENA_BLOCK_SIZE * ARENA_BLOCK_SIZE;
+		size_t arena_size = 0;
+		for (unsigned i = 0; i < arena->num_blocks; ++i) { arena_size += arena->blocks[i].size; }
+		if (block_size < arena_size) { block_size = arena_size; }
+		arena->blocks[arena->num_blocks].base = map_arena_block(arena, block_size);
+		arena->blocks[arena->num_blocks].size = block_size;
+		++arena->num_blocks;
+	}
+
+	unsigned char *allocation = arena->blocks[arena->block].base + arena->used;
+	arena->used += size;
+	return allocation;
+}
+
+/**
+ * Gets how much of an arena has been handed out
+ * @param arena : the arena
+ * @return the mark to give to release_to_arena_mark
+ */
+struct Arena_Mark arena_mark(struct Img_Arena *arena) {
+	struct Arena_Mark mark = { arena->block, arena->used };
+	return mark;
+}
+
+/**
+ * Releases everything allocated from an arena after a mark was taken, so it is handed out again by the next allocations
+ * @param arena : the arena
+ * @param mark : the mark taken before the allocations to release
+ */
+void release_to_arena_mark(struct Img_Arena *arena, struct Arena_Mark mark) {
+	arena->block = mark.block;
+	arena->used = mark.used;
+}
+
+/**
+ * Unmaps all the memory of an arena (everything allocated from it is invalid afterwards)
+ * @param arena : the arena to release
+ */
+void release_img_arena(struct Img_Arena *arena) {
+	for (unsigned i = 0; i < arena->num_blocks; ++i) {
+		munmap(arena->blocks[i].base, arena->blocks[i].size);
+	}
+	init_img_arena(arena, arena->huge_pages);
+}
+
+/**
+ * Gets the padded row stride of an image, a multiple of IMG_ALIGNMENT that is an odd number of cache lines,
+ * so the pixels of a column don't all map to the same few cache sets when the vertical pass walks down it
+ * @param row_len : length of the pixels of one row in bytes
+ * @return the row stride in bytes
+ */
+unsigned padded_row_stride(unsigned row_len) {
+	unsigned lines = (row_len + IMG_ALIGNMENT - 1) / IMG_ALIGNMENT;
+	if (lines % 2 == 0) { ++lines; }
+	return lines * IMG_ALIGNMENT;
+}
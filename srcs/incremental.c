@@ -0,0 +1,91 @@
+// Ivan Bystrov
+// 18 October 2026
+//
+// Finds what changed since the previous frame so only the affected parts of the output get blurred again
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "incremental.h"
+#include "error.h"
+
+
+/**
+ * Checks if a tile of the current input image is different in the previous input image
+ * @param img_datap : struct storing the current input image (in img_datap->arrays[0])
+ * @param prev_img_datap : struct storing the previous input image (in prev_img_datap->arrays[0])
+ * @param tile : the pixels of the tile
+ * @return true if any pixel of the tile changed, false otherwise
+ */
+bool tile_changed(struct Img_Data *img_datap, struct Img_Data *prev_img_datap, struct Region tile) {
+	size_t tile_row_start = (size_t) tile.x * img_datap->pixel_length;
+	size_t tile_row_len = (size_t) tile.width * img_datap->pixel_length;
+	
+	for (unsigned row = tile.y; row < tile.y + tile.height; ++row) {
+		unsigned char *pxls = img_datap->arrays[0] + (size_t) row * img_datap->row_stride + tile_row_start;
+		unsigned char *prev_pxls = prev_img_datap->arrays[0] + (size_t) row * prev_img_datap->row_stride + tile_row_start;
+		if (memcmp(pxls, prev_pxls, tile_row_len)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * Finds the regions of the output image that have to be blurred again because the input image changed since the previous frame
+ * @param img_datap : struct storing the current input image (in img_datap->arrays[0])
+ * @param prev_img_datap : struct storing the previous input image (in prev_img_datap->arrays[0], must be the same size)
+ * @param offset : the index of the target pixel in the gaussian kernel (how far a changed input pixel spreads in the output)
+ * @param [output] regions : pointer to where the (malloced) array of regions is stored
+ * @return the number of regions
+ */
+unsigned find_changed_regions(struct Img_Data *img_datap, struct Img_Data *prev_img_datap, unsigned offset, struct Region **regions) {
+	unsigned width = img_datap->width;
+	unsigned height = img_datap->height;
+	unsigned tiles_x = (width + CHANGE_TILE_SIZE - 1) / CHANGE_TILE_SIZE;
+	unsigned tiles_y = (height + CHANGE_TILE_SIZE - 1) / CHANGE_TILE_SIZE;
+	
+	unsigned char *dirty_tiles = calloc((size_t) tiles_x * tiles_y, sizeof(unsigned char));
+	if (dirty_tiles == NULL) { error("could not allocate changed tile map\n"); }
+
+	// Compare each tile of the input images, and mark every output tile a changed tile's pixels can reach through the kernel
+	for (unsigned tile_row = 0; tile_row < tiles_y; ++tile_row) {
+		for (unsigned tile_col = 0; tile_col < tiles_x; ++tile_col) {
+			struct Region tile = { tile_col * CHANGE_TILE_SIZE, tile_row * CHANGE_TILE_SIZE, CHANGE_TILE_SIZE, CHANGE_TILE_SIZE };
+			clip_regions(&tile, 1, width, height);
+			if (!tile_changed(img_datap, prev_img_datap, tile)) { continue; }
+
+			struct Region reach = expand_region(tile, offset, offset, width, height);
+			unsigned last_col = (reach.x + reach.width - 1) / CHANGE_TILE_SIZE;
+			unsigned last_row = (reach.y + reach.height - 1) / CHANGE_TILE_SIZE;
+			for (unsigned row = reach.y / CHANGE_TILE_SIZE; row <= last_row; ++row) {
+				memset(dirty_tiles + row * tiles_x + reach.x / CHANGE_TILE_SIZE, 1, last_col - reach.x / CHANGE_TILE_SIZE + 1);
+			}
+		}
+	}
+
+	unsigned num_regions = regions_from_tile_map(dirty_tiles, CHANGE_TILE_SIZE, width, height, regions);
+	free(dirty_tiles);
+	return num_regions;
+}
+
+/**
+ * Copies the blurred regions in img_datap->arrays[0] over the previous output image, making it the output of the current frame
+ * @param img_datap : struct storing the blurred current image
+ * @param prev_out_datap : struct storing the previous output image (in prev_out_datap->arrays[0], must be the same size)
+ * @param regions : the regions that were blurred again
+ * @param num_regions : number of regions
+ */
+void update_previous_output(struct Img_Data *img_datap, struct Img_Data *prev_out_datap, struct Region *regions, unsigned num_regions) {
+	unsigned pxl_length = img_datap->pixel_length;
+
+	for (unsigned i = 0; i < num_regions; ++i) {
+		struct Region region = regions[i];
+		for (unsigned row = region.y; row < region.y + region.height; ++row) {
+			unsigned char *blurred = img_datap->arrays[0] + (size_t) row * img_datap->row_stride + (size_t) region.x * pxl_length;
+			unsigned char *prev_out = prev_out_datap->arrays[0] + (size_t) row * prev_out_datap->row_stride + (size_t) region.x * pxl_length;
+			memcpy(prev_out, blurred, (size_t) region.width * pxl_length);
+		}
+	}
+}
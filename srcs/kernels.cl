@@ -6,23 +6,24 @@
 
 __constant sampler_t sampler = CLK_NORMALIZED_COORDS_FALSE | CLK_FILTER_NEAREST |  CLK_ADDRESS_CLAMP_TO_EDGE;
 
+// Sampler for the linear kernels, which read between two pixels to get both of them weighted in one fetch (needs CL_UNORM_INT8 images)
+__constant sampler_t linear_sampler = CLK_NORMALIZED_COORDS_FALSE | CLK_FILTER_LINEAR |  CLK_ADDRESS_CLAMP_TO_EDGE;
+
 /*
-/ Kernel blurs all pixels in in_img and writes to out_img, this is the first pass of the blur
+/ Blurs one pixel of in_img horizontally, this is the first pass of the blur
 / @param in_img : the original input image
-/ @param out_img : the output image after the first blurring pass
+/ @param coord : the coordinates of the pixel to blur
 / @param gaussian_kernel : pointer to global memory where gaussian_kernel is stored
+/ @param gaussian_kernel_len : the length of the gaussian kernel
+/ @param offset : the index of the target pixel in the gaussian kernel
+/ @return the blurred pixel (with the alpha component of the original pixel)
 */
-__kernel void first_pass_blur(read_only image2d_t in_img,	
-						write_only image2d_t out_img, 
-						__constant float *gaussian_kernel)
+uint4 first_pass_pixel(read_only image2d_t in_img, int2 coord, __constant float *gaussian_kernel, uint gaussian_kernel_len, uint offset)
 {
-	// Get the coordinates of the pixel to be blurred, return early if it is out of bounds of image
-	int2 coord = (int2) (get_global_id(0), get_global_id(1));
-	
 	// Loop over each element of the gaussian kernel and add the multiplication to sum_rgb0
 	float4 sum_rgb0 = (float4) (0, 0, 0, 0);
-	for (uint i = 0; i < GAUSSIAN_KERNEL_LEN; ++i) {
-			int2 pxl_coord = (int2) (coord.x - OFFSET + i, coord.y);
+	for (uint i = 0; i < gaussian_kernel_len; ++i) {
+			int2 pxl_coord = (int2) (coord.x - offset + i, coord.y);
 			uint4 pxl_u = (uint4) read_imageui(in_img, sampler, pxl_coord);
 			float4 pxl_f = convert_float4(pxl_u);
 			sum_rgb0 += pxl_f * gaussian_kernel[i];
@@ -32,9 +33,67 @@ __kernel void first_pass_blur(read_only image2d_t in_img,
 	uint4 original_pxl = (uint4) read_imageui(in_img, sampler, coord);
 	uint4 out_rgba = convert_uint4(sum_rgb0);
 	out_rgba.w = original_pxl.w;
-	
-	// Write the new pixel to the new image
-	write_imageui(out_img, coord, out_rgba); 
+	return out_rgba;
+}
+
+
+/*
+/ Calculates the weighted sum of the pixels the gaussian kernel covers vertically around one pixel of in_img, without rounding it
+/ @param in_img : the intermidiate input image
+/ @param coord : the coordinates of the pixel to blur
+/ @param gaussian_kernel : pointer to global memory where gaussian_kernel is stored
+/ @param gaussian_kernel_len : the length of the gaussian kernel
+/ @param offset : the index of the target pixel in the gaussian kernel
+/ @return the weighted sum of every component
+*/
+float4 second_pass_sum(read_only image2d_t in_img, int2 coord, __constant float *gaussian_kernel, uint gaussian_kernel_len, uint offset)
+{
+	// Loop over each element of the gaussian kernel and add the multiplication to sum_rgb0
+	float4 sum_rgb0 = (float4) (0, 0, 0, 0);
+	for (uint i = 0; i < gaussian_kernel_len; ++i) {
+			int2 pxl_coord = (int2) (coord.x, coord.y - offset + i);
+			uint4 pxl_u = (uint4) read_imageui(in_img, sampler, pxl_coord);
+			float4 pxl_f = convert_float4_rte(pxl_u);
+			sum_rgb0 += pxl_f * gaussian_kernel[i];
+	}
+	return sum_rgb0;
+}
+
+
+/*
+/ Blurs one pixel of in_img vertically, this is the second pass of the blur
+/ @param in_img : the intermidiate input image
+/ @param coord : the coordinates of the pixel to blur
+/ @param gaussian_kernel : pointer to global memory where gaussian_kernel is stored
+/ @param gaussian_kernel_len : the length of the gaussian kernel
+/ @param offset : the index of the target pixel in the gaussian kernel
+/ @return the blurred pixel (with the alpha component of the original pixel)
+*/
+uint4 second_pass_pixel(read_only image2d_t in_img, int2 coord, __constant float *gaussian_kernel, uint gaussian_kernel_len, uint offset)
+{
+	float4 sum_rgb0 = second_pass_sum(in_img, coord, gaussian_kernel, gaussian_kernel_len, offset);
+
+	// Initialize the output vector which also includes alpha component of the original pixel
+	uint4 original_pxl = (uint4) read_imageui(in_img, sampler, coord);
+	uint4 out_rgba = convert_uint4_sat_rte(sum_rgb0);
+	out_rgba.w = original_pxl.w;
+	return out_rgba;
+}
+
+
+/*
+/ Kernel blurs all pixels in in_img and writes to out_img, this is the first pass of the blur
+/ @param in_img : the original input image
+/ @param out_img : the output image after the first blurring pass
+/ @param gaussian_kernel : pointer to global memory where gaussian_kernel is stored
+*/
+__kernel void first_pass_blur(read_only image2d_t in_img,	
+						write_only image2d_t out_img, 
+						__constant float *gaussian_kernel)
+{
+	// Get the coordinates of the pixel to be blurred and write the new pixel to the new image
+	int2 coord = (int2) (get_global_id(0), get_global_id(1));
+	write_imageui(out_img, coord, first_pass_pixel(in_img, coord, gaussian_kernel, GAUSSIAN_KERNEL_LEN, OFFSET)); 
 }
 
 
@@ -48,23 +107,448 @@ __kernel void second_pass_blur(read_only image2d_t in_img,
 						write_only image2d_t out_img, 
 						__constant float *gaussian_kernel)
 {
-	// Get the coordinates of the pixel to be blurred, return early if it is out of bounds of image
+	// Get the coordinates of the pixel to be blurred and write the new pixel to the new image
+	int2 coord = (int2) (get_global_id(0), get_global_id(1));
+	write_imageui(out_img, coord, second_pass_pixel(in_img, coord, gaussian_kernel, GAUSSIAN_KERNEL_LEN, OFFSET)); 
+}
+
+
+/*
+/ Same as first_pass_blur, but the length of the gaussian kernel is an argument instead of being built into the program
+/ (so a program can be reused for kernels of any length, like the levels of a scale space)
+/ @param gaussian_kernel_len : the length of the gaussian kernel
+/ @param offset : the index of the target pixel in the gaussian kernel
+*/
+__kernel void first_pass_blur_any_len(read_only image2d_t in_img,	
+						write_only image2d_t out_img, 
+						__constant float *gaussian_kernel,
+						uint gaussian_kernel_len,
+						uint offset)
+{
+	int2 coord = (int2) (get_global_id(0), get_global_id(1));
+	write_imageui(out_img, coord, first_pass_pixel(in_img, coord, gaussian_kernel, gaussian_kernel_len, offset)); 
+}
+
+
+/*
+/ Same as second_pass_blur, but the length of the gaussian kernel is an argument instead of being built into the program
+/ @param gaussian_kernel_len : the length of the gaussian kernel
+/ @param offset : the index of the target pixel in the gaussian kernel
+*/
+__kernel void second_pass_blur_any_len(read_only image2d_t in_img,	
+						write_only image2d_t out_img, 
+						__constant float *gaussian_kernel,
+						uint gaussian_kernel_len,
+						uint offset)
+{
+	int2 coord = (int2) (get_global_id(0), get_global_id(1));
+	write_imageui(out_img, coord, second_pass_pixel(in_img, coord, gaussian_kernel, gaussian_kernel_len, offset)); 
+}
+
+
+/*
+/ Blurs one pixel of in_img (a CL_UNORM_INT8 image) in one direction with merged taps, each fetch reads two neighbouring pixels at once
+/ @param in_img : the image to blur
+/ @param coord : the coordinates of the pixel to blur
+/ @param direction : (1, 0) to blur horizontally, (0, 1) to blur vertically
+/ @param linear_taps : pointer to global memory where the merged taps (offset from the target pixel, weight) are stored
+/ @param num_linear_taps : the number of merged taps
+/ @return the blurred pixel (with the alpha component of the original pixel)
+*/
+float4 linear_pass_pixel(read_only image2d_t in_img, int2 coord, float2 direction, __constant float2 *linear_taps, uint num_linear_taps)
+{
+	// With linear filtering the centre of a pixel is at + 0.5, so an offset between two pixels blends them by the fraction
+	float2 centre = convert_float2(coord) + 0.5f;
+	float4 sum_rgb0 = (float4) (0, 0, 0, 0);
+	for (uint i = 0; i < num_linear_taps; ++i) {
+		sum_rgb0 += read_imagef(in_img, linear_sampler, centre + direction * linear_taps[i].x) * linear_taps[i].y;
+	}
+
+	sum_rgb0.w = read_imagef(in_img, sampler, coord).w;
+	return sum_rgb0;
+}
+
+
+/*
+/ Same as first_pass_blur_any_len, but for CL_UNORM_INT8 images with merged taps (so about half the fetches)
+/ @param linear_taps : pointer to global memory where the merged taps (offset from the target pixel, weight) are stored
+/ @param num_linear_taps : the number of merged taps
+*/
+__kernel void first_pass_blur_linear(read_only image2d_t in_img,	
+						write_only image2d_t out_img, 
+						__constant float2 *linear_taps,
+						uint num_linear_taps)
+{
+	int2 coord = (int2) (get_global_id(0), get_global_id(1));
+	write_imagef(out_img, coord, linear_pass_pixel(in_img, coord, (float2) (1, 0), linear_taps, num_linear_taps)); 
+}
+
+
+/*
+/ Same as second_pass_blur_any_len, but for CL_UNORM_INT8 images with merged taps (so about half the fetches)
+/ @param linear_taps : pointer to global memory where the merged taps (offset from the target pixel, weight) are stored
+/ @param num_linear_taps : the number of merged taps
+*/
+__kernel void second_pass_blur_linear(read_only image2d_t in_img,	
+						write_only image2d_t out_img, 
+						__constant float2 *linear_taps,
+						uint num_linear_taps)
+{
+	int2 coord = (int2) (get_global_id(0), get_global_id(1));
+	write_imagef(out_img, coord, linear_pass_pixel(in_img, coord, (float2) (0, 1), linear_taps, num_linear_taps)); 
+}
+
+
+/*
+/ Loads 4 neighbouring RGBA pixels of a row of a packed buffer, clamping pixels out of bounds of the row to the closest pixel on the edge
+/ (the same as the CLK_ADDRESS_CLAMP_TO_EDGE sampler the image kernels use)
+/ @param row : pointer to the first pixel of the row
+/ @param x : the column of the first of the 4 pixels
+/ @param width : the width of the image in pixels
+/ @return the 4 pixels, one after another
+*/
+float16 load_4_pixels(__global const uchar *row, int x, int width)
+{
+	// Pixels inside the row are loaded with one 16 byte load
+	if (x >= 0 && x + 4 <= width) { return convert_float16(vload16(0, row + x * 4)); }
+
+	return (float16) (convert_float4(vload4(clamp(x + 0, 0, width - 1), row)),
+			convert_float4(vload4(clamp(x + 1, 0, width - 1), row)),
+			convert_float4(vload4(clamp(x + 2, 0, width - 1), row)),
+			convert_float4(vload4(clamp(x + 3, 0, width - 1), row)));
+}
+
+
+/*
+/ Stores up to 4 neighbouring blurred pixels into a row of a packed buffer, with the alpha components of the original pixels
+/ @param in_row : pointer to the first pixel of the row the pixels were blurred from (to get the alpha components)
+/ @param out_row : pointer to the first pixel of the row to store the pixels in
+/ @param x : the column of the first of the 4 pixels
+/ @param end_col : the first column to NOT store a pixel in
+/ @param pxls : the 4 blurred pixels
+*/
+void store_4_pixels(__global const uchar *in_row, __global uchar *out_row, int x, int end_col, uchar16 pxls)
+{
+	if (x + 4 <= end_col) {
+		uchar16 original = vload16(0, in_row + x * 4);
+		pxls.s37bf = original.s37bf;
+		vstore16(pxls, 0, out_row + x * 4);
+		return;
+	}
+
+	uchar4 pxl[] = { pxls.s0123, pxls.s4567, pxls.s89ab, pxls.scdef };
+	for (int i = 0; x + i < end_col; ++i) {
+		pxl[i].w = in_row[(x + i) * 4 + 3];
+		vstore4(pxl[i], x + i, out_row);
+	}
+}
+
+
+/*
+/ Same as first_pass_blur_any_len, but for packed RGBA buffers instead of images (which some devices, like CPUs, emulate slowly)
+/ Each work item blurs 4 neighbouring pixels of a row, so neighbouring work items read neighbouring 16 byte chunks of the row
+/ @param in_buf : the original input image
+/ @param out_buf : the output image after the first blurring pass
+/ @param gaussian_kernel : pointer to global memory where gaussian_kernel is stored
+/ @param gaussian_kernel_len : the length of the gaussian kernel
+/ @param offset : the index of the target pixel in the gaussian kernel
+/ @param width : the width of the image in pixels
+/ @param height : the height of the image in pixels
+/ @param first_col : the first column to blur (the columns of a work item start at first_col + 4 * get_global_id(0))
+/ @param end_col : the first column to NOT blur
+*/
+__kernel void first_pass_blur_buffer(__global const uchar *in_buf,
+						__global uchar *out_buf,
+						__constant float *gaussian_kernel,
+						uint gaussian_kernel_len,
+						uint offset,
+						uint width,
+						uint height,
+						uint first_col,
+						uint end_col)
+{
+	int x = first_col + get_global_id(0) * 4;
+	int y = get_global_id(1);
+	if (x >= (int) end_col || y >= (int) height) { return; }
+
+	__global const uchar *in_row = in_buf + (size_t) y * width * 4;
+	float16 sum_rgb0 = (float16) (0);
+	for (uint i = 0; i < gaussian_kernel_len; ++i) {
+		sum_rgb0 += load_4_pixels(in_row, x - (int) offset + (int) i, width) * gaussian_kernel[i];
+	}
+
+	store_4_pixels(in_row, out_buf + (size_t) y * width * 4, x, end_col, convert_uchar16_sat(sum_rgb0));
+}
+
+
+/*
+/ Same as second_pass_blur_any_len, but for packed RGBA buffers instead of images
+/ Each work item blurs 4 neighbouring pixels of a row, reading whole rows above and below it (so the reads of a work group are coalesced)
+/ @param in_buf : the intermidiate input image
+/ @param out_buf : the output image after the second blurring pass
+/ @param gaussian_kernel : pointer to global memory where gaussian_kernel is stored
+/ @param gaussian_kernel_len : the length of the gaussian kernel
+/ @param offset : the index of the target pixel in the gaussian kernel
+/ @param width : the width of the image in pixels
+/ @param height : the height of the image in pixels
+/ @param first_col : the first column to blur (the columns of a work item start at first_col + 4 * get_global_id(0))
+/ @param end_col : the first column to NOT blur
+*/
+__kernel void second_pass_blur_buffer(__global const uchar *in_buf,
+						__global uchar *out_buf,
+						__constant float *gaussian_kernel,
+						uint gaussian_kernel_len,
+						uint offset,
+						uint width,
+						uint height,
+						uint first_col,
+						uint end_col)
+{
+	int x = first_col + get_global_id(0) * 4;
+	int y = get_global_id(1);
+	if (x >= (int) end_col || y >= (int) height) { return; }
+
+	float16 sum_rgb0 = (float16) (0);
+	for (uint i = 0; i < gaussian_kernel_len; ++i) {
+		int row = clamp(y - (int) offset + (int) i, 0, (int) height - 1);
+		sum_rgb0 += load_4_pixels(in_buf + (size_t) row * width * 4, x, width) * gaussian_kernel[i];
+	}
+
+	store_4_pixels(in_buf + (size_t) y * width * 4, out_buf + (size_t) y * width * 4, x, end_col, convert_uchar16_sat_rte(sum_rgb0));
+}
+
+
+/*
+/ Gets the pixel of a line that a pixel of the line downscaled is sampled at (the same as SAMPLE_POSITION in blur_helpers.h)
+/ @param i : the pixel of the downscaled line
+/ @param in_len : the length of the line in pixels
+/ @param out_len : the length of the downscaled line in pixels
+/ @return the pixel of the line under the centre of the footprint of pixel i
+*/
+uint sample_position(uint i, uint in_len, uint out_len)
+{
+	return (uint) ((2 * (ulong) i + 1) * in_len / (2 * (ulong) out_len));
+}
+
+
+/*
+/ First pass of the downscaling blur, blurs horizontally only the columns of in_img the downscaled image samples (but every row)
+/ @param in_img : the original input image
+/ @param out_img : the output image after the first pass (as wide as the downscaled image, as high as in_img)
+/ @param gaussian_kernel : pointer to global memory where gaussian_kernel is stored
+/ @param gaussian_kernel_len : the length of the gaussian kernel
+/ @param offset : the index of the target pixel in the gaussian kernel
+*/
+__kernel void first_pass_blur_resized(read_only image2d_t in_img,	
+						write_only image2d_t out_img, 
+						__constant float *gaussian_kernel,
+						uint gaussian_kernel_len,
+						uint offset)
+{
+	int2 coord = (int2) (get_global_id(0), get_global_id(1));
+	int2 sample = (int2) (sample_position(coord.x, get_image_width(in_img), get_image_width(out_img)), coord.y);
+	write_imageui(out_img, coord, first_pass_pixel(in_img, sample, gaussian_kernel, gaussian_kernel_len, offset)); 
+}
+
+
+/*
+/ Second pass of the downscaling blur, blurs vertically only the rows the downscaled image samples
+/ @param in_img : the intermidiate input image (as wide as the downscaled image, as high as the original input image)
+/ @param out_img : the downscaled output image
+/ @param gaussian_kernel : pointer to global memory where gaussian_kernel is stored
+/ @param gaussian_kernel_len : the length of the gaussian kernel
+/ @param offset : the index of the target pixel in the gaussian kernel
+*/
+__kernel void second_pass_blur_resized(read_only image2d_t in_img,	
+						write_only image2d_t out_img, 
+						__constant float *gaussian_kernel,
+						uint gaussian_kernel_len,
+						uint offset)
+{
+	int2 coord = (int2) (get_global_id(0), get_global_id(1));
+	int2 sample = (int2) (coord.x, sample_position(coord.y, get_image_height(in_img), get_image_height(out_img)));
+	write_imageui(out_img, coord, second_pass_pixel(in_img, sample, gaussian_kernel, gaussian_kernel_len, offset)); 
+}
+
+
+/*
+/ Second pass of the blur fused with an unsharp mask, writes original + amount * (original - blurred) instead of the blurred pixel
+/ @param in_img : the intermidiate input image
+/ @param original_img : the original input image
+/ @param out_img : the sharpened output image
+/ @param gaussian_kernel : pointer to global memory where gaussian_kernel is stored
+/ @param gaussian_kernel_len : the length of the gaussian kernel
+/ @param offset : the index of the target pixel in the gaussian kernel
+/ @param amount : how much to sharpen
+*/
+__kernel void second_pass_blur_unsharp(read_only image2d_t in_img,
+						read_only image2d_t original_img,
+						write_only image2d_t out_img, 
+						__constant float *gaussian_kernel,
+						uint gaussian_kernel_len,
+						uint offset,
+						float amount)
+{
+	int2 coord = (int2) (get_global_id(0), get_global_id(1));
+	float4 blurred = second_pass_sum(in_img, coord, gaussian_kernel, gaussian_kernel_len, offset);
+	uint4 original_pxl = read_imageui(original_img, sampler, coord);
+	float4 original = convert_float4(original_pxl);
+
+	uint4 out_rgba = convert_uint4_sat_rte(original + amount * (original - blurred));
+	out_rgba.w = original_pxl.w;
+	write_imageui(out_img, coord, out_rgba); 
+}
+
+
+/*
+/ First pass of a difference of gaussians, blurs in_img horizontally with both gaussian kernels, reading each pixel once for both
+/ @param in_img : the original input image
+/ @param out_img : the output image after the first pass with gaussian_kernel
+/ @param dog_out_img : the output image after the first pass with dog_kernel
+/ @param gaussian_kernel : pointer to global memory where gaussian_kernel is stored
+/ @param gaussian_kernel_len : the length of the gaussian kernel
+/ @param offset : the index of the target pixel in the gaussian kernel
+/ @param dog_kernel : pointer to global memory where the kernel of the blur that is subtracted is stored
+/ @param dog_kernel_len : the length of dog_kernel
+/ @param dog_offset : the index of the target pixel in dog_kernel
+*/
+__kernel void first_pass_blur_dog(read_only image2d_t in_img,
+						write_only image2d_t out_img, 
+						write_only image2d_t dog_out_img, 
+						__constant float *gaussian_kernel,
+						uint gaussian_kernel_len,
+						uint offset,
+						__constant float *dog_kernel,
+						uint dog_kernel_len,
+						uint dog_offset)
+{
+	int2 coord = (int2) (get_global_id(0), get_global_id(1));
+
+	// Loop over the taps of the longer kernel, adding each pixel to the sums of the kernels that cover it
+	int max_offset = max(offset, dog_offset);
+	float4 sum_rgb0 = (float4) (0, 0, 0, 0);
+	float4 dog_sum_rgb0 = (float4) (0, 0, 0, 0);
+	for (int i = -max_offset; i <= max_offset; ++i) {
+			uint4 pxl_u = (uint4) read_imageui(in_img, sampler, (int2) (coord.x + i, coord.y));
+			float4 pxl_f = convert_float4(pxl_u);
+			if (abs(i) <= offset) { sum_rgb0 += pxl_f * gaussian_kernel[offset + i]; }
+			if (abs(i) <= dog_offset) { dog_sum_rgb0 += pxl_f * dog_kernel[dog_offset + i]; }
+	}
+
+	// Both outputs keep the alpha component of the original pixel, like first_pass_pixel
+	uint4 original_pxl = (uint4) read_imageui(in_img, sampler, coord);
+	uint4 out_rgba = convert_uint4(sum_rgb0);
+	uint4 dog_out_rgba = convert_uint4(dog_sum_rgb0);
+	out_rgba.w = original_pxl.w;
+	dog_out_rgba.w = original_pxl.w;
+	write_imageui(out_img, coord, out_rgba); 
+	write_imageui(dog_out_img, coord, dog_out_rgba); 
+}
+
+
+/*
+/ Second pass of a difference of gaussians, blurs both first pass images vertically and writes 128 + the difference of the blurs
+/ @param in_img : the intermidiate input image of gaussian_kernel
+/ @param dog_in_img : the intermidiate input image of dog_kernel
+/ @param out_img : the output image
+/ @param gaussian_kernel : pointer to global memory where gaussian_kernel is stored
+/ @param gaussian_kernel_len : the length of the gaussian kernel
+/ @param offset : the index of the target pixel in the gaussian kernel
+/ @param dog_kernel : pointer to global memory where the kernel of the blur that is subtracted is stored
+/ @param dog_kernel_len : the length of dog_kernel
+/ @param dog_offset : the index of the target pixel in dog_kernel
+*/
+__kernel void second_pass_blur_dog(read_only image2d_t in_img,
+						read_only image2d_t dog_in_img,
+						write_only image2d_t out_img, 
+						__constant float *gaussian_kernel,
+						uint gaussian_kernel_len,
+						uint offset,
+						__constant float *dog_kernel,
+						uint dog_kernel_len,
+						uint dog_offset)
+{
 	int2 coord = (int2) (get_global_id(0), get_global_id(1));
-	
+	float4 blurred = second_pass_sum(in_img, coord, gaussian_kernel, gaussian_kernel_len, offset);
+	float4 dog_blurred = second_pass_sum(dog_in_img, coord, dog_kernel, dog_kernel_len, dog_offset);
+
+	uint4 original_pxl = (uint4) read_imageui(in_img, sampler, coord);
+	uint4 out_rgba = convert_uint4_sat_rte(128 + blurred - dog_blurred);
+	out_rgba.w = original_pxl.w;
+	write_imageui(out_img, coord, out_rgba); 
+}
+
+
+/*
+/ First pass of the batched blur, blurs one pixel of one layer of in_img horizontally (the layers are separate images of up to the size of the array)
+/ Each layer clamps at the edges of its own image, so the result is the same as first_pass_blur on that image alone
+/ @param in_img : the original input images, one per layer
+/ @param out_img : the output images after the first pass, one per layer
+/ @param gaussian_kernel : pointer to global memory where gaussian_kernel is stored
+/ @param gaussian_kernel_len : the length of the gaussian kernel
+/ @param offset : the index of the target pixel in the gaussian kernel
+/ @param layer_sizes : the width and height of the image in each layer
+*/
+__kernel void first_pass_blur_batch(read_only image2d_array_t in_img,
+						write_only image2d_array_t out_img, 
+						__constant float *gaussian_kernel,
+						uint gaussian_kernel_len,
+						uint offset,
+						__global const int2 *layer_sizes)
+{
+	int4 coord = (int4) (get_global_id(0), get_global_id(1), get_global_id(2), 0);
+	int2 size = layer_sizes[coord.z];
+	if (coord.x >= size.x || coord.y >= size.y) { return; }
+
+	// Loop over each element of the gaussian kernel and add the multiplication to sum_rgb0
+	float4 sum_rgb0 = (float4) (0, 0, 0, 0);
+	for (uint i = 0; i < gaussian_kernel_len; ++i) {
+			int4 pxl_coord = (int4) (clamp((int) (coord.x - offset + i), 0, size.x - 1), coord.y, coord.z, 0);
+			uint4 pxl_u = (uint4) read_imageui(in_img, sampler, pxl_coord);
+			float4 pxl_f = convert_float4(pxl_u);
+			sum_rgb0 += pxl_f * gaussian_kernel[i];
+	}
+
+	// Same rounding as first_pass_pixel, and the alpha component of the original pixel
+	uint4 original_pxl = (uint4) read_imageui(in_img, sampler, coord);
+	uint4 out_rgba = convert_uint4(sum_rgb0);
+	out_rgba.w = original_pxl.w;
+	write_imageui(out_img, coord, out_rgba); 
+}
+
+
+/*
+/ Second pass of the batched blur, blurs one pixel of one layer of in_img vertically
+/ @param in_img : the intermidiate input images, one per layer
+/ @param out_img : the output images after the second pass, one per layer
+/ @param gaussian_kernel : pointer to global memory where gaussian_kernel is stored
+/ @param gaussian_kernel_len : the length of the gaussian kernel
+/ @param offset : the index of the target pixel in the gaussian kernel
+/ @param layer_sizes : the width and height of the image in each layer
+*/
+__kernel void second_pass_blur_batch(read_only image2d_array_t in_img,
+						write_only image2d_array_t out_img, 
+						__constant float *gaussian_kernel,
+						uint gaussian_kernel_len,
+						uint offset,
+						__global const int2 *layer_sizes)
+{
+	int4 coord = (int4) (get_global_id(0), get_global_id(1), get_global_id(2), 0);
+	int2 size = layer_sizes[coord.z];
+	if (coord.x >= size.x || coord.y >= size.y) { return; }
+
 	// Loop over each element of the gaussian kernel and add the multiplication to sum_rgb0
 	float4 sum_rgb0 = (float4) (0, 0, 0, 0);
-	for (uint i = 0; i < GAUSSIAN_KERNEL_LEN; ++i) {
-			int2 pxl_coord = (int2) (coord.x, coord.y - OFFSET + i);
+	for (uint i = 0; i < gaussian_kernel_len; ++i) {
+			int4 pxl_coord = (int4) (coord.x, clamp((int) (coord.y - offset + i), 0, size.y - 1), coord.z, 0);
 			uint4 pxl_u = (uint4) read_imageui(in_img, sampler, pxl_coord);
 			float4 pxl_f = convert_float4_rte(pxl_u);
 			sum_rgb0 += pxl_f * gaussian_kernel[i];
 	}
 
-	// Initialize the output vector which also includes alpha component of the original pixel
+	// Same rounding as second_pass_pixel, and the alpha component of the original pixel
 	uint4 original_pxl = (uint4) read_imageui(in_img, sampler, coord);
 	uint4 out_rgba = convert_uint4_sat_rte(sum_rgb0);
 	out_rgba.w = original_pxl.w;
-	
-	// Write the new pixel to the new image
 	write_imageui(out_img, coord, out_rgba); 
 }
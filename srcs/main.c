@@ -10,8 +10,18 @@
 #include <ctype.h>
 #include <stdbool.h>
 #include "process_png.h"
+#include "image_io.h"
 #include "blur_cpu.h"
 #include "blur_gpu.h"
+#include "blur_helpers.h"
+#include "incremental.h"
+#include "stream.h"
+#include "scale_space.h"
+#include "auto_select.h"
+#include "resize.h"
+#include "flat_tiles.h"
+#include "batch.h"
+#include "affinity.h"
 #include "error.h"
 
 #define OUTPUT_MODIFIER "_gb"
@@ -20,15 +30,71 @@
 /**
  * Command line input parameters to the program
  * filename : filename of the input image
- * std_dev : standard deviation of the gaussian blur (must be pos int)
- * device : device to run this program on (must be 'c' for cpu or 'g' for gpu)
+ * std_dev : standard deviation of the gaussian blur (must be pos int), the first of std_devs
+ * std_devs : every standard deviation to blur with (malloced, more than one means a scale space is output)
+ * num_std_devs : number of standard deviations in std_devs
+ * device : device to run this program on (must be 'c' for cpu, 'g' for gpu or 'a' to pick one automatically, which is replaced by the picked one)
  * threads : number of threads (only set if device = gpu) 
+ * planar : 1 means the cpu blur works on per channel planes instead of interleaved RGBA pixels, 0 otherwise
+ * gpu_memory : 'i' means the gpu blur uses images, 'b' means packed RGBA buffers, 'a' means images on gpus and buffers on other OpenCL devices
+ * gpu_bands : number of horizontal bands the gpu blur uploads, blurs and downloads at the same time (1 means no bands)
+ * linear : 1 means the gpu blur merges pairs of taps into one fetch with linear filtering, 0 otherwise
+ * approx : 1 means the cpu blur is approximated with box blurs (if device = 'a' it means the approximate blur may be picked), 0 otherwise
+ * regions : rectangles of the image to blur (malloced, NULL if there are none)
+ * num_regions : number of rectangles in regions
+ * mask_filename : filename of the mask image limiting which pixels are blurred (NULL if there is none)
+ * prev_input_filename : filename of the previous frame's input image in incremental mode (NULL if not incremental)
+ * prev_output_filename : filename of the previous frame's blurred output image in incremental mode (NULL if not incremental)
+ * stream_width : width of the raw frames read from stdin in stream mode (0 if not streaming)
+ * stream_height : height of the raw frames read from stdin in stream mode (0 if not streaming)
+ * scale : factor in (0, 1] to downscale the blurred image by (0 if not given)
+ * out_width : width to downscale the blurred image to (0 if not given, set from scale once the image is read)
+ * out_height : height to downscale the blurred image to (0 if not given, set from scale once the image is read)
+ * op : the unsharp mask or difference of gaussians to output instead of the blurred image (type is 0 if there is none)
+ * row_stride_mode : 'a' pads the rows of the image arrays to an odd number of cache lines, 'p' packs them, 'n' uses row_stride
+ * row_stride : bytes between the starts of two rows of the image arrays (only used if row_stride_mode = 'n')
+ * huge_pages : 1 means the image arrays are mapped from the reserved huge pages, 0 means they are only advised to be huge pages
+ * skip_flat : 1 means tiles whose whole kernel footprint is one colour are left as they are instead of being blurred, 0 otherwise
+ * output_format : extension (without the '.') of the format the output images are written in (NULL means the format of the input image)
+ * perf : 1 means the hardware counters of every cpu thread in every pass are collected and output, 0 otherwise
+ * batch : 1 means filename is a list of images (one per line) that are blurred in batches of the same size class, 0 otherwise
+ * affinity : 'c' pins the cpu threads compactly, 's' scatters them over the NUMA nodes and cores, 'l' pins them to affinity_cpus (0 means they aren't pinned)
+ * affinity_cpus : the cpus of the list the threads are pinned to in order (malloced, only set if affinity = 'l')
+ * num_affinity_cpus : number of cpus in affinity_cpus
  */
 struct Input_Pars {
 	char *filename;
 	unsigned std_dev;
+	unsigned *std_devs;
+	unsigned num_std_devs;
 	char device;
 	unsigned threads;
+	unsigned planar;
+	char gpu_memory;
+	unsigned gpu_bands;
+	unsigned linear;
+	unsigned approx;
+	struct Region *regions;
+	unsigned num_regions;
+	char *mask_filename;
+	char *prev_input_filename;
+	char *prev_output_filename;
+	unsigned stream_width;
+	unsigned stream_height;
+	float scale;
+	unsigned out_width;
+	unsigned out_height;
+	struct Blur_Op op;
+	char row_stride_mode;
+	unsigned row_stride;
+	unsigned huge_pages;
+	unsigned skip_flat;
+	char *output_format;
+	unsigned perf;
+	unsigned batch;
+	char affinity;
+	int *affinity_cpus;
+	unsigned num_affinity_cpus;
 }; 
 
 
@@ -37,11 +103,36 @@ struct Input_Pars {
  * @param program_name : name of this program
  */
 void usage_msg(char *program_name) {
-	fprintf(stderr, "Usage: %s input.png standard_deviation device [threads]\n", program_name);
-	fprintf(stderr, "	input.png = PNG image to be blurred (must be 8 bit, RGBA)\n");
-	fprintf(stderr, "	standard_deviation = 'pos_int'\n");
-	fprintf(stderr, "	device = 'c' for running on cpu, device = 'g' for running on gpu\n");
-	fprintf(stderr, "	if device = 'c', threads = number of threads (no threads specified means 1)\n\n");
+	fprintf(stderr, "Usage: %s input.(png|rgba|pam|ppm|qoi) standard_deviation device [threads] [options]\n", program_name);
+	fprintf(stderr, "       %s --calibrate\n", program_name);
+	fprintf(stderr, "	input = image to be blurred, picked by extension: PNG (must be 8 bit, RGBA), raw RGBA (.rgba), PAM, PPM or QOI,\n");
+	fprintf(stderr, "		or '-' to blur a stream of frames from stdin (needs --stream), or a list of images, one per line (needs --batch)\n");
+	fprintf(stderr, "	standard_deviation = 'pos_int', or increasing 'pos_int,pos_int,...' to output the image blurred with each of them\n");
+	fprintf(stderr, "	device = 'c' for running on cpu, device = 'g' for running on gpu, device = 'a' for picking the fastest device and threads\n");
+	fprintf(stderr, "	if device = 'c', threads = number of threads (no threads specified means 1)\n");
+	fprintf(stderr, "	options:\n");
+	fprintf(stderr, "	--planar = (cpu only) blur separate R, G, B planes instead of interleaved RGBA pixels\n");
+	fprintf(stderr, "	--linear = (gpu only) merge each pair of kernel taps into one fetch with linear filtering\n");
+	fprintf(stderr, "	--gpu-bands N = (gpu only) blur whole images in N horizontal bands, uploading, blurring and downloading different bands at the same time\n");
+	fprintf(stderr, "	--gpu-memory image|buffer = (gpu only) blur OpenCL images or packed RGBA buffers (default is images on gpus, buffers on other OpenCL devices)\n");
+	fprintf(stderr, "	--approx = (cpu only) approximate the blur with box blurs, or (auto only) allow the approximate blur to be picked\n");
+	fprintf(stderr, "	--roi x,y,width,height = only blur this rectangle (can be given more than once)\n");
+	fprintf(stderr, "	--mask mask.png = only blur pixels that are not black in mask.png (must be 8 bit, RGBA, same size as the input image)\n");
+	fprintf(stderr, "	--incremental prev_input prev_output = only blur again the parts of prev_output affected by changes since prev_input\n");
+	fprintf(stderr, "	--stream widthxheight = read raw RGBA frames of this size from stdin and write the blurred frames to stdout\n");
+	fprintf(stderr, "	--unsharp amount = output the image sharpened by amount (original + amount * (original - blurred)) instead of the blurred image\n");
+	fprintf(stderr, "	--dog standard_deviation = output 128 + the difference of the blur and the blur with this standard deviation instead of the blurred image\n");
+	fprintf(stderr, "	--scale factor = downscale the blurred image by factor (0 < factor <= 1), only computing the pixels the output samples\n");
+	fprintf(stderr, "	--size widthxheight = downscale the blurred image to this size (at most the size of the input image), only computing the pixels the output samples\n");
+	fprintf(stderr, "	--skip-flat = don't blur the tiles whose whole kernel footprint is one colour (they are already their blurred value)\n");
+	fprintf(stderr, "	--row-stride auto|packed|bytes = bytes between rows of the image in memory (default auto pads rows to an odd number of cache lines)\n");
+	fprintf(stderr, "	--huge-pages = map the image memory from the reserved huge pages (default only advises transparent huge pages)\n");
+	fprintf(stderr, "	--output-format png|rgba|pam|ppm|qoi = write the output images in this format (default is the format of the input image)\n");
+	fprintf(stderr, "	--perf = (cpu only) count cycles, instructions, cache and TLB misses of every thread in every pass and output them\n");
+	fprintf(stderr, "	--affinity compact|scatter|cpus = (cpu only) pin the threads filling one NUMA node first, spreading them over the nodes and cores first,\n");
+	fprintf(stderr, "		or to a list of cpus like 0,2,4-7 (each band of the image is first touched by the thread that blurs it)\n");
+	fprintf(stderr, "	--batch = blur every image of the input list, the gpu blurs images of the same size class together in one dispatch per pass\n");
+	fprintf(stderr, "	--calibrate = time the devices on this host and write the profile the auto device picks with to ~/" PROFILE_FILENAME "\n\n");
 }
 
 /**
@@ -50,14 +141,71 @@ void usage_msg(char *program_name) {
  * Should be called after parse_input_args() so that input_parameters members are all valid
  */
 void print_input_args(struct Input_Pars *input_parameters) {
-	fprintf(stdout, "Input Image: %s\n", input_parameters->filename);
-	fprintf(stdout, "Standard Deviation: %u\n", input_parameters->std_dev);
+	if (input_parameters->stream_width) {
+		fprintf(stdout, "Input Stream: stdin (%u x %u RGBA frames)\n", input_parameters->stream_width, input_parameters->stream_height);
+	} else if (input_parameters->batch) {
+		fprintf(stdout, "Input List: %s\n", input_parameters->filename);
+	} else {
+		fprintf(stdout, "Input Image: %s\n", input_parameters->filename);
+	}
+	fprintf(stdout, "Standard Deviation: %u", input_parameters->std_devs[0]);
+	for (unsigned i = 1; i < input_parameters->num_std_devs; ++i) {
+		fprintf(stdout, ", %u", input_parameters->std_devs[i]);
+	}
+	fprintf(stdout, "\n");
 	if (input_parameters->device == 'c') {
 		fprintf(stdout, "Device: cpu\n");
 		fprintf(stdout, "Num Threads: %u\n", input_parameters->threads);
+		fprintf(stdout, "Layout: %s\n", input_parameters->planar ? "planar" : "interleaved");
+		if (input_parameters->approx) { fprintf(stdout, "Approximate: box blurs\n"); }
+		if (input_parameters->affinity == 'l') {
+			fprintf(stdout, "Affinity: cpus %d", input_parameters->affinity_cpus[0]);
+			for (unsigned i = 1; i < input_parameters->num_affinity_cpus; ++i) {
+				fprintf(stdout, ",%d", input_parameters->affinity_cpus[i]);
+			}
+			fprintf(stdout, "\n");
+		} else if (input_parameters->affinity) {
+			fprintf(stdout, "Affinity: %s\n", input_parameters->affinity == 'c' ? "compact" : "scatter");
+		}
+	} else if (input_parameters->device == 'a') {
+		fprintf(stdout, "Device: auto%s\n", input_parameters->approx ? " (approximate blur allowed)" : "");
 	} else {
 		fprintf(stdout, "Device: gpu\n");
+		if (input_parameters->linear) { fprintf(stdout, "Sampling: linear (merged taps)\n"); }
+		if (input_parameters->gpu_bands > 1) { fprintf(stdout, "Bands: %u\n", input_parameters->gpu_bands); }
+		if (input_parameters->gpu_memory != 'a') { fprintf(stdout, "Memory: %s\n", input_parameters->gpu_memory == 'b' ? "buffers" : "images"); }
+	}
+	if (input_parameters->num_regions) {
+		fprintf(stdout, "Regions: %u\n", input_parameters->num_regions);
+	}
+	if (input_parameters->mask_filename) {
+		fprintf(stdout, "Mask Image: %s\n", input_parameters->mask_filename);
+	}
+	if (input_parameters->prev_input_filename) {
+		fprintf(stdout, "Previous Input Image: %s\n", input_parameters->prev_input_filename);
+		fprintf(stdout, "Previous Output Image: %s\n", input_parameters->prev_output_filename);
+	}
+	if (input_parameters->skip_flat) {
+		fprintf(stdout, "Flat Tiles: skipped\n");
+	}
+	if (input_parameters->op.type == 'u') {
+		fprintf(stdout, "Operation: unsharp mask (amount %g)\n", input_parameters->op.amount);
+	} else if (input_parameters->op.type == 'd') {
+		fprintf(stdout, "Operation: difference of gaussians (minus standard deviation %u)\n", input_parameters->op.dog_std_dev);
+	}
+	if (input_parameters->scale) {
+		fprintf(stdout, "Downscale: %g\n", input_parameters->scale);
+	} else if (input_parameters->out_width) {
+		fprintf(stdout, "Downscale To: %u x %u\n", input_parameters->out_width, input_parameters->out_height);
+	}
+	if (input_parameters->row_stride_mode == 'p') {
+		fprintf(stdout, "Row Stride: packed\n");
+	} else if (input_parameters->row_stride_mode == 'n') {
+		fprintf(stdout, "Row Stride: %u bytes\n", input_parameters->row_stride);
 	}
+	if (input_parameters->huge_pages) { fprintf(stdout, "Huge Pages: reserved\n"); }
+	if (input_parameters->output_format) { fprintf(stdout, "Output Format: %s\n", input_parameters->output_format); }
+	if (input_parameters->perf) { fprintf(stdout, "Perf Counters: on\n"); }
 	fprintf(stdout, "\n");
 }
 
@@ -76,6 +224,38 @@ bool is_pos_int(char *input) {
 	return !(zero_counter == strlen(input));
 }
 
+/**
+ * Parse a comma separated list of strictly increasing positive integer standard deviations
+ * @param [output] input_parameters : struct for input paramters from command line, std_devs and num_std_devs are set
+ * @param input : the input string to parse
+ * @return true if input is a valid list, false otherwise
+ */
+bool parse_std_devs(struct Input_Pars *input_parameters, char *input) {
+	input_parameters->std_devs = NULL;
+	input_parameters->num_std_devs = 0;
+	
+	// Copy each comma separated value so it can be checked on its own
+	char value[strlen(input) + 1];
+	while (true) {
+		size_t value_len = strcspn(input, ",");
+		memcpy(value, input, value_len);
+		value[value_len] = '\0';
+		if (!is_pos_int(value)) { return false; }
+
+		unsigned std_dev = strtol(value, NULL, 10);
+		unsigned num = input_parameters->num_std_devs;
+		if (num && std_dev <= input_parameters->std_devs[num - 1]) { return false; }
+		
+		input_parameters->std_devs = realloc(input_parameters->std_devs, sizeof(unsigned) * (num + 1));
+		if (input_parameters->std_devs == NULL) { error("could not allocate standard deviations\n"); }
+		input_parameters->std_devs[num] = std_dev;
+		input_parameters->num_std_devs ++;
+
+		if (input[value_len] == '\0') { return true; }
+		input += value_len + 1;
+	}
+}
+
 /** 
  * Parse command line arguments to the program
  * @param [output] input_parameters : struct for input paramters from command line, only set if all valid
@@ -83,81 +263,474 @@ bool is_pos_int(char *input) {
  * @param argv : command line arguments
  */
 void parse_input_args(struct Input_Pars *input_parameters, int argc, char **argv) {
-	// Print usage message if there are not exactly 4 or 3 command line arguments or if -help was input
-	if ((argc != 5 && argc != 4) || !strcmp(argv[1], "-help")) {
+	// Print usage message if there are less than 3 command line arguments or if -help was input
+	if (argc < 4 || !strcmp(argv[1], "-help")) {
 		usage_msg(argv[0]);
 		exit(1);
 	}
 
-	// Print usage message if filename doesn't end in .png
-	char *extension = argv[1] + strlen(argv[1]) - 4;
-	if (strcmp(extension, ".png")) {
-		usage_msg(argv[0]);
-		exit(1);
-	}
+	// Anything that is not '-' for a stream or the extension of a supported format is a list of images (which needs --batch, checked below)
+	bool is_stream = !strcmp(argv[1], "-");
+	bool is_list = !is_stream && image_format(argv[1]) == FORMAT_UNKNOWN;
 	
-	// Print usage message if standard deviation is not a positive integer
-	if (!is_pos_int(argv[2])) {
+	// Print usage message if standard deviation is not a positive integer (or list of increasing positive integers)
+	if (!parse_std_devs(input_parameters, argv[2])) {
 		usage_msg(argv[0]);
 		exit(1);
 	}
 	
-	// Print usage message if device isn't either 'c' or 'g'
-	if (strlen(argv[3]) != 1 || (argv[3][0] != 'c' && argv[3][0] != 'g')) {
+	// Print usage message if device isn't 'c', 'g' or 'a'
+	if (strlen(argv[3]) != 1 || (argv[3][0] != 'c' && argv[3][0] != 'g' && argv[3][0] != 'a')) {
 		usage_msg(argv[0]);
 		exit(1);
 	}
 
+	// The threads argument is present if the 4th argument isn't an option
+	bool has_threads = argc > 4 && strncmp(argv[4], "--", 2);
+
 	// Print usage message if device is 'c' and threads exists and threads is not a positive integer
-	if (argv[3][0] == 'c' && argc == 5 &&  !is_pos_int(argv[4])) {
+	if (argv[3][0] == 'c' && has_threads && !is_pos_int(argv[4])) {
 		usage_msg(argv[0]);
 		exit(1);
 	}
 		
-	// Print usage message if device is 'g' and there is a threads argument
-	if (argv[3][0] == 'g' && argc == 5) {
+	// Print usage message if device is 'g' or 'a' and there is a threads argument (the auto device picks its own)
+	if (argv[3][0] != 'c' && has_threads) {
 		usage_msg(argv[0]);
 		exit(1);
 	}
 
 	// Set the input parameters now that we have confirmed they are valid
 	input_parameters->filename = argv[1];
-	input_parameters->std_dev = strtol(argv[2], NULL, 10);
+	input_parameters->std_dev = input_parameters->std_devs[0];
 	input_parameters->device = argv[3][0];
-	if (argc == 5) {
+	if (has_threads) {
 		input_parameters->threads = strtol(argv[4], NULL, 10);
 	} else {
 		input_parameters->threads = 1;
 	} 
+	input_parameters->planar = 0;
+	input_parameters->gpu_memory = 'a';
+	input_parameters->gpu_bands = 1;
+	input_parameters->linear = 0;
+	input_parameters->approx = 0;
+	input_parameters->regions = NULL;
+	input_parameters->num_regions = 0;
+	input_parameters->mask_filename = NULL;
+	input_parameters->prev_input_filename = NULL;
+	input_parameters->prev_output_filename = NULL;
+	input_parameters->stream_width = 0;
+	input_parameters->stream_height = 0;
+	input_parameters->scale = 0;
+	input_parameters->out_width = 0;
+	input_parameters->out_height = 0;
+	input_parameters->op.type = 0;
+	input_parameters->row_stride_mode = 'a';
+	input_parameters->row_stride = 0;
+	input_parameters->huge_pages = 0;
+	input_parameters->skip_flat = 0;
+	input_parameters->output_format = NULL;
+	input_parameters->perf = 0;
+	input_parameters->batch = 0;
+	input_parameters->affinity = 0;
+	input_parameters->affinity_cpus = NULL;
+	input_parameters->num_affinity_cpus = 0;
+
+	// Parse the options that come after the positional arguments
+	for (int i = has_threads ? 5 : 4; i < argc; ++i) {
+		// Print usage message for unknown options or options that don't apply to the device
+		if (!strcmp(argv[i], "--planar") && input_parameters->device == 'c') {
+			input_parameters->planar = 1;
+		
+		} else if (!strcmp(argv[i], "--linear") && input_parameters->device == 'g') {
+			input_parameters->linear = 1;
+		
+		} else if (!strcmp(argv[i], "--gpu-bands") && i + 1 < argc && input_parameters->device == 'g') {
+			// Print usage message if the number of bands isn't a positive integer
+			if (!is_pos_int(argv[++i])) {
+				usage_msg(argv[0]);
+				exit(1);
+			}
+			input_parameters->gpu_bands = strtol(argv[i], NULL, 10);
+		
+		} else if (!strcmp(argv[i], "--gpu-memory") && i + 1 < argc && input_parameters->device == 'g') {
+			// Print usage message if the memory kind isn't image or buffer
+			i ++;
+			if (!strcmp(argv[i], "image")) {
+				input_parameters->gpu_memory = 'i';
+			} else if (!strcmp(argv[i], "buffer")) {
+				input_parameters->gpu_memory = 'b';
+			} else {
+				usage_msg(argv[0]);
+				exit(1);
+			}
+		
+		} else if (!strcmp(argv[i], "--approx") && input_parameters->device != 'g') {
+			input_parameters->approx = 1;
+		
+		} else if (!strcmp(argv[i], "--roi") && i + 1 < argc) {
+			// Print usage message if the rectangle isn't exactly 4 comma separated positive integers
+			struct Region region;
+			char trailing;
+			if (sscanf(argv[++i], "%u,%u,%u,%u%c", &region.x, &region.y, &region.width, &region.height, &trailing) != 4 || !region.width || !region.height) {
+				usage_msg(argv[0]);
+				exit(1);
+			}
+
+			input_parameters->regions = realloc(input_parameters->regions, sizeof(struct Region) * (input_parameters->num_regions + 1));
+			if (input_parameters->regions == NULL) { error("could not allocate regions\n"); }
+			input_parameters->regions[input_parameters->num_regions++] = region;
+		
+		} else if (!strcmp(argv[i], "--mask") && i + 1 < argc) {
+			input_parameters->mask_filename = argv[++i];
+		
+		} else if (!strcmp(argv[i], "--incremental") && i + 2 < argc) {
+			input_parameters->prev_input_filename = argv[++i];
+			input_parameters->prev_output_filename = argv[++i];
+		
+		} else if (!strcmp(argv[i], "--stream") && i + 1 < argc) {
+			// Print usage message if the frame size isn't 2 positive integers separated by an 'x'
+			char trailing;
+			if (sscanf(argv[++i], "%ux%u%c", &input_parameters->stream_width, &input_parameters->stream_height, &trailing) != 2
+					|| !input_parameters->stream_width || !input_parameters->stream_height) {
+				usage_msg(argv[0]);
+				exit(1);
+			}
+		
+		} else if (!strcmp(argv[i], "--unsharp") && i + 1 < argc && !input_parameters->op.type) {
+			// Print usage message if the amount isn't a positive number
+			char trailing;
+			if (sscanf(argv[++i], "%f%c", &input_parameters->op.amount, &trailing) != 1 || !(input_parameters->op.amount > 0)) {
+				usage_msg(argv[0]);
+				exit(1);
+			}
+			input_parameters->op.type = 'u';
+		
+		} else if (!strcmp(argv[i], "--dog") && i + 1 < argc && !input_parameters->op.type) {
+			// Print usage message if the standard deviation isn't a positive integer
+			if (!is_pos_int(argv[++i])) {
+				usage_msg(argv[0]);
+				exit(1);
+			}
+			input_parameters->op.dog_std_dev = strtol(argv[i], NULL, 10);
+			input_parameters->op.type = 'd';
+		
+		} else if (!strcmp(argv[i], "--scale") && i + 1 < argc) {
+			// Print usage message if the factor isn't a number in (0, 1]
+			char trailing;
+			if (sscanf(argv[++i], "%f%c", &input_parameters->scale, &trailing) != 1 || !(input_parameters->scale > 0 && input_parameters->scale <= 1)) {
+				usage_msg(argv[0]);
+				exit(1);
+			}
+		
+		} else if (!strcmp(argv[i], "--size") && i + 1 < argc) {
+			// Print usage message if the size isn't 2 positive integers separated by an 'x'
+			char trailing;
+			if (sscanf(argv[++i], "%ux%u%c", &input_parameters->out_width, &input_parameters->out_height, &trailing) != 2
+					|| !input_parameters->out_width || !input_parameters->out_height) {
+				usage_msg(argv[0]);
+				exit(1);
+			}
+		
+		} else if (!strcmp(argv[i], "--row-stride") && i + 1 < argc) {
+			// Print usage message if the stride isn't auto, packed or a positive multiple of 4 bytes (so every pixel stays aligned)
+			i ++;
+			if (!strcmp(argv[i], "auto")) {
+				input_parameters->row_stride_mode = 'a';
+			} else if (!strcmp(argv[i], "packed")) {
+				input_parameters->row_stride_mode = 'p';
+			} else if (is_pos_int(argv[i]) && strtol(argv[i], NULL, 10) % 4 == 0) {
+				input_parameters->row_stride_mode = 'n';
+				input_parameters->row_stride = strtol(argv[i], NULL, 10);
+			} else {
+				usage_msg(argv[0]);
+				exit(1);
+			}
+		
+		} else if (!strcmp(argv[i], "--huge-pages")) {
+			input_parameters->huge_pages = 1;
+		
+		} else if (!strcmp(argv[i], "--skip-flat")) {
+			input_parameters->skip_flat = 1;
+		
+		} else if (!strcmp(argv[i], "--output-format") && i + 1 < argc) {
+			// Print usage message if the format isn't the extension of a supported format
+			i ++;
+			char extension[strlen(argv[i]) + 2];
+			snprintf(extension, sizeof(extension), ".%s", argv[i]);
+			if (image_format(extension) == FORMAT_UNKNOWN) {
+				usage_msg(argv[0]);
+				exit(1);
+			}
+			input_parameters->output_format = argv[i];
+		
+		} else if (!strcmp(argv[i], "--perf") && input_parameters->device == 'c') {
+			input_parameters->perf = 1;
+		
+		} else if (!strcmp(argv[i], "--affinity") && i + 1 < argc && input_parameters->device == 'c' && !input_parameters->affinity) {
+			// Print usage message if the affinity isn't compact, scatter or a valid list of cpus
+			i ++;
+			if (!strcmp(argv[i], "compact")) {
+				input_parameters->affinity = 'c';
+			} else if (!strcmp(argv[i], "scatter")) {
+				input_parameters->affinity = 's';
+			} else if (parse_cpu_list(argv[i], &input_parameters->affinity_cpus, &input_parameters->num_affinity_cpus)) {
+				input_parameters->affinity = 'l';
+			} else {
+				usage_msg(argv[0]);
+				exit(1);
+			}
+		
+		} else if (!strcmp(argv[i], "--batch")) {
+			input_parameters->batch = 1;
+		
+		} else {
+			usage_msg(argv[0]);
+			exit(1);
+		}
+	}
+
+	// Print usage message if incremental mode is combined with regions or a mask (it picks its own regions)
+	if (input_parameters->prev_input_filename && (input_parameters->num_regions || input_parameters->mask_filename)) {
+		usage_msg(argv[0]);
+		exit(1);
+	}
+
+	// Print usage message if the input is a stream without a frame size (or the other way around), or a stream is combined with per image options
+	// (or an output format, the blurred frames are always raw RGBA)
+	bool has_image_options = input_parameters->num_regions || input_parameters->mask_filename || input_parameters->prev_input_filename;
+	if (is_stream != (input_parameters->stream_width != 0) || (is_stream && (has_image_options || input_parameters->output_format))) {
+		usage_msg(argv[0]);
+		exit(1);
+	}
+
+	// Print usage message if several standard deviations are combined with streams or per image options
+	if (input_parameters->num_std_devs > 1 && (is_stream || has_image_options)) {
+		usage_msg(argv[0]);
+		exit(1);
+	}
+
+	// Print usage message if linear filtering is combined with buffers (it needs the texture sampler of images)
+	if (input_parameters->linear && input_parameters->gpu_memory == 'b') {
+		usage_msg(argv[0]);
+		exit(1);
+	}
+
+	// Print usage message if the approximate blur is forced on the cpu together with per image options (it always blurs the whole image)
+	if (input_parameters->approx && input_parameters->device == 'c' && has_image_options) {
+		usage_msg(argv[0]);
+		exit(1);
+	}
+
+	// Print usage message if downscaling is given twice, or combined with anything but a plain blur of a whole image (it has its own passes)
+	bool resize = input_parameters->scale || input_parameters->out_width;
+	if ((input_parameters->scale && input_parameters->out_width) || (resize && (is_stream || has_image_options || input_parameters->num_std_devs > 1
+			|| input_parameters->approx || input_parameters->linear || input_parameters->gpu_memory == 'b'))) {
+		usage_msg(argv[0]);
+		exit(1);
+	}
+
+	// Print usage message if an operation is combined with anything but a plain blur of a whole image (it is fused into the last pass of that blur)
+	if (input_parameters->op.type && (is_stream || has_image_options || input_parameters->num_std_devs > 1 || resize
+			|| input_parameters->approx || input_parameters->linear || input_parameters->gpu_memory == 'b')) {
+		usage_msg(argv[0]);
+		exit(1);
+	}
+
+	// Print usage message if skipping flat tiles is combined with anything but a plain blur of a whole image (it picks its own regions),
+	// or with the approximate blur (its box blurs don't give back a flat colour next to the edges of the image)
+	if (input_parameters->skip_flat && (is_stream || has_image_options || input_parameters->num_std_devs > 1 || resize
+			|| input_parameters->op.type || input_parameters->approx)) {
+		usage_msg(argv[0]);
+		exit(1);
+	}
+
+	// Print usage message if the counters are combined with a blur of several images, or the downscaling blur (they are only collected for one blur)
+	if (input_parameters->perf && (is_stream || input_parameters->num_std_devs > 1 || resize)) {
+		usage_msg(argv[0]);
+		exit(1);
+	}
+
+	// Print usage message if the input is a list without --batch (or the other way around, which also covers filenames of unsupported formats),
+	// or a batch is combined with the auto device or anything but a plain blur of whole images (every image of a batch is blurred the same way, with the default row stride)
+	if (is_list != (input_parameters->batch != 0) || (is_list && (input_parameters->device == 'a' || has_image_options || input_parameters->num_std_devs > 1
+			|| resize || input_parameters->op.type || input_parameters->skip_flat || input_parameters->perf || input_parameters->linear
+			|| input_parameters->gpu_bands > 1 || input_parameters->gpu_memory == 'b' || input_parameters->row_stride_mode != 'a'))) {
+		usage_msg(argv[0]);
+		exit(1);
+	}
 }
 
 /**
- * Create 3, 1D image arrays to store input, output and temp of the blur, and put libpng multi array into img_datap->arr1
- * @param img_data : struct stores input image information, new_row_pointers value updated at return
- * @return 0 on success, 1 on failure
+ * Replaces the auto device with the device and number of threads expected to blur the fastest, and outputs the choice
+ * @param [output] input_parameters : struct for input parameters from command line, device, threads, planar and approx are set
+ * @param width : width of the image (or frames) to blur in pixels
+ * @param height : height of the image (or frames) to blur in pixels
  */
-int create_new_img_arrays(struct Img_Data *img_datap) {
-	// Create 3 arrays to store the image data
+void select_auto_device(struct Input_Pars *input_parameters, unsigned width, unsigned height) {
+	struct Cost_Profile profile;
+	load_cost_profile(&profile);
+
+	// The approximate blur always blurs the whole image, so it can't be picked when only parts of the image are blurred
+	bool has_image_options = input_parameters->num_regions || input_parameters->mask_filename || input_parameters->prev_input_filename;
+	bool allow_approx = input_parameters->approx && !has_image_options;
 	
-	img_datap->arrays = malloc(sizeof(unsigned char *) * 2);
-	for (unsigned i = 0; i < 2; ++i) {
-		img_datap->arrays[i] = calloc(img_datap->width * img_datap->height * img_datap->pixel_length, sizeof(unsigned char));
-		if (img_datap->arrays[i] == NULL) { error("could not allocate temporary image buffers\n"); }
+	// A scale space is costed by its largest standard deviation
+	unsigned std_dev = input_parameters->std_devs[input_parameters->num_std_devs - 1];
+	struct Engine_Choice choice;
+	choose_engine(&profile, width, height, std_dev, allow_approx, &choice);
+
+	// The exact cpu blur is always planar since it gives the same result as interleaved, but faster
+	input_parameters->device = choice.device;
+	input_parameters->threads = choice.threads;
+	input_parameters->planar = choice.device == 'c' && !choice.approx;
+	input_parameters->approx = choice.approx;
+
+	if (choice.device == 'c') {
+		printf("Auto Selected Device: cpu (%s), Num Threads: %u", choice.approx ? "approximate" : "planar", choice.threads);
+	} else {
+		printf("Auto Selected Device: gpu");
 	}
-	return 0;
+	printf(", Estimated Duration: %f seconds%s\n\n", choice.estimated_duration, profile.calibrated ? "" : " (uncalibrated)");
+}
+
+/**
+ * Works out the row stride of the image arrays from the input parameters
+ * @param input_parameters : struct for input parameters from command line
+ * @param width : width of the image (or frames) in pixels
+ * @return bytes between the starts of two rows
+ */
+unsigned get_row_stride(struct Input_Pars *input_parameters, unsigned width) {
+	unsigned row_len = width * 4;
+	if (input_parameters->row_stride_mode == 'p') { return row_len; }
+	if (input_parameters->row_stride_mode == 'a') { return padded_row_stride(row_len); }
+	
+	if (input_parameters->row_stride < row_len) { error("row stride is smaller than a row of the image\n"); }
+	return input_parameters->row_stride;
+}
+
+/**
+ * Works out which parts of the image should be blurred from the regions and mask in the input parameters
+ * @param [output] areap : pointer to the area struct to fill in
+ * @param input_parameters : struct for input parameters from command line
+ * @param img_datap : struct storing the input image information
+ * @return areap, or NULL if the whole image should be blurred
+ */
+struct Blur_Area *create_blur_area(struct Blur_Area *areap, struct Input_Pars *input_parameters, struct Img_Data *img_datap) {
+	if (!input_parameters->num_regions && !input_parameters->mask_filename) { return NULL; }
+
+	// Read the mask if there is one
+	areap->mask = NULL;
+	if (input_parameters->mask_filename) {
+		areap->mask = read_png_mask(input_parameters->mask_filename, img_datap->width, img_datap->height);
+	}
+
+	// Use the given rectangles, or cover the mask with rectangles if there are none
+	if (input_parameters->num_regions) {
+		areap->regions = input_parameters->regions;
+		areap->num_regions = clip_regions(areap->regions, input_parameters->num_regions, img_datap->width, img_datap->height);
+	} else {
+		areap->num_regions = regions_from_mask(areap->mask, img_datap->width, img_datap->height, &areap->regions);
+	}
+
+	return areap;
+}
+
+/**
+ * Reads the previous frame in incremental mode, and finds the parts of the output that have to be blurred again
+ * @param [output] areap : pointer to the area struct to fill in
+ * @param [output] prev_out_datap : struct to store the previous output image in (the blurred regions are copied over it later)
+ * @param input_parameters : struct for input parameters from command line
+ * @param img_datap : struct storing the input image information
+ * @return areap
+ */
+struct Blur_Area *create_incremental_area(struct Blur_Area *areap, struct Img_Data *prev_out_datap, struct Input_Pars *input_parameters, struct Img_Data *img_datap) {
+	// Read the previous input and output images, which must be the same size as the input image
+	struct Img_Data prev_in_data;
+	read_image(&prev_in_data, input_parameters->prev_input_filename);
+	read_image(prev_out_datap, input_parameters->prev_output_filename);
+	if (prev_in_data.width != img_datap->width || prev_in_data.height != img_datap->height
+			|| prev_out_datap->width != img_datap->width || prev_out_datap->height != img_datap->height) {
+		error("previous images are not the same size as the input image\n");
+	}
+
+	// The previous output is kept until it is written, the previous input only until the changes are found
+	load_image_arrays(prev_out_datap, img_datap->arena, img_datap->row_stride);
+	struct Arena_Mark mark = arena_mark(img_datap->arena);
+	load_image_arrays(&prev_in_data, img_datap->arena, img_datap->row_stride);
+
+	// Find the regions the changes reach in the output
+	areap->mask = NULL;
+	areap->num_regions = find_changed_regions(img_datap, &prev_in_data, RADIUS * input_parameters->std_dev, &areap->regions);
+	free_image(&prev_in_data);
+	release_to_arena_mark(img_datap->arena, mark);
+
+	// Output how much of the image has to be blurred again
+	size_t changed_pxls = 0;
+	for (unsigned i = 0; i < areap->num_regions; ++i) {
+		changed_pxls += (size_t) areap->regions[i].width * areap->regions[i].height;
+	}
+	printf("Changed Regions: %u (%.1f%% of the image)\n\n", areap->num_regions, 100.0 * changed_pxls / ((size_t) img_datap->width * img_datap->height));
+
+	return areap;
+}
+
+/**
+ * Finds the parts of the image that are not flat, so only those are blurred, and outputs how much of the image that is
+ * @param [output] areap : pointer to the area struct to fill in
+ * @param input_parameters : struct for input parameters from command line
+ * @param img_datap : struct storing the input image information (in img_datap->arrays[0])
+ * @return areap
+ */
+struct Blur_Area *create_non_flat_area(struct Blur_Area *areap, struct Input_Pars *input_parameters, struct Img_Data *img_datap) {
+	areap->mask = NULL;
+	areap->num_regions = find_non_flat_regions(img_datap, RADIUS * input_parameters->std_dev, &areap->regions);
+
+	// Output how much of the image has to be blurred
+	size_t blurred_pxls = 0;
+	for (unsigned i = 0; i < areap->num_regions; ++i) {
+		blurred_pxls += (size_t) areap->regions[i].width * areap->regions[i].height;
+	}
+	printf("Non Flat Regions: %u (%.1f%% of the image)\n\n", areap->num_regions, 100.0 * blurred_pxls / ((size_t) img_datap->width * img_datap->height));
+
+	return areap;
 }
 
 /**
- * Constructs the output filename of the blurred image
+ * Constructs the output filename of the blurred image (<input_filename>_OUTPUT_MODIFIER.<output_format>)
  * @param input_filename : the filename of the input image
- * @param [output] output_filename : pointer to where the filename of the output image is stored
+ * @param output_format : extension of the output image without the '.' (NULL means the extension of the input image)
+ * @return the (malloced) filename of the output image
  */
-void get_output_filename(char *input_filename, char *output_filename) {
-	output_filename[0] = '\0';
-	strncat(output_filename, input_filename, strlen(input_filename) - 4);
-	output_filename[strlen(input_filename) - 3] = '\0';
-	strncat(output_filename, OUTPUT_MODIFIER, strlen(OUTPUT_MODIFIER) + 1);
-	strncat(output_filename, input_filename + strlen(input_filename) - 4, 5);
+char *get_output_filename(char *input_filename, char *output_format) {
+	char *extension = strrchr(input_filename, '.');
+	int base_len = extension - input_filename;
+	if (output_format == NULL) { output_format = extension + 1; }
+
+	int size = snprintf(NULL, 0, "%.*s%s.%s", base_len, input_filename, OUTPUT_MODIFIER, output_format) + 1;
+	char *output_filename = malloc(size);
+	if (output_filename == NULL) { error("could not allocate output filename\n"); }
+	snprintf(output_filename, size, "%.*s%s.%s", base_len, input_filename, OUTPUT_MODIFIER, output_format);
+	return output_filename;
+}
+
+/**
+ * Constructs the output filename of one level of a scale space (<input_filename>_OUTPUT_MODIFIER_s<std_dev>.<output_format>)
+ * @param input_filename : the filename of the input image
+ * @param output_format : extension of the output image without the '.' (NULL means the extension of the input image)
+ * @param std_dev : the standard deviation of the level
+ * @return the (malloced) filename of the output image
+ */
+char *get_level_output_filename(char *input_filename, char *output_format, unsigned std_dev) {
+	char *extension = strrchr(input_filename, '.');
+	int base_len = extension - input_filename;
+	if (output_format == NULL) { output_format = extension + 1; }
+	
+	int size = snprintf(NULL, 0, "%.*s%s_s%u.%s", base_len, input_filename, OUTPUT_MODIFIER, std_dev, output_format) + 1;
+	char *output_filename = malloc(size);
+	if (output_filename == NULL) { error("could not allocate output filename\n"); }
+	snprintf(output_filename, size, "%.*s%s_s%u.%s", base_len, input_filename, OUTPUT_MODIFIER, std_dev, output_format);
+	return output_filename;
 }
 
 /**
@@ -166,38 +739,192 @@ void get_output_filename(char *input_filename, char *output_filename) {
  * @param argv : command line arguments
  */
 int main(int argc, char **argv) {
+	// Time the devices on this host for the auto device
+	if (argc == 2 && !strcmp(argv[1], "--calibrate")) {
+		calibrate_cost_profile();
+		return 0;
+	}
+
 	// Parse and store command line arguments in input_parameters struct
 	struct Input_Pars input_parameters;
 	parse_input_args(&input_parameters, argc, argv);
+
+	// All the image memory comes from one arena, which is unmapped when the program ends
+	struct Img_Arena arena;
+	init_img_arena(&arena, input_parameters.huge_pages);
+
+	// Work out which cpu each thread of the cpu blur is pinned to (NULL means they aren't pinned)
+	struct Thread_Placement placement;
+	struct Thread_Placement *placementp = NULL;
+	if (input_parameters.affinity) {
+		init_thread_placement(&placement, input_parameters.affinity, input_parameters.affinity_cpus, input_parameters.num_affinity_cpus);
+		placementp = &placement;
+	}
+
+	// In stream mode blur every frame from stdin, everything printed goes to stderr so it doesn't mix with the frames
+	if (input_parameters.stream_width) {
+		FILE *frames_out = take_stdout_for_frames();
+		print_input_args(&input_parameters);
+		if (input_parameters.device == 'a') { select_auto_device(&input_parameters, input_parameters.stream_width, input_parameters.stream_height); }
+		
+		struct Cpu_Config config = { input_parameters.threads, input_parameters.planar, NULL, input_parameters.approx, NULL, NULL, placementp };
+		struct Gpu_Config gpu_config = { NULL, input_parameters.linear, input_parameters.gpu_memory, input_parameters.gpu_bands, NULL };
+		blur_stream(input_parameters.stream_width, input_parameters.stream_height, input_parameters.std_dev, input_parameters.device, &config, &gpu_config,
+				&arena, get_row_stride(&input_parameters, input_parameters.stream_width), frames_out);
+		release_img_arena(&arena);
+		if (placementp) { free_thread_placement(placementp); }
+		return 0;
+	}
 	print_input_args(&input_parameters);
 
-	// Read and store png file in img_data and output some core information
+	// With a list of images blur every one of them, in batches of the same size class
+	if (input_parameters.batch) {
+		unsigned num_images;
+		char **input_filenames = read_batch_list(input_parameters.filename, &num_images);
+		char **output_filenames = malloc(sizeof(char *) * num_images);
+		if (output_filenames == NULL) { error("could not allocate output filenames\n"); }
+		for (unsigned i = 0; i < num_images; ++i) {
+			output_filenames[i] = get_output_filename(input_filenames[i], input_parameters.output_format);
+		}
+
+		struct Cpu_Config config = { input_parameters.threads, input_parameters.planar, NULL, input_parameters.approx, NULL, NULL, placementp };
+		struct Gpu_Config gpu_config = { NULL, input_parameters.linear, input_parameters.gpu_memory, input_parameters.gpu_bands, NULL };
+		blur_batch(input_filenames, output_filenames, num_images, input_parameters.std_dev, input_parameters.device, &config, &gpu_config, &arena);
+
+		for (unsigned i = 0; i < num_images; ++i) {
+			free(input_filenames[i]);
+			free(output_filenames[i]);
+		}
+		free(input_filenames);
+		free(output_filenames);
+		release_img_arena(&arena);
+		if (placementp) { free_thread_placement(placementp); }
+		printf("Output Images: %u\n", num_images);
+		free(input_parameters.std_devs);
+		return 0;
+	}
+
+	// Read the input image into img_data and output some core information
 	struct Img_Data img_data;
-	read_png(&img_data, input_parameters.filename);
+	read_image(&img_data, input_parameters.filename);
+	if (input_parameters.device == 'a') { select_auto_device(&input_parameters, img_data.width, img_data.height); }
 	
-	// Allocate space to store new modified image and copy image from img_datap->row_pointers to img_datap->arr1
-	if (create_new_img_arrays(&img_data)) { error("could not allocate enough space in memory for output image\n"); }
-	copy_row_pointers_and_arr(&img_data, 0, 1);
+	// Have each pinned thread first touch the rows it blurs before the image is decoded into them (a raw image only needs its temp array),
+	// and the planes or temp array the blur allocates after them
+	unsigned row_stride = get_row_stride(&input_parameters, img_data.width);
+	if (placementp) {
+		struct Blur_Op *touch_opp = input_parameters.op.type ? &input_parameters.op : NULL;
+		struct Cpu_Config touch_config = { input_parameters.threads, input_parameters.planar, NULL, input_parameters.approx, touch_opp, NULL, placementp };
+		bool raw = image_format(input_parameters.filename) == FORMAT_RAW;
+		first_touch_img_arrays(&arena, img_data.width, img_data.height, raw ? img_data.row_stride : row_stride, raw ? 1 : 2, &touch_config);
+	}
+
+	// Put the image in img_datap->arrays[0] (decoded into the arena, or the mapped pixels themselves for a raw image)
+	load_image_arrays(&img_data, &arena, row_stride);
+
+	// With several standard deviations output every level of the scale space from this one decode
+	if (input_parameters.num_std_devs > 1) {
+		char *output_filenames[input_parameters.num_std_devs];
+		for (unsigned i = 0; i < input_parameters.num_std_devs; ++i) {
+			output_filenames[i] = get_level_output_filename(input_parameters.filename, input_parameters.output_format, input_parameters.std_devs[i]);
+		}
+		
+		struct Cpu_Config config = { input_parameters.threads, input_parameters.planar, NULL, input_parameters.approx, NULL, NULL, placementp };
+		struct Gpu_Config gpu_config = { NULL, input_parameters.linear, input_parameters.gpu_memory, input_parameters.gpu_bands, NULL };
+		blur_scale_space(&img_data, input_parameters.std_devs, input_parameters.num_std_devs, input_parameters.device, &config, &gpu_config, output_filenames);
+
+		for (unsigned i = 0; i < input_parameters.num_std_devs; ++i) {
+			free(output_filenames[i]);
+		}
+		free_image(&img_data);
+		release_img_arena(&arena);
+		if (placementp) { free_thread_placement(placementp); }
+		free(input_parameters.std_devs);
+		return 0;
+	}
+
+	// With a scale or size only compute the blurred pixels the downscaled image samples, and write the downscaled image
+	if (input_parameters.scale || input_parameters.out_width) {
+		if (input_parameters.scale) {
+			input_parameters.out_width = (unsigned) (img_data.width * input_parameters.scale + 0.5f);
+			input_parameters.out_height = (unsigned) (img_data.height * input_parameters.scale + 0.5f);
+			if (!input_parameters.out_width) { input_parameters.out_width = 1; }
+			if (!input_parameters.out_height) { input_parameters.out_height = 1; }
+		}
+		if (input_parameters.out_width > img_data.width || input_parameters.out_height > img_data.height) {
+			error("output size is larger than the input image\n");
+		}
+
+		char *output_filename = get_output_filename(input_parameters.filename, input_parameters.output_format);
+		struct Cpu_Config config = { input_parameters.threads, input_parameters.planar, NULL, input_parameters.approx, NULL, NULL, placementp };
+		struct Gpu_Config gpu_config = { NULL, input_parameters.linear, input_parameters.gpu_memory, input_parameters.gpu_bands, NULL };
+		blur_resized(&img_data, input_parameters.std_dev, input_parameters.out_width, input_parameters.out_height, input_parameters.device,
+				&config, &gpu_config, output_filename);
+
+		free_image(&img_data);
+		release_img_arena(&arena);
+		if (placementp) { free_thread_placement(placementp); }
+		printf("Output Image: %s\n", output_filename);
+		free(output_filename);
+		free(input_parameters.std_devs);
+		return 0;
+	}
+
+	// Work out which parts of the image to blur (NULL means all of it)
+	struct Blur_Area area;
+	struct Blur_Area *areap;
+	struct Img_Data prev_out_data;
+	if (input_parameters.prev_input_filename) {
+		areap = create_incremental_area(&area, &prev_out_data, &input_parameters, &img_data);
+	} else if (input_parameters.skip_flat) {
+		areap = create_non_flat_area(&area, &input_parameters, &img_data);
+	} else {
+		areap = create_blur_area(&area, &input_parameters, &img_data);
+	}
 	
-	// Call correct blur function depending on device
+	// Call correct blur function depending on device (with the operation to output instead of the blurred image, if there is one)
+	struct Blur_Op *opp = input_parameters.op.type ? &input_parameters.op : NULL;
 	if (input_parameters.device == 'c') {
-		blur_cpu(&img_data, input_parameters.std_dev, input_parameters.threads);
+		struct Perf_Report perf;
+		struct Perf_Report *perfp = NULL;
+		if (input_parameters.perf) {
+			init_perf_report(&perf, input_parameters.threads);
+			perfp = &perf;
+		}
+		
+		struct Cpu_Config config = { input_parameters.threads, input_parameters.planar, areap, input_parameters.approx, opp, perfp, placementp };
+		blur_cpu(&img_data, input_parameters.std_dev, &config);
+		if (perfp) { free_perf_report(perfp); }
 	
 	} else {
-		blur_gpu(&img_data, input_parameters.std_dev);
+		struct Gpu_Config config = { areap, input_parameters.linear, input_parameters.gpu_memory, input_parameters.gpu_bands, opp };
+		blur_gpu(&img_data, input_parameters.std_dev, &config);
 	}
 
-	// Write the blurred image to the output file
-	copy_row_pointers_and_arr(&img_data, 0, 0);
-	char output_filename[strlen(input_parameters.filename) + strlen(OUTPUT_MODIFIER) + 1];
-	get_output_filename(input_parameters.filename, output_filename);
-	write_png(&img_data, output_filename);
+	// Write the blurred image to the output file (in incremental mode that is the previous output with the blurred regions updated)
+	char *output_filename = get_output_filename(input_parameters.filename, input_parameters.output_format);
+	if (input_parameters.prev_input_filename) {
+		update_previous_output(&img_data, &prev_out_data, area.regions, area.num_regions);
+		write_image(&prev_out_data, output_filename);
+		free_image(&prev_out_data);
+	
+	} else {
+		write_image(&img_data, output_filename);
+	}
 
-	// Free the img_data struct
-	free_img_data_struct(&img_data);
+	// Free the img_data struct (and the arena its arrays are in) and the area that was blurred
+	free_image(&img_data);
+	release_img_arena(&arena);
+	if (placementp) { free_thread_placement(placementp); }
+	if (areap) {
+		free(areap->regions);
+		free(areap->mask);
+	}
 
 	// Output the output image filename
 	printf("Output Image: %s\n", output_filename);
+	free(output_filename);
+	free(input_parameters.std_devs);
 
 	return 0;
 }
@@ -0,0 +1,184 @@
+// Ivan Bystrov
+// 18 October 2026
+//
+// Counts hardware events (cycles, instructions, cache and TLB misses) of each cpu blur thread in each pass with perf_event_open
+
+// Needed for syscall
+#define _DEFAULT_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "perf_counters.h"
+#include "error.h"
+
+// Bytes brought in by each last level cache miss
+#define CACHE_LINE_SIZE 64
+
+// The type and config of each Perf_Event for perf_event_open (cache events count read misses)
+#define CACHE_READ_MISS(cache) ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+static const struct { unsigned type; unsigned long long config; char *name; } PERF_EVENTS[NUM_PERF_EVENTS] = {
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, "cycles" },
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, "instructions" },
+	{ PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_L1D), "L1D misses" },
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, "LLC misses" },
+	{ PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_DTLB), "dTLB misses" }
+};
+
+
+/**
+ * Allocates a report for a blur with the given number of threads (every counter starts at zero)
+ * @param [output] report : the report to set up
+ * @param num_threads : number of threads of each pass
+ */
+void init_perf_report(struct Perf_Report *report, unsigned num_threads) {
+	report->num_threads = num_threads;
+	report->num_passes = 0;
+	report->counters = calloc((size_t) MAX_PERF_PASSES * num_threads, sizeof(struct Perf_Counters));
+	if (report->counters == NULL) { error("could not allocate perf counters\n"); }
+}
+
+/**
+ * Opens a counter of one event for the calling thread (user space only, so it works with perf_event_paranoid up to 2)
+ * @param event : the event to count
+ * @return the file descriptor of the counter (disabled), or -1 if it couldn't be opened (errno is set)
+ */
+int open_perf_counter(enum Perf_Event event) {
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_EVENTS[event].type;
+	attr.config = PERF_EVENTS[event].config;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+	// pid 0 and cpu -1 count the calling thread on whichever cpu it runs
+	return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/**
+ * Entry point for a thread that counts the hardware events of thread_func (start it with pthread_create instead of thread_func)
+ * Events that can't be counted are left out, so the thread always runs thread_func and at least its wall time is recorded
+ * @param perf_thread : Pointer to Perf_Thread struct
+ * @return : returns NULL
+ */
+void *perf_thread(void *perf_thread) {
+	struct Perf_Thread *pt = (struct Perf_Thread *) perf_thread;
+	struct Perf_Counters *counters = pt->counters;
+
+	// Counters are per thread, so they have to be opened by the thread itself
+	int fds[NUM_PERF_EVENTS];
+	for (unsigned event = 0; event < NUM_PERF_EVENTS; ++event) {
+		fds[event] = open_perf_counter(event);
+		if (fds[event] < 0 && !counters->open_errno) { counters->open_errno = errno; }
+		if (fds[event] >= 0) { ioctl(fds[event], PERF_EVENT_IOC_ENABLE, 0); }
+	}
+
+	struct timespec start, finish;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	pt->thread_func(pt->thread_params);
+	clock_gettime(CLOCK_MONOTONIC, &finish);
+
+	for (unsigned event = 0; event < NUM_PERF_EVENTS; ++event) {
+		if (fds[event] >= 0) { ioctl(fds[event], PERF_EVENT_IOC_DISABLE, 0); }
+	}
+	counters->seconds = (finish.tv_sec - start.tv_sec) + (finish.tv_nsec - start.tv_nsec) / 1000000000.0;
+
+	// Read each counter, scaling it up by how long it was actually counting if the kernel had to share the counters between events
+	for (unsigned event = 0; event < NUM_PERF_EVENTS; ++event) {
+		if (fds[event] < 0) { continue; }
+
+		unsigned long long value[3];
+		if (read(fds[event], value, sizeof(value)) == sizeof(value) && value[2]) {
+			counters->values[event] = value[2] < value[1] ? (unsigned long long) ((double) value[0] * value[1] / value[2]) : value[0];
+			counters->counted[event] = true;
+		}
+		close(fds[event]);
+	}
+
+	return NULL;
+}
+
+/**
+ * Outputs the count of one event of a thread (n/a if it couldn't be counted)
+ * @param counters : the counters of the thread
+ * @param event : the event to output
+ */
+void print_perf_count(struct Perf_Counters *counters, enum Perf_Event event) {
+	if (counters->counted[event]) {
+		printf(", %llu %s", counters->values[event], PERF_EVENTS[event].name);
+	} else {
+		printf(", n/a %s", PERF_EVENTS[event].name);
+	}
+}
+
+/**
+ * Outputs the counters of every thread in every pass, with the IPC, LLC traffic per pixel and the imbalance between the threads of each pass
+ * The imbalance is how much longer the slowest thread of a pass took than the mean of its threads (the time the other threads wait at the join)
+ * @param report : the report filled in by the blur
+ */
+void print_perf_report(struct Perf_Report *report) {
+	int open_errno = 0;
+	printf("Perf Counters:\n");
+
+	for (unsigned pass = 0; pass < report->num_passes; ++pass) {
+		struct Perf_Counters *pass_counters = report->counters + (size_t) pass * report->num_threads;
+
+		// Sum the threads of the pass (an event only counts for the pass if every thread counted it)
+		struct Perf_Counters total;
+		memset(&total, 0, sizeof(total));
+		for (unsigned event = 0; event < NUM_PERF_EVENTS; ++event) { total.counted[event] = true; }
+		double max_seconds = 0;
+		for (unsigned thread = 0; thread < report->num_threads; ++thread) {
+			struct Perf_Counters *counters = &pass_counters[thread];
+			for (unsigned event = 0; event < NUM_PERF_EVENTS; ++event) {
+				total.values[event] += counters->values[event];
+				total.counted[event] = total.counted[event] && counters->counted[event];
+			}
+			total.seconds += counters->seconds;
+			total.pixels += counters->pixels;
+			if (counters->seconds > max_seconds) { max_seconds = counters->seconds; }
+			if (counters->open_errno && !open_errno) { open_errno = counters->open_errno; }
+		}
+
+		double mean_seconds = total.seconds / report->num_threads;
+		printf("Pass %u (%s): %zu pixels, %f seconds, %.1f%% imbalance", pass, report->pass_names[pass], total.pixels, max_seconds,
+				mean_seconds > 0 ? 100.0 * (max_seconds / mean_seconds - 1) : 0.0);
+		if (total.counted[PERF_CYCLES] && total.counted[PERF_INSTRUCTIONS] && total.values[PERF_CYCLES]) {
+			printf(", IPC %.2f", (double) total.values[PERF_INSTRUCTIONS] / total.values[PERF_CYCLES]);
+		}
+		if (total.counted[PERF_LLC_MISSES] && total.pixels) {
+			printf(", %.2f LLC bytes/pixel", (double) total.values[PERF_LLC_MISSES] * CACHE_LINE_SIZE / total.pixels);
+		}
+		printf("\n");
+
+		for (unsigned thread = 0; thread < report->num_threads; ++thread) {
+			struct Perf_Counters *counters = &pass_counters[thread];
+			printf("	Thread %u: %zu pixels, %f seconds", thread, counters->pixels, counters->seconds);
+			for (unsigned event = 0; event < NUM_PERF_EVENTS; ++event) {
+				print_perf_count(counters, event);
+			}
+			printf("\n");
+		}
+	}
+
+	// Counters are often not allowed in containers and virtual machines, the times are still measured without them
+	if (open_errno) { printf("Some counters could not be opened (%s), they are shown as n/a\n", strerror(open_errno)); }
+	printf("\n");
+}
+
+/**
+ * Frees the counters of a report
+ * @param report : the report to free
+ */
+void free_perf_report(struct Perf_Report *report) {
+	free(report->counters);
+}
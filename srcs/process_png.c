@@ -71,7 +71,7 @@ void copy_row_pointers_and_arr(struct Img_Data *img_datap, unsigned arr_val, uns
 		for (unsigned col = 0; col < width; ++col) {
 			// Get pointers to the pxls involved in the copy between the i/o array and the computation array
 			unsigned char *io_pxl = row_ptrs[row] + col * pxl_len;
-			unsigned char *comp_pxl = arr + (row * width * pxl_len) + (col * pxl_len);
+			unsigned char *comp_pxl = arr + ((size_t) row * img_datap->row_stride) + (col * pxl_len);
 
 			// Copy the current pixel between the two arrays in the desired direction
 			if (io_to_comp) {
@@ -91,12 +91,13 @@ void copy_row_pointers_and_arr(struct Img_Data *img_datap, unsigned arr_val, uns
 }
 
 /**
- * Reads a png image and stores image data at img_p
- * @param [output] img_datap : pointer to struct storing input image data needed for program
- * @param filename : filepath to the input image the program will be blurring
+ * Opens a png file and sets up the read structs for it (exits with an error if it can't)
+ * @param filename : filepath to the png image
+ * @param [output] png_ptr_p : pointer to where the png_struct pointer is stored
+ * @param [output] info_ptr_p : pointer to where the png_info pointer is stored
+ * @return the open file, at its start
  */
-void read_png(struct Img_Data *img_datap, char *filename) {
-	// Open input image file
+static FILE *open_png(char *filename, png_structp *png_ptr_p, png_infop *info_ptr_p) {
 	FILE *fp;
 	if (!(fp = fopen(filename, "rb"))) { error(NULL); }
 	
@@ -107,12 +108,53 @@ void read_png(struct Img_Data *img_datap, char *filename) {
 	}
 	
 	// Allocate and initialize all the structs used for reading
+	if(init_read_structs(png_ptr_p, info_ptr_p)) { 
+		fclose(fp);
+		error("failed to initialize structs for reading input PNG\n"); 
+	}
+
+	return fp;
+}
+
+/**
+ * Reads the size of a png image from its header, without decoding its pixels
+ * @param filename : filepath to the png image
+ * @param [output] width : width of the image in pixels
+ * @param [output] height : height of the image in pixels
+ */
+void read_png_size(char *filename, unsigned *width, unsigned *height) {
 	png_structp png_ptr;
 	png_infop info_ptr;
-	if(init_read_structs(&png_ptr, &info_ptr)) { 
+	FILE *fp = open_png(filename, &png_ptr, &info_ptr);
+
+	// libpng jumps here when it encounters an error
+	if (setjmp(png_jmpbuf(png_ptr))) {
+		png_destroy_read_struct(&png_ptr, &info_ptr, (png_infopp) NULL);
 		fclose(fp);
-		error("failed to initialize structs for reading input PNG\n"); 
+		error("libpng failed to process input image\n");
 	}
+
+	// Only the chunks up to the first image data are read
+	png_init_io(png_ptr, fp);
+	png_read_info(png_ptr, info_ptr);
+	fclose(fp);
+	*width = png_get_image_width(png_ptr, info_ptr);
+	*height = png_get_image_height(png_ptr, info_ptr);
+	bool is_rgba8 = png_get_bit_depth(png_ptr, info_ptr) == 8 && png_get_color_type(png_ptr, info_ptr) == 6;
+	png_destroy_read_struct(&png_ptr, &info_ptr, (png_infopp) NULL);
+
+	if (!is_rgba8) { error("input image colour type is not RGBA with bit depth 8\n"); }
+}
+
+/**
+ * Decodes a png image and stores image data at img_p, without outputting anything or checking its colour type (read_png does both)
+ * @param [output] img_datap : pointer to struct storing input image data needed for program
+ * @param filename : filepath to the input image the program will be blurring
+ */
+void decode_png(struct Img_Data *img_datap, char *filename) {
+	png_structp png_ptr;
+	png_infop info_ptr;
+	FILE *fp = open_png(filename, &png_ptr, &info_ptr);
 	
 	// libpng jumps here when it encounters an error
 	if (setjmp(png_jmpbuf(png_ptr))) {
@@ -135,6 +177,20 @@ void read_png(struct Img_Data *img_datap, char *filename) {
 	img_datap->bit_depth = png_get_bit_depth(png_ptr, info_ptr); 
 	img_datap->colour_type = png_get_color_type(png_ptr, info_ptr);
 	img_datap->pixel_length = 4;
+	img_datap->arrays = NULL;
+	img_datap->row_stride = img_datap->width * img_datap->pixel_length;
+	img_datap->arena = NULL;
+	img_datap->mapped_file = NULL;
+	img_datap->mapped_size = 0;
+}
+
+/**
+ * Reads a png image and stores image data at img_p
+ * @param [output] img_datap : pointer to struct storing input image data needed for program
+ * @param filename : filepath to the input image the program will be blurring
+ */
+void read_png(struct Img_Data *img_datap, char *filename) {
+	decode_png(img_datap, filename);
 
 	// Output core image information	
 	printf("Image Width: %u, Image Height: %u, Bit Depth: %u, Colour Type: %u\n\n", 
@@ -142,23 +198,70 @@ void read_png(struct Img_Data *img_datap, char *filename) {
 
 	// Make sure core image information is acceptable for the program
 	if (img_datap->bit_depth != 8 || img_datap->colour_type != 6) {
-		png_destroy_read_struct(&png_ptr, &info_ptr, (png_infopp) NULL);
+		png_destroy_read_struct(&img_datap->png_ptr, &img_datap->info_ptr, (png_infopp) NULL);
 		error("input image colour type is not RGBA with bit depth 8\n");
 	}
 }
 
 /**
- * Free img_data struct (should only be called after the three buffers have been created)
+ * Reads a mask png image (must be 8 bit, RGBA, and the same size as the image being blurred)
+ * @param filename : filepath to the mask image
+ * @param width : width the mask image must have
+ * @param height : height the mask image must have
+ * @return width * height bytes (malloced), non zero where the mask pixel is not black
+ */
+unsigned char *read_png_mask(char *filename, unsigned width, unsigned height) {
+	// Read the mask the same way as the input image
+	struct Img_Data mask_data;
+	read_png(&mask_data, filename);
+	if (mask_data.width != width || mask_data.height != height) {
+		free_img_data_struct(&mask_data);
+		error("mask image is not the same size as the input image\n");
+	}
+
+	unsigned char *mask = malloc((size_t) width * height);
+	if (mask == NULL) { error("could not allocate mask\n"); }
+	
+	// A pixel is masked if any of its colour components are non zero
+	for (unsigned row = 0; row < height; ++row) {
+		unsigned char *pxl = mask_data.row_pointers[row];
+		for (unsigned col = 0; col < width; ++col, pxl += mask_data.pixel_length) {
+			mask[(size_t) row * width + col] = pxl[0] | pxl[1] | pxl[2];
+		}
+	}
+
+	// Free the read structs (this also frees mask_data.row_pointers)
+	free_img_data_struct(&mask_data);
+	return mask;
+}
+
+/**
+ * Allocates the two temp image arrays from an arena (not zeroed), with the given row stride
+ * @param img_datap : pointer to img_data struct to allocate the arrays of
+ * @param arena : the arena to allocate the arrays from
+ * @param row_stride : bytes between the starts of two rows (at least width * pixel_length)
+ */
+void create_img_arrays(struct Img_Data *img_datap, struct Img_Arena *arena, unsigned row_stride) {
+	if (!(img_datap->arrays = malloc(sizeof(unsigned char *) * 2))) { error("could not allocate image arrays\n"); }
+
+	// Every pixel is written before it is read, so there is no need to zero the arrays
+	size_t arr_size = (size_t) row_stride * img_datap->height;
+	img_datap->arrays[0] = arena_alloc(arena, arr_size);
+	img_datap->arrays[1] = arena_alloc(arena, arr_size);
+	img_datap->row_stride = row_stride;
+	img_datap->arena = arena;
+}
+
+/**
+ * Free img_data struct (the two buffers belong to the arena they were allocated from, so they are not freed)
  * @param img_datap : pointer to the img_data struct to be freed
  */
 void free_img_data_struct(struct Img_Data *img_datap) {
 	// Free the two read structs from read_png first (this also frees img_data->row_pointers)
 	png_destroy_read_struct(&(img_datap->png_ptr), &(img_datap->info_ptr), (png_infopp) NULL);
 
-	// Free all the arrays
-	for (unsigned i = 0; i < 2; ++i) {
-		free(img_datap->arrays[i]);
-	}
+	// Free the pointers to the arrays (the arrays themselves are released with their arena)
+	if (!img_datap->arrays) { return; }
 	free(img_datap->arrays);
 }
 
@@ -197,3 +300,56 @@ void write_png(struct Img_Data *img_datap, char *filename) {
 	// Free the write_png_ptr struct
 	png_destroy_write_struct(&write_png_ptr, (png_infopp) NULL);
 }
+
+/**
+ * Writes RGBA pixels that don't have png info from an input image (like a downscaled image) to a png file
+ * @param filename : filepath of the output image
+ * @param pixels : the RGBA pixels to write
+ * @param width : width of the output image in pixels
+ * @param height : height of the output image in pixels
+ * @param row_stride : bytes between the starts of two rows of pixels
+ */
+void write_png_pixels(char *filename, unsigned char *pixels, unsigned width, unsigned height, unsigned row_stride) {
+	// Open output image file
+	FILE *fp;
+	if(!(fp = fopen(filename, "wb"))) { error(NULL); }
+
+	// Allocate and initialize the png structs used for writing (there is no input info struct to reuse since the size is different)
+	png_structp write_png_ptr;
+	png_infop write_info_ptr;
+	if (!(write_png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL))) {
+		fclose(fp);
+		error("failed to initialize struct for writing output PNG\n");
+	}
+	if (!(write_info_ptr = png_create_info_struct(write_png_ptr))) {
+		png_destroy_write_struct(&write_png_ptr, (png_infopp) NULL);
+		fclose(fp);
+		error("failed to initialize struct for writing output PNG\n");
+	}
+
+	// Point a row pointer at each row of the pixels
+	png_bytep *row_pointers = malloc(sizeof(png_bytep) * height);
+	if (row_pointers == NULL) { error("could not allocate output row pointers\n"); }
+	for (unsigned row = 0; row < height; ++row) {
+		row_pointers[row] = pixels + (size_t) row * row_stride;
+	}
+	
+	// libpng jumps here when it encounters an error
+	if (setjmp(png_jmpbuf(write_png_ptr))) {
+		png_destroy_write_struct(&write_png_ptr, &write_info_ptr);
+		free(row_pointers);
+		fclose(fp);
+		error("libpng failed to process output image\n");
+	}
+
+	// Write the PNG as 8 bit RGBA, like the input images
+	png_init_io(write_png_ptr, fp);
+	png_set_IHDR(write_png_ptr, write_info_ptr, width, height, 8, PNG_COLOR_TYPE_RGBA, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+	png_set_rows(write_png_ptr, write_info_ptr, row_pointers);
+	png_write_png(write_png_ptr, write_info_ptr, PNG_TRANSFORM_IDENTITY, NULL);
+	fclose(fp);
+
+	// Free the write structs and the row pointers
+	png_destroy_write_struct(&write_png_ptr, &write_info_ptr);
+	free(row_pointers);
+}
@@ -0,0 +1,252 @@
+// Ivan Bystrov
+// 18 October 2026
+//
+// Encodes and decodes QOI ("Quite OK Image") images in memory
+
+
+#include <string.h>
+#include "qoi.h"
+#include "error.h"
+
+// Chunk tags (the 2 bit tags are the top 2 bits of the first byte, the 8 bit tags are the whole byte)
+#define QOI_OP_INDEX 0x00
+#define QOI_OP_DIFF 0x40
+#define QOI_OP_LUMA 0x80
+#define QOI_OP_RUN 0xc0
+#define QOI_OP_RGB 0xfe
+#define QOI_OP_RGBA 0xff
+#define QOI_MASK_2 0xc0
+
+// Longest run a single run chunk can store (62, since run lengths 63 and 64 would clash with the RGB and RGBA tags)
+#define QOI_MAX_RUN 62
+
+// Number of previously seen pixels kept in the index
+#define QOI_INDEX_LEN 64
+
+
+/**
+ * Struct storing one RGBA pixel
+ */
+struct Qoi_Pixel {
+	unsigned char r;
+	unsigned char g;
+	unsigned char b;
+	unsigned char a;
+};
+
+/**
+ * Gets the position of a pixel in the index of previously seen pixels
+ * @param px : the pixel
+ * @return the position in the index
+ */
+static inline unsigned qoi_hash(struct Qoi_Pixel px) {
+	return (px.r * 3 + px.g * 5 + px.b * 7 + px.a * 11) % QOI_INDEX_LEN;
+}
+
+/**
+ * Checks if two pixels are the same
+ * @param a : the first pixel
+ * @param b : the second pixel
+ * @return true if every component is the same, false otherwise
+ */
+static inline bool qoi_equal(struct Qoi_Pixel a, struct Qoi_Pixel b) {
+	return a.r == b.r && a.g == b.g && a.b == b.b && a.a == b.a;
+}
+
+/**
+ * Reads a big endian 32 bit unsigned integer
+ * @param bytes : the 4 bytes to read
+ * @return the integer
+ */
+static unsigned read_u32_be(unsigned char *bytes) {
+	return ((unsigned) bytes[0] << 24) | ((unsigned) bytes[1] << 16) | ((unsigned) bytes[2] << 8) | bytes[3];
+}
+
+/**
+ * Writes a big endian 32 bit unsigned integer
+ * @param [output] bytes : the 4 bytes to write
+ * @param value : the integer
+ */
+static void write_u32_be(unsigned char *bytes, unsigned value) {
+	bytes[0] = value >> 24;
+	bytes[1] = value >> 16;
+	bytes[2] = value >> 8;
+	bytes[3] = value;
+}
+
+/**
+ * Reads the size of a QOI image from its header
+ * @param data : the encoded image
+ * @param size : size of the encoded image in bytes
+ * @param [output] width : width of the image in pixels
+ * @param [output] height : height of the image in pixels
+ * @return true if data starts with a valid QOI header, false otherwise
+ */
+bool qoi_read_header(unsigned char *data, size_t size, unsigned *width, unsigned *height) {
+	if (size < QOI_HEADER_SIZE + QOI_END_SIZE || memcmp(data, "qoif", 4)) { return false; }
+
+	*width = read_u32_be(data + 4);
+	*height = read_u32_be(data + 8);
+	unsigned channels = data[12];
+	return *width && *height && (channels == 3 || channels == 4);
+}
+
+/**
+ * Decodes a QOI image into RGBA pixels (3 channel images get an alpha of 255)
+ * @param data : the encoded image (its header must be valid)
+ * @param size : size of the encoded image in bytes
+ * @param [output] pixels : the decoded RGBA pixels
+ * @param row_stride : bytes between the starts of two rows of pixels
+ */
+void qoi_decode(unsigned char *data, size_t size, unsigned char *pixels, unsigned row_stride) {
+	unsigned width = read_u32_be(data + 4);
+	unsigned height = read_u32_be(data + 8);
+
+	struct Qoi_Pixel index[QOI_INDEX_LEN];
+	memset(index, 0, sizeof(index));
+	struct Qoi_Pixel px = { 0, 0, 0, 255 };
+	unsigned run = 0;
+
+	// Every chunk has to end before the end marker
+	size_t pos = QOI_HEADER_SIZE;
+	size_t chunks_end = size - QOI_END_SIZE;
+
+	for (unsigned row = 0; row < height; ++row) {
+		unsigned char *out = pixels + (size_t) row * row_stride;
+		for (unsigned col = 0; col < width; ++col, out += 4) {
+			if (run > 0) {
+				run --;
+
+			} else {
+				if (pos >= chunks_end) { error("QOI image is truncated\n"); }
+				unsigned char b1 = data[pos++];
+
+				if (b1 == QOI_OP_RGB || b1 == QOI_OP_RGBA) {
+					unsigned len = b1 == QOI_OP_RGB ? 3 : 4;
+					if (pos + len > chunks_end) { error("QOI image is truncated\n"); }
+					px.r = data[pos];
+					px.g = data[pos + 1];
+					px.b = data[pos + 2];
+					if (b1 == QOI_OP_RGBA) { px.a = data[pos + 3]; }
+					pos += len;
+
+				} else if ((b1 & QOI_MASK_2) == QOI_OP_INDEX) {
+					px = index[b1];
+
+				} else if ((b1 & QOI_MASK_2) == QOI_OP_DIFF) {
+					px.r += ((b1 >> 4) & 0x03) - 2;
+					px.g += ((b1 >> 2) & 0x03) - 2;
+					px.b += (b1 & 0x03) - 2;
+
+				} else if ((b1 & QOI_MASK_2) == QOI_OP_LUMA) {
+					if (pos >= chunks_end) { error("QOI image is truncated\n"); }
+					unsigned char b2 = data[pos++];
+					int vg = (b1 & 0x3f) - 32;
+					px.r += vg - 8 + ((b2 >> 4) & 0x0f);
+					px.g += vg;
+					px.b += vg - 8 + (b2 & 0x0f);
+
+				} else {
+					// This pixel is the first of the run, the run chunk stores the length - 1
+					run = b1 & 0x3f;
+				}
+
+				index[qoi_hash(px)] = px;
+			}
+
+			out[0] = px.r;
+			out[1] = px.g;
+			out[2] = px.b;
+			out[3] = px.a;
+		}
+	}
+}
+
+/**
+ * Encodes RGBA pixels as a 4 channel QOI image
+ * @param pixels : the RGBA pixels to encode
+ * @param width : width of the image in pixels
+ * @param height : height of the image in pixels
+ * @param row_stride : bytes between the starts of two rows of pixels
+ * @param [output] out : the encoded image (must have room for QOI_MAX_SIZE(width, height) bytes)
+ * @return size of the encoded image in bytes
+ */
+size_t qoi_encode(unsigned char *pixels, unsigned width, unsigned height, unsigned row_stride, unsigned char *out) {
+	// Header (4 channels, sRGB with linear alpha)
+	memcpy(out, "qoif", 4);
+	write_u32_be(out + 4, width);
+	write_u32_be(out + 8, height);
+	out[12] = 4;
+	out[13] = 0;
+	size_t pos = QOI_HEADER_SIZE;
+
+	struct Qoi_Pixel index[QOI_INDEX_LEN];
+	memset(index, 0, sizeof(index));
+	struct Qoi_Pixel prev = { 0, 0, 0, 255 };
+	unsigned run = 0;
+
+	for (unsigned row = 0; row < height; ++row) {
+		unsigned char *in = pixels + (size_t) row * row_stride;
+		for (unsigned col = 0; col < width; ++col, in += 4) {
+			struct Qoi_Pixel px = { in[0], in[1], in[2], in[3] };
+			bool last = row == height - 1 && col == width - 1;
+
+			if (qoi_equal(px, prev)) {
+				run ++;
+				if (run == QOI_MAX_RUN || last) {
+					out[pos++] = QOI_OP_RUN | (run - 1);
+					run = 0;
+				}
+				continue;
+			}
+
+			if (run > 0) {
+				out[pos++] = QOI_OP_RUN | (run - 1);
+				run = 0;
+			}
+
+			unsigned hash = qoi_hash(px);
+			if (qoi_equal(index[hash], px)) {
+				out[pos++] = QOI_OP_INDEX | hash;
+
+			} else {
+				index[hash] = px;
+
+				// Store the difference from the previous pixel if it is small enough, the pixel itself otherwise
+				signed char vr = px.r - prev.r;
+				signed char vg = px.g - prev.g;
+				signed char vb = px.b - prev.b;
+				signed char vg_r = vr - vg;
+				signed char vg_b = vb - vg;
+
+				if (px.a != prev.a) {
+					out[pos++] = QOI_OP_RGBA;
+					out[pos++] = px.r;
+					out[pos++] = px.g;
+					out[pos++] = px.b;
+					out[pos++] = px.a;
+
+				} else if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2) {
+					out[pos++] = QOI_OP_DIFF | (vr + 2) << 4 | (vg + 2) << 2 | (vb + 2);
+
+				} else if (vg_r > -9 && vg_r < 8 && vg > -33 && vg < 32 && vg_b > -9 && vg_b < 8) {
+					out[pos++] = QOI_OP_LUMA | (vg + 32);
+					out[pos++] = (vg_r + 8) << 4 | (vg_b + 8);
+
+				} else {
+					out[pos++] = QOI_OP_RGB;
+					out[pos++] = px.r;
+					out[pos++] = px.g;
+					out[pos++] = px.b;
+				}
+			}
+
+			prev = px;
+		}
+	}
+
+	// End marker
+	memset(out + pos, 0, QOI_END_SIZE - 1);
+	out[pos + QOI_END_SIZE - 1] = 1;
+	return pos + QOI_END_SIZE;
+}
@@ -0,0 +1,71 @@
+// Ivan Bystrov
+// 18 October 2026
+//
+// Blurs an image and downscales it in one go, for anti-aliasing before shrinking (e.g. thumbnails)
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include "resize.h"
+#include "blur_helpers.h"
+#include "image_io.h"
+
+
+/**
+ * Blurs the input image, downscales it and writes it to the output file, only computing the blurred pixels the downscaled image samples
+ * @param img_datap : struct storing all the info of the input image (must already be copied into arrays[0])
+ * @param std_dev : the standard deviation of the blur
+ * @param out_width : width of the downscaled image in pixels (at most the width of the input image)
+ * @param out_height : height of the downscaled image in pixels (at most the height of the input image)
+ * @param device : 'c' to blur on the cpu, 'g' to blur on the gpu
+ * @param cpu_config : how the cpu blur should be performed (only used if device is 'c', only the number of threads and their placement are used)
+ * @param gpu_config : how the gpu blur should be performed (only used if device is 'g', always blurs images without linear filtering or bands)
+ * @param output_filename : filename to write the downscaled image to
+ */
+void blur_resized(struct Img_Data *img_datap, unsigned std_dev, unsigned out_width, unsigned out_height, char device,
+		struct Cpu_Config *cpu_config, struct Gpu_Config *gpu_config, char *output_filename) {
+	// Create the 1D Gaussian convolution kernel and output it
+	unsigned gaussian_kernel_len = std_dev * RADIUS * 2 + 1;
+	float *gaussian_kernel = malloc(sizeof(float) * gaussian_kernel_len);
+	calculate_kernel(&gaussian_kernel, gaussian_kernel_len, std_dev);
+	print_kernel(gaussian_kernel, gaussian_kernel_len);
+
+	// Only the downscaled image is stored, the blurred image at full size never is
+	struct Arena_Mark mark = arena_mark(img_datap->arena);
+	unsigned char *out_pixels = arena_alloc(img_datap->arena, (size_t) out_width * out_height * img_datap->pixel_length);
+	printf("Output Size: %u x %u\n", out_width, out_height);
+
+	// Start timing the duration of the blur
+	printf("Blurring...\n");
+	struct timespec start, finish;
+	float duration;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	if (device == 'c') {
+		blur_cpu_resized(img_datap, gaussian_kernel, gaussian_kernel_len, cpu_config->num_threads, cpu_config->placement, out_width, out_height, out_pixels);
+	
+	} else {
+		// The downscaling kernels read unnormalized images, and the image is small enough once downscaled that bands aren't worth it
+		struct Gpu_Config resized_config = *gpu_config;
+		resized_config.linear = 0;
+		resized_config.memory = 'i';
+		resized_config.num_bands = 1;
+		
+		struct Gpu_Context *ctx = create_gpu_context(img_datap, gaussian_kernel, gaussian_kernel_len, &resized_config);
+		blur_gpu_resized_with_context(ctx, img_datap, out_width, out_height, out_pixels);
+		release_gpu_context(ctx);
+	}
+
+	// Output the duration of the blur
+	clock_gettime(CLOCK_MONOTONIC, &finish);
+	duration = (finish.tv_sec - start.tv_sec);
+	duration += (finish.tv_nsec - start.tv_nsec) / 1000000000.0;
+	printf("Blur Duration: %f seconds\n\n", duration);
+	if (device == 'c' && cpu_config->placement) { print_thread_placement(cpu_config->placement, cpu_config->num_threads); }
+
+	write_image_pixels(output_filename, out_pixels, out_width, out_height, out_width * 4);
+
+	release_to_arena_mark(img_datap->arena, mark);
+	free(gaussian_kernel);
+}
@@ -0,0 +1,78 @@
+// Ivan Bystrov
+// 18 October 2026
+//
+// Blurs one image with several standard deviations, each level blurring the level before it
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+#include "scale_space.h"
+#include "blur_gpu.h"
+#include "blur_helpers.h"
+#include "image_io.h"
+#include "error.h"
+
+
+/**
+ * Blurs the input image with every standard deviation and writes each level to its own output file
+ * Each level is computed from the previous level with the residual standard deviation sqrt(s_n^2 - s_(n-1)^2)
+ * @param img_datap : struct storing all the info of the input image (must already be copied into arrays[0])
+ * @param std_devs : the standard deviations to blur with (strictly increasing)
+ * @param num_std_devs : number of standard deviations
+ * @param device : 'c' to blur on the cpu, 'g' to blur on the gpu
+ * @param cpu_config : how the cpu blur should be performed (only used if device is 'c')
+ * @param gpu_config : how the gpu blur should be performed (only used if device is 'g', the area is ignored)
+ * @param output_filenames : filename to write each level to
+ */
+void blur_scale_space(struct Img_Data *img_datap, unsigned *std_devs, unsigned num_std_devs, char device, struct Cpu_Config *cpu_config, struct Gpu_Config *gpu_config, char **output_filenames) {
+	struct Gpu_Context *ctx = NULL;
+	
+	for (unsigned level = 0; level < num_std_devs; ++level) {
+		// Gaussian blurs add in quadrature, so only the residual standard deviation is needed on top of the previous level
+		float prev_std_dev = level ? std_devs[level - 1] : 0;
+		float residual_std_dev = sqrt((float) std_devs[level] * std_devs[level] - prev_std_dev * prev_std_dev);
+		unsigned gaussian_kernel_len = kernel_len_for_std_dev(residual_std_dev);
+		float *gaussian_kernel = malloc(sizeof(float) * gaussian_kernel_len);
+		calculate_kernel_float(&gaussian_kernel, gaussian_kernel_len, residual_std_dev);
+		
+		printf("Level %u: Standard Deviation: %u, Residual Standard Deviation: %f\n", level, std_devs[level], residual_std_dev);
+		print_kernel(gaussian_kernel, gaussian_kernel_len);
+
+		// Start timing the duration of the blur
+		printf("Blurring...\n");
+		struct timespec start, finish;
+		float duration;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+
+		// Blur the previous level (which is stored in arrays[0]), the gpu builds its program for the first level and reuses it after
+		if (device == 'c') {
+			blur_cpu_with_kernel(img_datap, gaussian_kernel, gaussian_kernel_len, cpu_config);
+		
+		} else {
+			if (ctx == NULL) {
+				ctx = create_gpu_context(img_datap, gaussian_kernel, gaussian_kernel_len, gpu_config);
+			} else {
+				set_gpu_context_kernel(ctx, gaussian_kernel, gaussian_kernel_len);
+			}
+			blur_gpu_with_context(ctx, img_datap, NULL);
+		}
+
+		// Output the duration of the blur
+		clock_gettime(CLOCK_MONOTONIC, &finish);
+		duration = (finish.tv_sec - start.tv_sec);
+		duration += (finish.tv_nsec - start.tv_nsec) / 1000000000.0;
+		printf("Blur Duration: %f seconds\n\n", duration);
+
+		// Write this level, arrays[0] stays as the input of the next level
+		write_image(img_datap, output_filenames[level]);
+		printf("Output Image: %s\n\n", output_filenames[level]);
+
+		free(gaussian_kernel);
+	}
+
+	// Every level was blurred by the same threads
+	if (device == 'c' && cpu_config->placement) { print_thread_placement(cpu_config->placement, cpu_config->num_threads); }
+	if (ctx) { release_gpu_context(ctx); }
+}
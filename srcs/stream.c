@@ -0,0 +1,275 @@
+// Ivan Bystrov
+// 18 October 2026
+//
+// Blurs a stream of raw RGBA frames read from stdin and writes the blurred frames to stdout
+
+// Needed for dup, dup2 and fdopen
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "stream.h"
+#include "blur_gpu.h"
+#include "blur_helpers.h"
+#include "error.h"
+
+// Number of frames in flight at once (one being read, one being blurred and one being written)
+#define NUM_FRAME_SLOTS 3
+
+
+/**
+ * What is currently stored in a frame slot
+ * SLOT_EMPTY : nothing, the reader can fill it with the next frame
+ * SLOT_READ : a frame that still has to be blurred
+ * SLOT_BLURRED : a blurred frame that still has to be written
+ */
+enum Slot_State {
+	SLOT_EMPTY,
+	SLOT_READ,
+	SLOT_BLURRED
+};
+
+/**
+ * Buffer for one frame travelling through the pipeline
+ * pixels : height rows of RGBA pixels, each starting row_stride bytes after the one before
+ * state : what is currently stored in pixels
+ * last : true if the stream ended instead of this frame being read (the threads stop when they reach it)
+ */
+struct Frame_Slot {
+	unsigned char *pixels;
+	enum Slot_State state;
+	bool last;
+};
+
+/**
+ * Struct storing everything shared by the reader, blur and writer threads
+ * slots : the frame buffers, frame n always uses slots[n % NUM_FRAME_SLOTS]
+ * row_len : size of the pixels of one row of a frame in bytes (rows are read and written without their padding)
+ * row_stride : bytes between the starts of two rows of a slot
+ * height : number of rows of a frame
+ * in : file the frames are read from
+ * out : file the blurred frames are written to
+ * lock : protects the state of every slot
+ * state_changed : signalled whenever the state of a slot changes
+ */
+struct Frame_Pipeline {
+	struct Frame_Slot slots[NUM_FRAME_SLOTS];
+	size_t row_len;
+	size_t row_stride;
+	unsigned height;
+	FILE *in;
+	FILE *out;
+	pthread_mutex_t lock;
+	pthread_cond_t state_changed;
+};
+
+
+/**
+ * Moves stdout to a new file descriptor for the blurred frames, and points the old stdout at stderr
+ * so everything the rest of the program prints can't end up in the middle of the frames
+ * @return file the blurred frames should be written to
+ */
+FILE *take_stdout_for_frames(void) {
+	fflush(stdout);
+	int frames_fd = dup(STDOUT_FILENO);
+	if (frames_fd < 0 || dup2(STDERR_FILENO, STDOUT_FILENO) < 0) { error(NULL); }
+	
+	FILE *out = fdopen(frames_fd, "wb");
+	if (out == NULL) { error(NULL); }
+	return out;
+}
+
+/**
+ * Waits until a slot is in the wanted state
+ * @param pipeline : the pipeline the slot belongs to
+ * @param slot : the slot to wait for
+ * @param state : the state to wait for
+ */
+void wait_for_slot(struct Frame_Pipeline *pipeline, struct Frame_Slot *slot, enum Slot_State state) {
+	pthread_mutex_lock(&pipeline->lock);
+	while (slot->state != state) {
+		pthread_cond_wait(&pipeline->state_changed, &pipeline->lock);
+	}
+	pthread_mutex_unlock(&pipeline->lock);
+}
+
+/**
+ * Hands a slot to the next stage of the pipeline
+ * @param pipeline : the pipeline the slot belongs to
+ * @param slot : the slot to hand over
+ * @param state : the new state of the slot
+ * @param last : true if the stream ended at this slot
+ */
+void set_slot_state(struct Frame_Pipeline *pipeline, struct Frame_Slot *slot, enum Slot_State state, bool last) {
+	pthread_mutex_lock(&pipeline->lock);
+	slot->state = state;
+	slot->last = last;
+	pthread_cond_broadcast(&pipeline->state_changed);
+	pthread_mutex_unlock(&pipeline->lock);
+}
+
+/**
+ * Entry point for the thread reading frames into the pipeline
+ * @param pipelinep : pointer to the Frame_Pipeline struct
+ * @return : returns NULL
+ */
+void *read_frames(void *pipelinep) {
+	struct Frame_Pipeline *pipeline = (struct Frame_Pipeline *) pipelinep;
+	
+	for (unsigned long frame = 0; ; ++frame) {
+		struct Frame_Slot *slot = &pipeline->slots[frame % NUM_FRAME_SLOTS];
+		wait_for_slot(pipeline, slot, SLOT_EMPTY);
+
+		// The stream can only end between frames
+		size_t num_read = 0;
+		for (unsigned row = 0; row < pipeline->height; ++row) {
+			num_read += fread(slot->pixels + row * pipeline->row_stride, 1, pipeline->row_len, pipeline->in);
+			if (num_read == 0) { break; }
+		}
+		if (num_read != 0 && num_read != pipeline->row_len * pipeline->height) { error("input stream ended in the middle of a frame\n"); }
+		
+		set_slot_state(pipeline, slot, SLOT_READ, num_read == 0);
+		if (num_read == 0) { return NULL; }
+	}
+}
+
+/**
+ * Entry point for the thread writing the blurred frames out of the pipeline
+ * @param pipelinep : pointer to the Frame_Pipeline struct
+ * @return : returns NULL
+ */
+void *write_frames(void *pipelinep) {
+	struct Frame_Pipeline *pipeline = (struct Frame_Pipeline *) pipelinep;
+	
+	for (unsigned long frame = 0; ; ++frame) {
+		struct Frame_Slot *slot = &pipeline->slots[frame % NUM_FRAME_SLOTS];
+		wait_for_slot(pipeline, slot, SLOT_BLURRED);
+		if (slot->last) { return NULL; }
+
+		// Flush every frame so the next program in the pipe gets it straight away
+		for (unsigned row = 0; row < pipeline->height; ++row) {
+			if (fwrite(slot->pixels + row * pipeline->row_stride, 1, pipeline->row_len, pipeline->out) != pipeline->row_len) { error(NULL); }
+		}
+		if (fflush(pipeline->out)) { error(NULL); }
+		
+		set_slot_state(pipeline, slot, SLOT_EMPTY, false);
+	}
+}
+
+/**
+ * Blurs every raw RGBA frame read from stdin and writes them to out, reading, blurring and writing 3 consecutive frames at the same time
+ * @param width : width of every frame in pixels
+ * @param height : height of every frame in pixels
+ * @param std_dev : desired standard deviation of the gaussian blur
+ * @param device : 'c' to blur on the cpu, 'g' to blur on the gpu
+ * @param cpu_config : how the cpu blur should be performed (only used if device is 'c')
+ * @param gpu_config : how the gpu blur should be performed (only used if device is 'g', the area is ignored)
+ * @param arena : the arena the frame slots (and the scratch memory of every blur) are allocated from
+ * @param row_stride : bytes between the starts of two rows of a frame slot (at least width * 4)
+ * @param out : file the blurred frames are written to
+ */
+void blur_stream(unsigned width, unsigned height, unsigned std_dev, char device, struct Cpu_Config *cpu_config, struct Gpu_Config *gpu_config,
+		struct Img_Arena *arena, unsigned row_stride, FILE *out) {
+	// Create the 1D Gaussian convolution kernel once for every frame and output it
+	unsigned gaussian_kernel_len = std_dev * RADIUS * 2 + 1;
+	float *gaussian_kernel = malloc(sizeof(float) * gaussian_kernel_len);
+	calculate_kernel(&gaussian_kernel, gaussian_kernel_len, std_dev);
+	print_kernel(gaussian_kernel, gaussian_kernel_len);
+
+	// Allocate all the frame slots (they stay allocated for the whole stream, so the frames only use memory from the arena that was already handed out)
+	struct Frame_Pipeline pipeline;
+	size_t frame_size = (size_t) row_stride * height;
+	pipeline.row_len = (size_t) width * 4;
+	pipeline.row_stride = row_stride;
+	pipeline.height = height;
+	pipeline.in = stdin;
+	pipeline.out = out;
+	pthread_mutex_init(&pipeline.lock, NULL);
+	pthread_cond_init(&pipeline.state_changed, NULL);
+	for (unsigned i = 0; i < NUM_FRAME_SLOTS; ++i) {
+		pipeline.slots[i].pixels = arena_alloc(arena, frame_size);
+		pipeline.slots[i].state = SLOT_EMPTY;
+		pipeline.slots[i].last = false;
+	}
+
+	// Each frame is blurred in its own slot (arrays[0]), and the temp buffer (arrays[1]) is shared by all frames
+	unsigned char *frame_arrays[2] = { NULL, arena_alloc(arena, frame_size) };
+	struct Img_Data img_data;
+	img_data.png_ptr = NULL;
+	img_data.info_ptr = NULL;
+	img_data.row_pointers = NULL;
+	img_data.width = width;
+	img_data.height = height;
+	img_data.colour_type = 6;
+	img_data.bit_depth = 8;
+	img_data.pixel_length = 4;
+	img_data.arrays = frame_arrays;
+	img_data.row_stride = row_stride;
+	img_data.arena = arena;
+	img_data.mapped_file = NULL;
+	img_data.mapped_size = 0;
+
+	// Have each pinned thread first touch the rows it blurs of every slot and the temp buffer, and the scratch memory of the blur, before the first frame is read
+	if (device == 'c' && cpu_config->placement) {
+		unsigned char *touch_arrays[NUM_FRAME_SLOTS + 1];
+		for (unsigned i = 0; i < NUM_FRAME_SLOTS; ++i) { touch_arrays[i] = pipeline.slots[i].pixels; }
+		touch_arrays[NUM_FRAME_SLOTS] = frame_arrays[1];
+		first_touch_arrays(touch_arrays, NUM_FRAME_SLOTS + 1, height, row_stride, cpu_config);
+		first_touch_blur_scratch(arena, width, height, row_stride, cpu_config);
+	}
+	
+	// The gpu keeps its context (and images) for the whole stream
+	struct Gpu_Context *ctx = NULL;
+	if (device == 'g') { ctx = create_gpu_context(&img_data, gaussian_kernel, gaussian_kernel_len, gpu_config); }
+
+	// Start timing the whole stream
+	printf("Blurring stream...\n");
+	struct timespec start, finish;
+	float duration;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	// Start the reader and writer threads, they overlap with the blur of the frame between them
+	pthread_t reader, writer;
+	pthread_create(&reader, NULL, read_frames, &pipeline);
+	pthread_create(&writer, NULL, write_frames, &pipeline);
+
+	// Blur every frame as soon as it has been read
+	unsigned long num_frames = 0;
+	for (;; ++num_frames) {
+		struct Frame_Slot *slot = &pipeline.slots[num_frames % NUM_FRAME_SLOTS];
+		wait_for_slot(&pipeline, slot, SLOT_READ);
+		if (slot->last) { 
+			set_slot_state(&pipeline, slot, SLOT_BLURRED, true);
+			break; 
+		}
+
+		frame_arrays[0] = slot->pixels;
+		if (device == 'c') {
+			blur_cpu_with_kernel(&img_data, gaussian_kernel, gaussian_kernel_len, cpu_config);
+		} else {
+			blur_gpu_with_context(ctx, &img_data, NULL);
+		}
+		set_slot_state(&pipeline, slot, SLOT_BLURRED, false);
+	}
+	
+	pthread_join(reader, NULL);
+	pthread_join(writer, NULL);
+
+	// Output the duration of the whole stream
+	clock_gettime(CLOCK_MONOTONIC, &finish);
+	duration = (finish.tv_sec - start.tv_sec);
+       	duration += (finish.tv_nsec - start.tv_nsec) / 1000000000.0;
+	printf("Frames: %lu, Stream Duration: %f seconds (%f frames per second)\n\n", num_frames, duration, num_frames / duration);
+	if (device == 'c' && cpu_config->placement) { print_thread_placement(cpu_config->placement, cpu_config->num_threads); }
+
+	// Free everything (the frame slots are released with the arena)
+	if (ctx) { release_gpu_context(ctx); }
+	free(gaussian_kernel);
+	pthread_mutex_destroy(&pipeline.lock);
+	pthread_cond_destroy(&pipeline.state_changed);
+	if (fclose(out)) { error(NULL); }
+}